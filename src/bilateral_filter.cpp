@@ -1,64 +1,65 @@
 #include "opencv2/imgproc.hpp"
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/core/utility.hpp"
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <vector>
 #include "opencv2/highgui.hpp"
+#include "depth_io.hpp"
+#include "depth_batch.hpp"
+#include "buffer_pool.hpp"
+#include "depth_filters.hpp"
+#include "trace.hpp"
 using namespace cv;
 using namespace std;
 
-// 将类似深度的图像加载为单通道 CV_32F 并返回原始深度类型
-static bool loadDepthAsFloat(const String &path, Mat &depth32f, int &origDepthType)
+const String keys =
+    "{help h usage ? |     | print this message                                               }"
+    "{workers        |0    | batch mode: filtering threads (0 = number of CPUs)               }"
+    "{io_threads     |2    | batch mode: decode threads and encode threads                    }"
+    "{in_flight      |0    | batch mode: max files held in memory (0 = auto)                  }"
+    "{out_ext        |     | batch mode: output extension, e.g. .rdm for raw mapped depth (default: same as input) }"
+    "{buffer_pool_mb |512  | batch mode: cap on idle Mat buffers kept for reuse by later files (0 = off) }"
+    "{engine         |exact| exact (cv::bilateralFilter) or grid (bilateral grid, cost independent of diameter) }"
+    "{bench          |     | time both engines on the input and report their difference      }"
+    "{bench_runs     |5    | bench: repetitions per engine (median is reported)              }"
+    "{trace          |     | write per-stage Chrome trace-event JSON to this file and print a time/allocation/RSS summary }"
+    ;
+
+// 两种实现分别运行runs次，报告中位耗时以及grid相对exact的误差
+static void benchEngines(const Mat& depth32f, const DepthBilateral& params, int runs)
 {
-    Mat src = imread(path, IMREAD_UNCHANGED);
-    if (src.empty()) {
-        cerr << "Cannot read depth file: " << path << endl;
-        return false;
+    Mat results[2];
+    double median_ms[2];
+    const char* names[2] = { "exact", "grid" };
+    for (int e = 0; e < 2; e++) {
+        DepthBilateral f = params;
+        f.use_grid = (e == 1);
+        vector<double> ms;
+        for (int r = 0; r < std::max(runs, 1); r++) {
+            int64 t0 = getTickCount();
+            f.apply(depth32f, results[e]);
+            ms.push_back((getTickCount() - t0) * 1000.0 / getTickFrequency());
+        }
+        std::sort(ms.begin(), ms.end());
+        median_ms[e] = ms[ms.size() / 2];
+        cout << names[e] << ": " << median_ms[e] << " ms ("
+             << median_ms[e] * 1e6 / depth32f.total() << " ms/MP)" << endl;
     }
 
-    origDepthType = src.depth();
-
-    Mat single;
-    if (src.channels() == 1) {
-        single = src;
-    } else if (src.channels() == 3) {
-        cvtColor(src, single, COLOR_BGR2GRAY);
-    } else if (src.channels() == 4) {
-        cvtColor(src, single, COLOR_BGRA2GRAY);
-    } else {
-        Mat ch0; extractChannel(src, ch0, 0); single = ch0;
-    }
-
-    switch (single.depth()) {
-        case CV_8U:  single.convertTo(depth32f, CV_32F, 1.0); break;
-        case CV_16U: single.convertTo(depth32f, CV_32F, 1.0); break;
-        case CV_16S: single.convertTo(depth32f, CV_32F, 1.0); break;
-        case CV_32S: single.convertTo(depth32f, CV_32F, 1.0); break;
-        case CV_32F: depth32f = single;                       break;
-        case CV_64F: single.convertTo(depth32f, CV_32F, 1.0); break;
-        default:
-            cerr << "Unsupported depth type: depth=" << single.depth() << endl;
-            return false;
-    }
-    return true;
-}
-
-// Save float depth back to original-like type
-static bool saveDepthLike(const Mat &depth32f, const String &outPath, int likeDepth)
-{
-    Mat out;
-    switch (likeDepth) {
-        case CV_8U:  depth32f.convertTo(out, CV_8U);  break;
-        case CV_16U: depth32f.convertTo(out, CV_16U); break;
-        case CV_16S: depth32f.convertTo(out, CV_16S); break;
-        case CV_32S: depth32f.convertTo(out, CV_32S); break;
-        case CV_32F: out = depth32f.clone();          break;
-        case CV_64F: depth32f.convertTo(out, CV_64F); break;
-        default:
-            cerr << "Unsupported output type" << endl;
-            return false;
-    }
-    return imwrite(outPath, out);
+    Mat diff;
+    absdiff(results[0], results[1], diff);
+    vector<float> d;
+    d.reserve(diff.total());
+    for (int y = 0; y < diff.rows; y++)
+        d.insert(d.end(), diff.ptr<float>(y), diff.ptr<float>(y) + diff.cols);
+    std::sort(d.begin(), d.end());
+    double minV = 0.0, maxV = 0.0;
+    minMaxLoc(depth32f, &minV, &maxV);
+    cout << "speedup: " << median_ms[0] / median_ms[1] << "x" << endl;
+    cout << "grid vs exact |diff|: mean=" << mean(diff)[0] << ", p99=" << d[(d.size() * 99) / 100]
+         << ", max=" << d.back() << " (input range " << maxV - minV << ")" << endl;
 }
 
 int main(int argc, char** argv)
@@ -73,41 +74,91 @@ int main(int argc, char** argv)
     double sigmaSpace    = 15.0;  // 空间sigma
     int    iterations    = 1;     // 如果需要，多次应用滤波器
 
-    if (argc >= 2) depth_path = argv[1];
-    if (argc >= 3) out_path   = argv[2];
-    if (argc >= 4) diameter   = atoi(argv[3]);
-    if (argc >= 5) sigmaColor = atof(argv[4]);
-    if (argc >= 6) sigmaSpace = atof(argv[5]);
-    if (argc >= 7) iterations = atoi(argv[6]);
-
-    // 加载深度图
-    Mat depth32f;
-    int origDepth = -1;
-    if (!loadDepthAsFloat(depth_path, depth32f, origDepth)) return -1;
+    CommandLineParser parser(argc, argv, keys);
+    parser.about("Usage: bilateral_filter [depth_path|dir|list.txt] [out_path|out_dir] [diameter] [sigmaColor] [sigmaSpace] [iterations] [--engine=exact|grid] [--bench] [--workers=N]");
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    TraceSession trace(parser.get<String>("trace"));
+
+    // 位置参数：跳过--开头的可选项（sigmaColor可以是负数，所以不交给parser）
+    vector<String> args;
+    for (int i = 1; i < argc; i++)
+        if (String(argv[i]).compare(0, 2, "--") != 0) args.push_back(argv[i]);
+    if (args.size() >= 1) depth_path = args[0];
+    if (args.size() >= 2) out_path   = args[1];
+    if (args.size() >= 3) diameter   = atoi(args[2].c_str());
+    if (args.size() >= 4) sigmaColor = atof(args[3].c_str());
+    if (args.size() >= 5) sigmaSpace = atof(args[4].c_str());
+    if (args.size() >= 6) iterations = atoi(args[5].c_str());
 
     // 使直径为奇数且 >= 1
     if (diameter <= 0) diameter = 9;
     if (diameter % 2 == 0) diameter += 1;
     if (iterations < 1) iterations = 1;
 
+    const String engine = parser.get<String>("engine");
+    if (engine != "exact" && engine != "grid") {
+        cerr << "Unknown engine: " << engine << " (expected exact or grid)" << endl;
+        return -1;
+    }
+
+    DepthBilateral params;
+    params.use_grid   = (engine == "grid");
+    params.diameter   = diameter;
+    params.sigmaColor = sigmaColor;
+    params.sigmaSpace = sigmaSpace;
+    params.iterations = iterations;
+
+    if (isDepthBatchInput(depth_path)) {
+        // 批处理：输入为目录或文件列表，输出为目录；sigmaColor<0时按每个文件自身的范围计算
+        vector<String> files;
+        if (!listDepthInputs(depth_path, files)) return -1;
+
+        DepthBatchOptions opts;
+        opts.workers    = parser.get<int>("workers");
+        opts.io_threads = parser.get<int>("io_threads");
+        opts.in_flight  = parser.get<int>("in_flight");
+        opts.out_ext    = parser.get<String>("out_ext");
+        if (parser.get<double>("buffer_pool_mb") > 0.0)
+            installBufferPool(parser.get<double>("buffer_pool_mb")); // 同尺寸的文件复用前一个文件释放的缓冲区
+
+        DepthBatchStats stats;
+        bool ok = runDepthBatch(files, out_path, [&]() -> DepthFilterFn {
+            // 每个工作线程一个实例，缓冲区在该线程处理的文件之间复用
+            Ptr<DepthBilateral> f = makePtr<DepthBilateral>(params);
+            return [f](const Mat& src, Mat& dst) {
+                f->apply(src, dst);
+                return true;
+            };
+        }, opts, stats);
+        printDepthBatchStats(stats);
+        return ok ? 0 : -1;
+    }
+
+    // 加载深度图（只解码一次，同时得到原始位深）
+    Mat depth32f;
+    int origDepth = -1;
+    if (!loadDepthAsFloat(depth_path, depth32f, origDepth)) return -1;
+
     // 从数据范围计算合理的sigmaColor
     double minV = 0.0, maxV = 0.0;
     minMaxLoc(depth32f, &minV, &maxV);
     cout << "Input depth range: [" << minV << ", " << maxV << "]\n";
-    double range = maxV - minV;
-    if (sigmaColor < 0.0) {
-        // 10%作为默认的动态范围  
-        sigmaColor = (range > 0.0) ? 0.10 * range : 1.0;
+    // 10%作为默认的动态范围
+    sigmaColor = autoSigmaColor(depth32f, sigmaColor);
+    params.sigmaColor = sigmaColor;
+
+    if (parser.has("bench")) {
+        cout << "Params: d=" << diameter << ", sigmaColor=" << sigmaColor
+             << ", sigmaSpace=" << sigmaSpace << ", iterations=" << iterations << endl;
+        benchEngines(depth32f, params, parser.get<int>("bench_runs"));
+        return 0;
     }
 
-    // 应用双边滤波器（如果需要则迭代应用）
-    Mat current = depth32f;
-    for (int i = 0; i < iterations; ++i) {
-        Mat out;
-        bilateralFilter(current, out, diameter, sigmaColor, sigmaSpace);
-        current = out; 
-    }
-    Mat filtered = current;
+    Mat filtered;
+    params.apply(depth32f, filtered);
 
     // 保存为原始数值类型
     if (!saveDepthLike(filtered, out_path, origDepth)) {
@@ -115,8 +166,9 @@ int main(int argc, char** argv)
         return -1;
     }
 
-    cout << "Params: d=" << diameter << ", sigmaColor=" << sigmaColor
+    cout << "Params: engine=" << engine << ", d=" << diameter << ", sigmaColor=" << sigmaColor
          << ", sigmaSpace=" << sigmaSpace << ", iterations=" << iterations << endl;
+    trace.finish();
 
     
         Mat visFloat, vis8u;
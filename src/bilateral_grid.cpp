@@ -0,0 +1,199 @@
+#include "bilateral_grid.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+
+using namespace cv;
+using namespace std;
+
+// 网格四周留出的空格子数，使5抽头模糊在边界处无需特殊处理
+static const int GRID_PAD = 2;
+
+BilateralGrid::BilateralGrid()
+    : gw(0), gh(0), gd(0), space_scale(1.0), range_scale(1.0), min_value(0.0)
+{
+}
+
+void BilateralGrid::filter(const Mat& src, Mat& dst, double sigmaSpace, double sigmaColor, int iterations)
+{
+    CV_Assert(src.type() == CV_32FC1 && sigmaSpace > 0.0 && sigmaColor > 0.0);
+
+    // 第一次迭代读src，之后在ping/pong之间交替，最后一次写到dst
+    const Mat* in = &src;
+    const int n = std::max(iterations, 1);
+    for(int it = 0; it < n; it++)
+    {
+        // 浮点深度常用NaN/±inf表示无效，值域只取有限值；无效像素不撒点，切片时原样写回
+        double minV = 0.0, maxV = 0.0;
+        if(checkRange(*in))
+            minMaxLoc(*in, &minV, &maxV);
+        else
+        {
+            compare(abs(*in), Scalar(FLT_MAX), finite, CMP_LE);
+            minMaxLoc(*in, &minV, &maxV, 0, 0, finite);
+        }
+        double sigma_r = sigmaColor;
+        if((maxV - minV) / sigma_r > MAX_RANGE_BINS)
+        {
+            sigma_r = (maxV - minV) / MAX_RANGE_BINS;
+            if(it == 0)
+                cerr << "BilateralGrid: sigmaColor raised to " << sigma_r << " to bound the grid size" << endl;
+        }
+
+        space_scale = 1.0 / sigmaSpace;
+        range_scale = 1.0 / sigma_r;
+        min_value = minV;
+        gw = (int)((src.cols - 1) * space_scale + 0.5) + 1 + 2 * GRID_PAD;
+        gh = (int)((src.rows - 1) * space_scale + 0.5) + 1 + 2 * GRID_PAD;
+        gd = (int)((maxV - minV) * range_scale + 0.5) + 1 + 2 * GRID_PAD;
+
+        splat(*in);
+        blur();
+
+        // 切片只依赖网格和该像素自身的值，所以out与in相同时也可以原地写
+        Mat& out = it == n - 1 ? dst : (it % 2 == 0 ? ping : pong);
+        slice(*in, out);
+        in = &out;
+    }
+}
+
+void BilateralGrid::splat(const Mat& src)
+{
+    const size_t cells = (size_t)gw * gh * gd * 2;
+    grid.assign(cells, 0.f);
+    tmp.resize(cells);
+
+    // 最近邻撒点：第cy层网格只接收round(y/sigmaSpace)==cy的图像行，按网格行并行没有写冲突。
+    // 行到网格行的映射单调，预先算好后每个并行块用二分查找自己的行区间
+    const double ss = space_scale, rs = range_scale, mv = min_value;
+    row_cell.resize(src.rows);
+    for(int y = 0; y < src.rows; y++)
+        row_cell[y] = (int)(y * ss + 0.5);
+    const int core_h = gh - 2 * GRID_PAD;
+    const int width = gw, depth = gd;
+    parallel_for_(Range(0, core_h), [&](const Range& r)
+    {
+        const int y0 = (int)(std::lower_bound(row_cell.begin(), row_cell.end(), r.start) - row_cell.begin());
+        const int y1 = (int)(std::lower_bound(row_cell.begin(), row_cell.end(), r.end) - row_cell.begin());
+        for(int y = y0; y < y1; y++)
+        {
+            const float* s = src.ptr<float>(y);
+            float* plane = &grid[(size_t)(row_cell[y] + GRID_PAD) * width * depth * 2];
+            for(int x = 0; x < src.cols; x++)
+            {
+                if(!std::isfinite(s[x]))
+                    continue;
+                const int gx = (int)(x * ss + 0.5) + GRID_PAD;
+                const int gz = (int)((s[x] - mv) * rs + 0.5) + GRID_PAD;
+                float* c = plane + ((size_t)gx * depth + gz) * 2;
+                c[0] += s[x];
+                c[1] += 1.f;
+            }
+        }
+    });
+}
+
+// 沿一个轴的[1 4 6 4 1]/16模糊：stride为该轴相邻格子之间的float数，每层网格内并行
+static void blurAxis(const vector<float>& src, vector<float>& dst, int gw, int gh, int gd, int axis)
+{
+    const size_t sz = 2, sx = (size_t)gd * 2, sy = (size_t)gw * gd * 2;
+    const size_t stride = axis == 0 ? sx : (axis == 1 ? sy : sz);
+    const int n = axis == 0 ? gw : (axis == 1 ? gh : gd);
+    parallel_for_(Range(0, gh), [&](const Range& r)
+    {
+        for(int y = r.start; y < r.end; y++)
+        {
+            for(int x = 0; x < gw; x++)
+            {
+                const int i = axis == 0 ? x : (axis == 1 ? y : 0);
+                const size_t base = (size_t)y * sy + (size_t)x * sx;
+                float* d = &dst[base];
+                const float* s = &src[base];
+                if(axis == 2)
+                {
+                    // 值域方向在内存中连续，整行一起处理
+                    for(int z = 0; z < n; z++)
+                    {
+                        for(int k = 0; k < 2; k++)
+                        {
+                            float v = 6.f * s[z * 2 + k];
+                            if(z >= 1)     v += 4.f * s[(z - 1) * 2 + k];
+                            if(z >= 2)     v += s[(z - 2) * 2 + k];
+                            if(z + 1 < n)  v += 4.f * s[(z + 1) * 2 + k];
+                            if(z + 2 < n)  v += s[(z + 2) * 2 + k];
+                            d[z * 2 + k] = v * (1.f / 16.f);
+                        }
+                    }
+                    continue;
+                }
+                const float* m2 = i >= 2 ? s - 2 * stride : 0;
+                const float* m1 = i >= 1 ? s - stride : 0;
+                const float* p1 = i + 1 < n ? s + stride : 0;
+                const float* p2 = i + 2 < n ? s + 2 * stride : 0;
+                for(int z = 0; z < gd * 2; z++)
+                {
+                    float v = 6.f * s[z];
+                    if(m2) v += m2[z];
+                    if(m1) v += 4.f * m1[z];
+                    if(p1) v += 4.f * p1[z];
+                    if(p2) v += p2[z];
+                    d[z] = v * (1.f / 16.f);
+                }
+            }
+        }
+    });
+}
+
+void BilateralGrid::blur()
+{
+    // 三个轴依次在grid和tmp之间乒乓，结果回到tmp后交换
+    blurAxis(grid, tmp, gw, gh, gd, 0);
+    blurAxis(tmp, grid, gw, gh, gd, 1);
+    blurAxis(grid, tmp, gw, gh, gd, 2);
+    grid.swap(tmp);
+}
+
+void BilateralGrid::slice(const Mat& src, Mat& dst)
+{
+    dst.create(src.size(), CV_32F);
+    const double ss = space_scale, rs = range_scale, mv = min_value;
+    const size_t sx = (size_t)gd * 2, sy = (size_t)gw * gd * 2;
+    parallel_for_(Range(0, src.rows), [&](const Range& r)
+    {
+        for(int y = r.start; y < r.end; y++)
+        {
+            const float* s = src.ptr<float>(y);
+            float* d = dst.ptr<float>(y);
+            const float fy = (float)(y * ss) + GRID_PAD;
+            const int iy = (int)fy;
+            const float ay = fy - iy;
+            for(int x = 0; x < src.cols; x++)
+            {
+                if(!std::isfinite(s[x]))
+                {
+                    d[x] = s[x];
+                    continue;
+                }
+                const float fx = (float)(x * ss) + GRID_PAD;
+                const float fz = (float)((s[x] - mv) * rs) + GRID_PAD;
+                const int ix = (int)fx, iz = (int)fz;
+                const float ax = fx - ix, az = fz - iz;
+                const float* c = &grid[(size_t)iy * sy + (size_t)ix * sx + (size_t)iz * 2];
+
+                // 三线性插值(加权值, 权重)，再相除
+                float v = 0.f, w = 0.f;
+                for(int k = 0; k < 8; k++)
+                {
+                    const int dx = k & 1, dy = (k >> 1) & 1, dz = k >> 2;
+                    const float wk = (dx ? ax : 1.f - ax) * (dy ? ay : 1.f - ay) * (dz ? az : 1.f - az);
+                    const float* cc = c + dy * sy + dx * sx + dz * 2;
+                    v += wk * cc[0];
+                    w += wk * cc[1];
+                }
+                d[x] = w > 1e-6f ? v / w : s[x];
+            }
+        }
+    });
+}
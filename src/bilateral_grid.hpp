@@ -0,0 +1,37 @@
+#ifndef DISPARITY_BILATERAL_GRID_HPP
+#define DISPARITY_BILATERAL_GRID_HPP
+
+#include "opencv2/core.hpp"
+#include <vector>
+
+// 双边网格（Chen/Paris/Durand）近似的双边滤波，用于单通道CV_32F深度图。
+// 把像素按(x/sigmaSpace, y/sigmaSpace, value/sigmaColor)撒到三维网格，网格上做三次可分离的[1 4 6 4 1]/16模糊，
+// 再三线性插值取回。耗时与像素数和网格大小成正比，与滤波核直径无关，sigmaSpace越大反而越快。
+// 与cv::bilateralFilter相比，空间核不截断到diameter，等效于diameter约为6*sigmaSpace的高斯核。
+// NaN/±inf像素不参与滤波，也不影响值域范围，输出中保持原值。
+// 网格缓冲区和迭代用的乒乓图像在多次调用之间复用；一个实例不能同时被多个线程使用。
+class BilateralGrid
+{
+public:
+    BilateralGrid();
+
+    // iterations次迭代，每次以上一次的结果重新建网格；src与dst可以是同一个Mat
+    void filter(const cv::Mat& src, cv::Mat& dst, double sigmaSpace, double sigmaColor, int iterations = 1);
+
+    // 网格在值域方向的最大格数；sigmaColor相对数据范围过小时会被放大到range/maxBins
+    static const int MAX_RANGE_BINS = 256;
+
+private:
+    void splat(const cv::Mat& src);
+    void blur();
+    void slice(const cv::Mat& src, cv::Mat& dst);
+
+    std::vector<float> grid, tmp; // 每个格子(加权值, 权重)两个float
+    std::vector<int> row_cell;    // 图像行对应的网格行
+    cv::Mat ping, pong;
+    cv::Mat finite;               // 有限值像素的掩码，只在输入含NaN/inf时使用
+    int gw, gh, gd;
+    double space_scale, range_scale, min_value;
+};
+
+#endif
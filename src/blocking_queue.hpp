@@ -0,0 +1,52 @@
+#ifndef DISPARITY_BLOCKING_QUEUE_HPP
+#define DISPARITY_BLOCKING_QUEUE_HPP
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// 简单的阻塞队列，用于在流水线各阶段之间传递缓冲区
+template<typename T>
+class BlockingQueue
+{
+public:
+    BlockingQueue() : closed(false) {}
+
+    void push(const T& item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            items.push_back(item);
+        }
+        cond.notify_one();
+    }
+
+    // 队列关闭且为空时返回false
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        cond.wait(lock, [this]{ return closed || !items.empty(); });
+        if(items.empty())
+            return false;
+        item = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            closed = true;
+        }
+        cond.notify_all();
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable cond;
+    std::deque<T> items;
+    bool closed;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "buffer_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+namespace
+{
+
+class PoolAllocator : public MatAllocator
+{
+public:
+    PoolAllocator() : backend(matAllocCounter()), limit(0), pooled_bytes(0), pooled_count(0), hits(0), misses(0) {}
+
+    UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                       AccessFlag flags, UMatUsageFlags usage) const override
+    {
+        if(data) // 外部数据只包装，不分配
+            return backend->allocate(dims, sizes, type, data, step, flags, usage);
+
+        // 连续布局的步长和总字节数，与标准分配器的计算相同
+        size_t total = CV_ELEM_SIZE(type);
+        for(int i = dims - 1; i >= 0; i--)
+        {
+            if(step)
+                step[i] = total;
+            total *= sizes[i];
+        }
+        {
+            lock_guard<mutex> g(lock);
+            map<size_t, vector<UMatData*> >::iterator it = free_lists.find(total);
+            if(it != free_lists.end() && !it->second.empty())
+            {
+                UMatData* u = it->second.back();
+                it->second.pop_back();
+                pooled_bytes -= total;
+                pooled_count--;
+                hits++;
+                return u;
+            }
+            misses++;
+        }
+        UMatData* u = backend->allocate(dims, sizes, type, data, step, flags, usage);
+        if(u)
+            u->currAllocator = this;
+        return u;
+    }
+
+    bool allocate(UMatData* u, AccessFlag flags, UMatUsageFlags usage) const override
+    {
+        return backend->allocate(u, flags, usage);
+    }
+
+    // 引用计数归零的缓冲区：状态与刚分配时相同，放回空闲表；带标志的（UMat映射等）以及超出上限的释放回堆
+    void deallocate(UMatData* u) const override
+    {
+        if(!u)
+            return;
+        {
+            lock_guard<mutex> g(lock);
+            if(u->flags == 0 && pooled_bytes + u->size <= limit)
+            {
+                free_lists[u->size].push_back(u);
+                pooled_bytes += u->size;
+                pooled_count++;
+                return;
+            }
+        }
+        backend->deallocate(u);
+    }
+
+    void setLimit(size_t bytes)
+    {
+        lock_guard<mutex> g(lock);
+        limit = bytes;
+    }
+
+    BufferPoolStats stats() const
+    {
+        lock_guard<mutex> g(lock);
+        BufferPoolStats s;
+        s.hits = hits;
+        s.misses = misses;
+        s.pooled = pooled_count;
+        s.pooled_mb = pooled_bytes / (1024.0 * 1024.0);
+        return s;
+    }
+
+    void trim()
+    {
+        map<size_t, vector<UMatData*> > released;
+        {
+            lock_guard<mutex> g(lock);
+            released.swap(free_lists);
+            pooled_bytes = 0;
+            pooled_count = 0;
+        }
+        for(map<size_t, vector<UMatData*> >::iterator it = released.begin(); it != released.end(); ++it)
+            for(size_t i = 0; i < it->second.size(); i++)
+                backend->deallocate(it->second[i]);
+    }
+
+private:
+    MatAllocator* backend;
+    mutable mutex lock;
+    // 按字节数分组的空闲缓冲区；同一大小的vector容量在预热后不再增长
+    mutable map<size_t, vector<UMatData*> > free_lists;
+    size_t limit;
+    mutable size_t pooled_bytes;
+    mutable long long pooled_count, hits, misses;
+};
+
+PoolAllocator* g_pool = 0;
+mutex g_install_lock;
+
+} // namespace
+
+void installBufferPool(double limit_mb)
+{
+    lock_guard<mutex> g(g_install_lock);
+    if(!g_pool)
+    {
+        // 不释放：进程结束前可能还有Mat引用着池分配的内存
+        g_pool = new PoolAllocator();
+        Mat::setDefaultAllocator(g_pool);
+    }
+    g_pool->setLimit((size_t)(std::max(limit_mb, 0.0) * 1024.0 * 1024.0));
+}
+
+bool bufferPoolInstalled()
+{
+    lock_guard<mutex> g(g_install_lock);
+    return g_pool != 0;
+}
+
+BufferPoolStats bufferPoolStats()
+{
+    lock_guard<mutex> g(g_install_lock);
+    if(!g_pool)
+    {
+        BufferPoolStats s;
+        s.hits = s.misses = s.pooled = 0;
+        s.pooled_mb = 0.0;
+        return s;
+    }
+    return g_pool->stats();
+}
+
+void trimBufferPool()
+{
+    lock_guard<mutex> g(g_install_lock);
+    if(g_pool)
+        g_pool->trim();
+}
@@ -0,0 +1,32 @@
+#ifndef DISPARITY_BUFFER_POOL_HPP
+#define DISPARITY_BUFFER_POOL_HPP
+
+#include "opencv2/core.hpp"
+
+// 进程内共享的Mat缓冲区池。安装后作为Mat的默认分配器：Mat释放的缓冲区不还给堆，而是按字节数
+// （尺寸 x 元素大小）放进空闲表，之后同样大小的分配直接取用。各阶段的输出、OpenCV函数内部的临时Mat
+// 都经过它，所以处理同尺寸的帧时，预热一帧之后的Mat分配全部由空闲表满足，不再向堆申请。
+// 类型不同但字节数相同的缓冲区可以互相复用（Mat的步长在分配时按类型重新计算）。
+//
+// 空闲缓冲区总大小超过上限时，多出的缓冲区直接释放回堆。向堆申请的分配经过trace的计数分配器，
+// 所以matAllocCounts()统计的就是真正的堆分配；池命中不计入。
+// 只管理Mat自己分配的连续内存，包装外部数据的Mat以及cv::AutoBuffer、std::vector不经过它。
+
+struct BufferPoolStats
+{
+    long long hits;    // 由空闲表满足的分配
+    long long misses;  // 向堆申请的分配
+    long long pooled;  // 当前空闲表中的缓冲区数
+    double pooled_mb;  // 当前空闲表中缓冲区的总大小
+};
+
+// 安装为Mat的默认分配器，重复调用只更新上限。limit_mb为空闲缓冲区总大小的上限
+void installBufferPool(double limit_mb = 512.0);
+bool bufferPoolInstalled();
+
+BufferPoolStats bufferPoolStats();
+
+// 把空闲表中的缓冲区全部释放回堆（池仍然保持安装）
+void trimBufferPool();
+
+#endif
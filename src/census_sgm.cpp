@@ -0,0 +1,909 @@
+#include "census_sgm.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define CENSUS_X86 1
+#define CENSUS_TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <immintrin.h>
+#include <intrin.h>
+#define CENSUS_X86 1
+#define CENSUS_TARGET_AVX2
+#else
+#define CENSUS_X86 0
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace
+{
+
+typedef short CostType;  // 单方向路径代价Lr
+typedef ushort SumType;  // 各方向路径代价之和S
+
+const CostType COST_INF = 0x3FFF; // 缓冲区两端的哨兵值，保证d-1/d+1越界时不会被选中
+const int L_PAD = 16;             // 路径代价缓冲区两侧的填充（元素个数）
+const int DIAG_OVERLAP = 32;      // 对角方向按列分块聚合时，每块左右额外预热的列数
+// 竖直/对角聚合的列块宽度。固定宽度而不按线程数划分：预热不能让块边界完全精确，
+// 划分随线程数变化时结果也会随之变化（条带和多路模式下线程数为1）
+const int VERTICAL_STRIPE_W = 8 * DIAG_OVERLAP;
+// 聚合按行带进行，不保存整个代价体：S只有一个行带（BAND_ROWS x W x D），匹配代价放在
+// BAND_ROWS + BAND_OVERLAP行的环形缓冲区中，每行只算一次。从上到下的路径在行带之间保存状态，结果精确；
+// 从下到上的路径在行带下方多走BAND_OVERLAP行来预热，与列块的处理方式相同。行带的划分只取决于图像高度
+const int BAND_ROWS = 128;
+const int BAND_OVERLAP = 2 * DIAG_OVERLAP;
+const int COST_RING_ROWS = BAND_ROWS + BAND_OVERLAP;
+
+enum Kernel { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+
+static inline int popcount64(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 单像素、单方向的路径代价更新
+//   Lc(d) = C(d) + min(Lp(d), Lp(d-1)+P1, Lp(d+1)+P1, minLp+P2) - minLp
+// Lp[-1]与Lp[D]为COST_INF哨兵。init为true时S = Lc，否则S += Lc（饱和加）。返回min(Lc)。
+
+static CostType updatePathScalar(const uchar* C, const CostType* Lp, int minLp, CostType* Lc,
+                                 SumType* S, int D, int P1, int P2, bool init)
+{
+    int minLc = COST_INF;
+    for(int d = 0; d < D; d++)
+    {
+        int t = std::min(std::min((int)Lp[d], minLp + P2), std::min((int)Lp[d-1], (int)Lp[d+1]) + P1);
+        int v = C[d] + t - minLp;
+        Lc[d] = (CostType)v;
+        S[d] = init ? (SumType)v : (SumType)std::min(S[d] + v, 0xFFFF);
+        minLc = std::min(minLc, v);
+    }
+    return (CostType)minLc;
+}
+
+#if CENSUS_X86
+static inline CostType hminEpi16(__m128i v)
+{
+    v = _mm_min_epi16(v, _mm_srli_si128(v, 8));
+    v = _mm_min_epi16(v, _mm_srli_si128(v, 4));
+    v = _mm_min_epi16(v, _mm_srli_si128(v, 2));
+    return (CostType)_mm_cvtsi128_si32(v);
+}
+
+static CostType updatePathSSE2(const uchar* C, const CostType* Lp, int minLp, CostType* Lc,
+                               SumType* S, int D, int P1, int P2, bool init)
+{
+    const __m128i vP1 = _mm_set1_epi16((short)P1);
+    const __m128i vMinP2 = _mm_set1_epi16((short)(minLp + P2));
+    const __m128i vMinLp = _mm_set1_epi16((short)minLp);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i vMin = _mm_set1_epi16(COST_INF);
+    for(int d = 0; d < D; d += 8)
+    {
+        __m128i c  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(C + d)), zero);
+        __m128i l0 = _mm_loadu_si128((const __m128i*)(Lp + d));
+        __m128i lm = _mm_loadu_si128((const __m128i*)(Lp + d - 1));
+        __m128i lp = _mm_loadu_si128((const __m128i*)(Lp + d + 1));
+        __m128i t  = _mm_min_epi16(_mm_min_epi16(l0, vMinP2), _mm_adds_epi16(_mm_min_epi16(lm, lp), vP1));
+        __m128i v  = _mm_sub_epi16(_mm_add_epi16(c, t), vMinLp);
+        _mm_storeu_si128((__m128i*)(Lc + d), v);
+        __m128i s = init ? v : _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(S + d)), v);
+        _mm_storeu_si128((__m128i*)(S + d), s);
+        vMin = _mm_min_epi16(vMin, v);
+    }
+    return hminEpi16(vMin);
+}
+
+CENSUS_TARGET_AVX2
+static CostType updatePathAVX2(const uchar* C, const CostType* Lp, int minLp, CostType* Lc,
+                               SumType* S, int D, int P1, int P2, bool init)
+{
+    const __m256i vP1 = _mm256_set1_epi16((short)P1);
+    const __m256i vMinP2 = _mm256_set1_epi16((short)(minLp + P2));
+    const __m256i vMinLp = _mm256_set1_epi16((short)minLp);
+    __m256i vMin = _mm256_set1_epi16(COST_INF);
+    for(int d = 0; d < D; d += 16)
+    {
+        __m256i c  = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(C + d)));
+        __m256i l0 = _mm256_loadu_si256((const __m256i*)(Lp + d));
+        __m256i lm = _mm256_loadu_si256((const __m256i*)(Lp + d - 1));
+        __m256i lp = _mm256_loadu_si256((const __m256i*)(Lp + d + 1));
+        __m256i t  = _mm256_min_epi16(_mm256_min_epi16(l0, vMinP2), _mm256_adds_epi16(_mm256_min_epi16(lm, lp), vP1));
+        __m256i v  = _mm256_sub_epi16(_mm256_add_epi16(c, t), vMinLp);
+        _mm256_storeu_si256((__m256i*)(Lc + d), v);
+        __m256i s = init ? v : _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(S + d)), v);
+        _mm256_storeu_si256((__m256i*)(S + d), s);
+        vMin = _mm256_min_epi16(vMin, v);
+    }
+    __m128i m = _mm_min_epi16(_mm256_castsi256_si128(vMin), _mm256_extracti128_si256(vMin, 1));
+    m = _mm_min_epi16(m, _mm_srli_si128(m, 8));
+    m = _mm_min_epi16(m, _mm_srli_si128(m, 4));
+    m = _mm_min_epi16(m, _mm_srli_si128(m, 2));
+    return (CostType)_mm_cvtsi128_si32(m);
+}
+#endif
+
+typedef CostType (*UpdatePathFn)(const uchar*, const CostType*, int, CostType*, SumType*, int, int, int, bool);
+
+// S += acc（饱和加）。竖直方向先把同一像素的几个方向累加在L1中的acc里，再一次性写回S
+static void addSumScalar(SumType* S, const SumType* acc, int D)
+{
+    for(int d = 0; d < D; d++)
+        S[d] = (SumType)std::min(S[d] + acc[d], 0xFFFF);
+}
+
+#if CENSUS_X86
+static void addSumSSE2(SumType* S, const SumType* acc, int D)
+{
+    for(int d = 0; d < D; d += 8)
+        _mm_storeu_si128((__m128i*)(S + d), _mm_adds_epu16(_mm_loadu_si128((const __m128i*)(S + d)),
+                                                           _mm_loadu_si128((const __m128i*)(acc + d))));
+}
+
+CENSUS_TARGET_AVX2
+static void addSumAVX2(SumType* S, const SumType* acc, int D)
+{
+    for(int d = 0; d < D; d += 16)
+        _mm256_storeu_si256((__m256i*)(S + d), _mm256_adds_epu16(_mm256_loadu_si256((const __m256i*)(S + d)),
+                                                                 _mm256_loadu_si256((const __m256i*)(acc + d))));
+}
+#endif
+
+typedef void (*AddSumFn)(SumType*, const SumType*, int);
+
+//////////////////////////////////////////////////////////////////////////////
+// 赢者通吃：返回S中最小值所在的视差，second为排除best±1之后的最小值
+
+static int selectScalar(const SumType* S, int D, int& best_cost, int& second)
+{
+    int best = 0;
+    best_cost = S[0];
+    for(int d = 1; d < D; d++)
+        if(S[d] < best_cost)
+        {
+            best_cost = S[d];
+            best = d;
+        }
+    second = 0xFFFF;
+    for(int d = 0; d < D; d++)
+        if(std::abs(d - best) > 1)
+            second = std::min(second, (int)S[d]);
+    return best;
+}
+
+#if CENSUS_X86
+// S的有效值小于0x8000（由P2上限保证），因此可以用有符号16位比较
+static int selectSSE2(const SumType* S, int D, int& best_cost, int& second)
+{
+    __m128i vBest = _mm_set1_epi16(0x7FFF), vIdx = _mm_setzero_si128();
+    __m128i vCur = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m128i vStep = _mm_set1_epi16(8);
+    for(int d = 0; d < D; d += 8)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)(S + d));
+        __m128i m = _mm_cmpgt_epi16(vBest, s);
+        vBest = _mm_min_epi16(vBest, s);
+        vIdx = _mm_or_si128(_mm_and_si128(m, vCur), _mm_andnot_si128(m, vIdx));
+        vCur = _mm_add_epi16(vCur, vStep);
+    }
+    short bv[8], bi[8];
+    _mm_storeu_si128((__m128i*)bv, vBest);
+    _mm_storeu_si128((__m128i*)bi, vIdx);
+    int best = bi[0];
+    best_cost = bv[0];
+    for(int k = 1; k < 8; k++)
+        if(bv[k] < best_cost || (bv[k] == best_cost && bi[k] < best))
+        {
+            best_cost = bv[k];
+            best = bi[k];
+        }
+
+    const __m128i vLo = _mm_set1_epi16((short)(best - 2)), vHi = _mm_set1_epi16((short)(best + 2));
+    __m128i vSecond = _mm_set1_epi16(0x7FFF);
+    vCur = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    for(int d = 0; d < D; d += 8)
+    {
+        __m128i s = _mm_loadu_si128((const __m128i*)(S + d));
+        __m128i near_best = _mm_and_si128(_mm_cmpgt_epi16(vCur, vLo), _mm_cmplt_epi16(vCur, vHi));
+        s = _mm_or_si128(_mm_andnot_si128(near_best, s), _mm_and_si128(near_best, _mm_set1_epi16(0x7FFF)));
+        vSecond = _mm_min_epi16(vSecond, s);
+        vCur = _mm_add_epi16(vCur, vStep);
+    }
+    second = hminEpi16(vSecond);
+    return best;
+}
+
+CENSUS_TARGET_AVX2
+static int selectAVX2(const SumType* S, int D, int& best_cost, int& second)
+{
+    __m256i vBest = _mm256_set1_epi16(0x7FFF), vIdx = _mm256_setzero_si256();
+    const __m256i vFirst = _mm256_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m256i vStep = _mm256_set1_epi16(16);
+    __m256i vCur = vFirst;
+    for(int d = 0; d < D; d += 16)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(S + d));
+        __m256i m = _mm256_cmpgt_epi16(vBest, s);
+        vBest = _mm256_min_epi16(vBest, s);
+        vIdx = _mm256_blendv_epi8(vIdx, vCur, m);
+        vCur = _mm256_add_epi16(vCur, vStep);
+    }
+    // 无分支的水平归约：先求最小代价，再在取到最小值的通道中求最小下标（代价<0x8000，可按无符号处理）
+    __m128i b = _mm_min_epu16(_mm256_castsi256_si128(vBest), _mm256_extracti128_si256(vBest, 1));
+    best_cost = _mm_cvtsi128_si32(_mm_minpos_epu16(b)) & 0xFFFF;
+    const __m256i vEq = _mm256_cmpeq_epi16(vBest, _mm256_set1_epi16((short)best_cost));
+    const __m256i vCand = _mm256_or_si256(vIdx, _mm256_andnot_si256(vEq, _mm256_set1_epi16(-1)));
+    __m128i i = _mm_min_epu16(_mm256_castsi256_si128(vCand), _mm256_extracti128_si256(vCand, 1));
+    const int best = _mm_cvtsi128_si32(_mm_minpos_epu16(i)) & 0xFFFF;
+
+    const __m256i vLo = _mm256_set1_epi16((short)(best - 2)), vHi = _mm256_set1_epi16((short)(best + 2));
+    const __m256i vMax = _mm256_set1_epi16(0x7FFF);
+    __m256i vSecond = vMax;
+    vCur = vFirst;
+    for(int d = 0; d < D; d += 16)
+    {
+        __m256i s = _mm256_loadu_si256((const __m256i*)(S + d));
+        __m256i near_best = _mm256_and_si256(_mm256_cmpgt_epi16(vCur, vLo), _mm256_cmpgt_epi16(vHi, vCur));
+        vSecond = _mm256_min_epi16(vSecond, _mm256_blendv_epi8(s, vMax, near_best));
+        vCur = _mm256_add_epi16(vCur, vStep);
+    }
+    __m128i m = _mm_min_epi16(_mm256_castsi256_si128(vSecond), _mm256_extracti128_si256(vSecond, 1));
+    second = hminEpi16(m);
+    return best;
+}
+#endif
+
+typedef int (*SelectFn)(const SumType*, int, int&, int&);
+
+//////////////////////////////////////////////////////////////////////////////
+// 右视差：左图像素x在视差d处对应右图像素xr = x - minD - d。按x顺序扫描S，
+// 把每个代价"散射"到对应的xr上取最小值，这样对S的访问是顺序的；
+// x递增时同一xr的d也递增，严格小于比较保证平局时取最小的d。
+
+static void scatterRightRange(const SumType* Sp, int xr0, int d_begin, int d_end, int width,
+                              short* rcost, short* rdisp)
+{
+    const int d_lo = std::max(d_begin, xr0 - (width - 1)), d_hi = std::min(d_end, xr0 + 1);
+    for(int d = d_lo; d < d_hi; d++)
+    {
+        int xr = xr0 - d;
+        if(Sp[d] < rcost[xr])
+        {
+            rcost[xr] = (short)Sp[d];
+            rdisp[xr] = (short)d;
+        }
+    }
+}
+
+static void scatterRightScalar(const SumType* Sp, int xr0, int D, int width, short* rcost, short* rdisp)
+{
+    scatterRightRange(Sp, xr0, 0, D, width, rcost, rdisp);
+}
+
+#if CENSUS_X86
+static void scatterRightSSE2(const SumType* Sp, int xr0, int D, int width, short* rcost, short* rdisp)
+{
+    const __m128i vRev = _mm_setr_epi16(7, 6, 5, 4, 3, 2, 1, 0);
+    int d = 0;
+    for(; d + 8 <= D; d += 8)
+    {
+        const int lo = xr0 - d - 7;
+        if(lo < 0 || xr0 - d >= width)
+        {
+            scatterRightRange(Sp, xr0, d, d + 8, width, rcost, rdisp);
+            continue;
+        }
+        // 反转8个元素，使第j个通道对应xr = lo + j（即视差d + 7 - j）
+        __m128i s = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)(Sp + d)), 0x4E);
+        s = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0x1B), 0x1B);
+        __m128i c = _mm_loadu_si128((const __m128i*)(rcost + lo));
+        __m128i m = _mm_cmpgt_epi16(c, s);
+        _mm_storeu_si128((__m128i*)(rcost + lo), _mm_min_epi16(c, s));
+        __m128i idx = _mm_add_epi16(_mm_set1_epi16((short)d), vRev);
+        __m128i i = _mm_loadu_si128((const __m128i*)(rdisp + lo));
+        _mm_storeu_si128((__m128i*)(rdisp + lo), _mm_or_si128(_mm_and_si128(m, idx), _mm_andnot_si128(m, i)));
+    }
+}
+
+CENSUS_TARGET_AVX2
+static void scatterRightAVX2(const SumType* Sp, int xr0, int D, int width, short* rcost, short* rdisp)
+{
+    const __m256i vRevBytes = _mm256_setr_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1,
+                                               14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    const __m256i vRev = _mm256_setr_epi16(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for(int d = 0; d < D; d += 16)
+    {
+        const int lo = xr0 - d - 15;
+        if(lo < 0 || xr0 - d >= width)
+        {
+            scatterRightRange(Sp, xr0, d, d + 16, width, rcost, rdisp);
+            continue;
+        }
+        // 反转16个元素，使第j个通道对应xr = lo + j（即视差d + 15 - j）
+        __m256i s = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(Sp + d)), 0x4E);
+        s = _mm256_shuffle_epi8(s, vRevBytes);
+        __m256i c = _mm256_loadu_si256((const __m256i*)(rcost + lo));
+        __m256i m = _mm256_cmpgt_epi16(c, s);
+        _mm256_storeu_si256((__m256i*)(rcost + lo), _mm256_min_epi16(c, s));
+        __m256i idx = _mm256_add_epi16(_mm256_set1_epi16((short)d), vRev);
+        __m256i i = _mm256_loadu_si256((const __m256i*)(rdisp + lo));
+        _mm256_storeu_si256((__m256i*)(rdisp + lo), _mm256_blendv_epi8(i, idx, m));
+    }
+}
+#endif
+
+typedef void (*ScatterRightFn)(const SumType*, int, int, int, short*, short*);
+
+//////////////////////////////////////////////////////////////////////////////
+// Census变换：窗口内比中心暗的邻居记为1。输入为带复制边界的8位图像，
+// 输出每行按16像素对齐，便于SIMD一次处理16个像素。
+
+struct CensusWindow
+{
+    int rx, ry;
+    vector<int> dx, dy; // 除中心外的邻居偏移，按行优先顺序对应描述子的位
+};
+
+static CensusWindow makeCensusWindow(int block_size)
+{
+    CensusWindow w;
+    w.rx = block_size / 2;
+    w.ry = std::min(block_size, 7) / 2;
+    for(int y = -w.ry; y <= w.ry; y++)
+        for(int x = -w.rx; x <= w.rx; x++)
+            if(x != 0 || y != 0)
+            {
+                w.dx.push_back(x);
+                w.dy.push_back(y);
+            }
+    return w;
+}
+
+static void censusRowScalar(const Mat& pad, const CensusWindow& w, int y, int width, uint64_t* out)
+{
+    const int nbits = (int)w.dx.size();
+    const uchar* center = pad.ptr<uchar>(y + w.ry) + w.rx;
+    for(int x = 0; x < width; x++)
+    {
+        uint64_t bits = 0;
+        for(int k = 0; k < nbits; k++)
+        {
+            uchar n = pad.ptr<uchar>(y + w.ry + w.dy[k])[x + w.rx + w.dx[k]];
+            bits |= (uint64_t)(n < center[x]) << k;
+        }
+        out[x] = bits;
+    }
+}
+
+#if CENSUS_X86
+// 每次处理16个像素：每8个邻居比较结果拼成一个字节平面，最后做8x16字节转置得到16个64位描述子
+static void censusRowSSE2(const Mat& pad, const CensusWindow& w, int y, int width, uint64_t* out)
+{
+    const int nbits = (int)w.dx.size();
+    const __m128i sign = _mm_set1_epi8((char)0x80);
+    const uchar* center_row = pad.ptr<uchar>(y + w.ry) + w.rx;
+    for(int x = 0; x < width; x += 16)
+    {
+        __m128i c = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(center_row + x)), sign);
+        __m128i planes[8];
+        for(int g = 0; g < 8; g++)
+        {
+            __m128i acc = _mm_setzero_si128();
+            for(int b = 0; b < 8; b++)
+            {
+                int k = g * 8 + b;
+                if(k >= nbits)
+                    break;
+                const uchar* p = pad.ptr<uchar>(y + w.ry + w.dy[k]) + x + w.rx + w.dx[k];
+                __m128i n = _mm_xor_si128(_mm_loadu_si128((const __m128i*)p), sign);
+                acc = _mm_or_si128(acc, _mm_and_si128(_mm_cmpgt_epi8(c, n), _mm_set1_epi8((char)(1 << b))));
+            }
+            planes[g] = acc;
+        }
+        __m128i t01l = _mm_unpacklo_epi8(planes[0], planes[1]), t01h = _mm_unpackhi_epi8(planes[0], planes[1]);
+        __m128i t23l = _mm_unpacklo_epi8(planes[2], planes[3]), t23h = _mm_unpackhi_epi8(planes[2], planes[3]);
+        __m128i t45l = _mm_unpacklo_epi8(planes[4], planes[5]), t45h = _mm_unpackhi_epi8(planes[4], planes[5]);
+        __m128i t67l = _mm_unpacklo_epi8(planes[6], planes[7]), t67h = _mm_unpackhi_epi8(planes[6], planes[7]);
+        __m128i q[4] = { _mm_unpacklo_epi16(t01l, t23l), _mm_unpackhi_epi16(t01l, t23l),
+                         _mm_unpacklo_epi16(t01h, t23h), _mm_unpackhi_epi16(t01h, t23h) };
+        __m128i r[4] = { _mm_unpacklo_epi16(t45l, t67l), _mm_unpackhi_epi16(t45l, t67l),
+                         _mm_unpacklo_epi16(t45h, t67h), _mm_unpackhi_epi16(t45h, t67h) };
+        for(int i = 0; i < 4; i++)
+        {
+            _mm_storeu_si128((__m128i*)(out + x + i * 4),     _mm_unpacklo_epi32(q[i], r[i]));
+            _mm_storeu_si128((__m128i*)(out + x + i * 4 + 2), _mm_unpackhi_epi32(q[i], r[i]));
+        }
+    }
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+// 匹配代价：C(x,d) = popcount(censusL(x) ^ censusR(x-minD-d))，按像素连续存放D个8位代价
+
+static void costRow(const uint64_t* cl, const uint64_t* cr, int width, int min_disp, int D, int max_cost, uchar* C)
+{
+    for(int x = 0; x < width; x++, C += D)
+    {
+        const uint64_t l = cl[x];
+        const int xr0 = x - min_disp;
+        for(int d = 0; d < D; d++)
+        {
+            int xr = xr0 - d;
+            C[d] = (uchar)((unsigned)xr < (unsigned)width ? popcount64(l ^ cr[xr]) : max_cost);
+        }
+    }
+}
+
+#if CENSUS_X86
+CENSUS_TARGET_AVX2
+static void costRowPopcnt(const uint64_t* cl, const uint64_t* cr, int width, int min_disp, int D, int max_cost, uchar* C)
+{
+    for(int x = 0; x < width; x++, C += D)
+    {
+        const uint64_t l = cl[x];
+        const int xr0 = x - min_disp;
+        // [d_lo, d_hi)内对应的右图像素都在图像内，不需要逐个做边界判断
+        const int d_lo = std::max(0, std::min(D, xr0 - (width - 1)));
+        const int d_hi = std::max(d_lo, std::min(D, xr0 + 1));
+        int d = 0;
+        for(; d < d_lo; d++)
+            C[d] = (uchar)max_cost;
+        for(; d < d_hi; d++)
+            C[d] = (uchar)_mm_popcnt_u64(l ^ cr[xr0 - d]);
+        for(; d < D; d++)
+            C[d] = (uchar)max_cost;
+    }
+}
+#endif
+
+// 一个列块从上到下的路径代价（各方向两行）和每个像素的min(Lr)，在行带之间延续
+struct PathState
+{
+    vector<CostType> L, minL;
+    int cur;
+};
+
+class StereoCensusSGMImpl : public StereoCensusSGM
+{
+public:
+    StereoCensusSGMImpl(int _minDisparity, int _numDisparities, int _blockSize,
+                        int _P1, int _P2, int _uniquenessRatio, int _paths)
+        : minDisparity(_minDisparity), numDisparities(_numDisparities), blockSize(_blockSize),
+          speckleWindowSize(0), speckleRange(0), disp12MaxDiff(1),
+          P1(_P1), P2(_P2), uniquenessRatio(_uniquenessRatio), paths(_paths),
+          kernel_name("scalar")
+    {
+    }
+
+    void compute(InputArray left, InputArray right, OutputArray disparity) override
+    {
+        computeImpl(left, right, disparity, 0);
+    }
+
+    void computeBoth(InputArray left, InputArray right, OutputArray disparity_left, OutputArray disparity_right) override
+    {
+        computeImpl(left, right, disparity_left, &disparity_right);
+    }
+
+    int getMinDisparity() const override { return minDisparity; }
+    void setMinDisparity(int v) override { minDisparity = v; }
+    int getNumDisparities() const override { return numDisparities; }
+    void setNumDisparities(int v) override { numDisparities = v; }
+    int getBlockSize() const override { return blockSize; }
+    void setBlockSize(int v) override { blockSize = v; }
+    int getSpeckleWindowSize() const override { return speckleWindowSize; }
+    void setSpeckleWindowSize(int v) override { speckleWindowSize = v; }
+    int getSpeckleRange() const override { return speckleRange; }
+    void setSpeckleRange(int v) override { speckleRange = v; }
+    int getDisp12MaxDiff() const override { return disp12MaxDiff; }
+    void setDisp12MaxDiff(int v) override { disp12MaxDiff = v; }
+    int getP1() const override { return P1; }
+    void setP1(int v) override { P1 = v; }
+    int getP2() const override { return P2; }
+    void setP2(int v) override { P2 = v; }
+    int getUniquenessRatio() const override { return uniquenessRatio; }
+    void setUniquenessRatio(int v) override { uniquenessRatio = v; }
+    int getPaths() const override { return paths; }
+    void setPaths(int v) override { paths = v; }
+    const char* getKernelName() const override { return kernel_name; }
+
+private:
+    void computeImpl(InputArray leftarr, InputArray rightarr, OutputArray disparr, const _OutputArray* disparr_right);
+    void census(const Mat& img, Mat& pad, vector<uint64_t>& out, const CensusWindow& w);
+    void computeCostRows(int y0, int y1, int width);
+    uchar* costPtr(int y, int width) { return &cost_ring[(size_t)(y % COST_RING_ROWS) * width * numDisparities]; }
+    void aggregateHorizontal(int width, int y0, int y1);
+    void aggregateVertical(int width, int height, int y0, int y1);
+    void selectDisparities(int width, int y0, int y1, Mat& disp, Mat* disp_right);
+
+    int minDisparity, numDisparities, blockSize;
+    int speckleWindowSize, speckleRange, disp12MaxDiff;
+    int P1, P2, uniquenessRatio, paths;
+    const char* kernel_name;
+
+    // 以下缓冲区在多次compute之间复用
+    Kernel kernel;
+    UpdatePathFn update_path;
+    AddSumFn add_sum_fn;
+    SelectFn select_fn;
+    ScatterRightFn scatter_right_fn;
+    Mat gray_l, gray_r, pad_l, pad_r;
+    vector<uint64_t> census_l, census_r;
+    int census_stride, max_cost;
+    vector<uchar> cost_ring; // COST_RING_ROWS x W x D，8位代价，第y行在y % COST_RING_ROWS处
+    vector<SumType> sum;     // BAND_ROWS x W x D，当前行带的聚合代价
+    vector<PathState> down_state; // 每个列块从上到下的路径状态，在行带之间延续
+    Mat disp_right_int;      // 右视图整数视差（用于左右一致性检查）
+    Mat speckle_buf;
+};
+
+void StereoCensusSGMImpl::census(const Mat& img, Mat& pad, vector<uint64_t>& out, const CensusWindow& w)
+{
+    const int width = img.cols;
+    census_stride = (width + 15) & ~15;
+    copyMakeBorder(img, pad, w.ry, w.ry, w.rx, w.rx + 16, BORDER_REPLICATE);
+    out.resize((size_t)census_stride * img.rows);
+    const Kernel k = kernel;
+    const int stride = census_stride;
+    parallel_for_(Range(0, img.rows), [&](const Range& r)
+    {
+        for(int y = r.start; y < r.end; y++)
+        {
+#if CENSUS_X86
+            if(k != KERNEL_SCALAR)
+            {
+                censusRowSSE2(pad, w, y, width, &out[(size_t)y * stride]);
+                continue;
+            }
+#endif
+            censusRowScalar(pad, w, y, width, &out[(size_t)y * stride]);
+        }
+    });
+}
+
+// 算出[y0, y1)行的匹配代价，放入环形缓冲区
+void StereoCensusSGMImpl::computeCostRows(int y0, int y1, int width)
+{
+    const int D = numDisparities;
+    const int stride = census_stride;
+    parallel_for_(Range(y0, y1), [&](const Range& r)
+    {
+        for(int y = r.start; y < r.end; y++)
+        {
+            const uint64_t* cl = &census_l[(size_t)y * stride];
+            const uint64_t* cr = &census_r[(size_t)y * stride];
+            uchar* C = costPtr(y, width);
+#if CENSUS_X86
+            if(kernel == KERNEL_AVX2)
+            {
+                costRowPopcnt(cl, cr, width, minDisparity, D, max_cost, C);
+                continue;
+            }
+#endif
+            costRow(cl, cr, width, minDisparity, D, max_cost, C);
+        }
+    });
+}
+
+// 水平方向（左→右，右→左）：各行互相独立，按行并行。这一步初始化行带[y0, y1)的S。
+void StereoCensusSGMImpl::aggregateHorizontal(int width, int y0, int y1)
+{
+    const int D = numDisparities;
+    const int Ls = D + 2 * L_PAD;
+    const UpdatePathFn update = update_path;
+    parallel_for_(Range(y0, y1), [&](const Range& r)
+    {
+        vector<CostType> buf(3 * Ls, COST_INF);
+        CostType* zero = &buf[L_PAD];
+        CostType* bufs[2] = { &buf[Ls + L_PAD], &buf[2 * Ls + L_PAD] };
+        std::fill(zero, zero + D, (CostType)0);
+
+        for(int y = r.start; y < r.end; y++)
+        {
+            const uchar* C = costPtr(y, width);
+            SumType* S = &sum[(size_t)(y - y0) * width * D];
+
+            const CostType* Lp = zero;
+            int minLp = 0, cur = 0;
+            for(int x = 0; x < width; x++)
+            {
+                CostType* Lc = bufs[cur];
+                minLp = update(C + (size_t)x * D, Lp, minLp, Lc, S + (size_t)x * D, D, P1, P2, true);
+                Lp = Lc;
+                cur ^= 1;
+            }
+
+            Lp = zero;
+            minLp = 0;
+            for(int x = width - 1; x >= 0; x--)
+            {
+                CostType* Lc = bufs[cur];
+                minLp = update(C + (size_t)x * D, Lp, minLp, Lc, S + (size_t)x * D, D, P1, P2, false);
+                Lp = Lc;
+                cur ^= 1;
+            }
+        }
+    });
+}
+
+// 竖直方向（以及8方向时的四个对角方向）：按列分块并行。
+// 竖直路径在列之间互不依赖；对角路径跨越块边界，每块左右多处理DIAG_OVERLAP列来预热，只把中间列累加到S。
+// 从上到下的路径状态保存在down_state中，下一个行带接着算，与整图一次聚合的结果相同；
+// 从下到上的路径从行带下方BAND_OVERLAP行处（图像底部时从底部）开始预热。只把[y0, y1)累加到S。
+void StereoCensusSGMImpl::aggregateVertical(int width, int height, int y0, int y1)
+{
+    const int D = numDisparities;
+    const int Ls = D + 2 * L_PAD;
+    const int ndirs = paths == 8 ? 3 : 1;
+    const int overlap = paths == 8 ? DIAG_OVERLAP : 0;
+    // 块的划分只取决于图像宽度，同一对图像在任意线程数下结果相同；对角方向的预热列是额外开销，块宽为8倍重叠宽度
+    const int stripe_w = VERTICAL_STRIPE_W;
+    const int nstripes = (width + stripe_w - 1) / stripe_w;
+    const UpdatePathFn update = update_path;
+    const AddSumFn add_sum = add_sum_fn;
+    if(y0 == 0)
+        down_state.resize(nstripes);
+
+    parallel_for_(Range(0, nstripes), [&](const Range& r)
+    {
+        for(int s = r.start; s < r.end; s++)
+        {
+            const int x0 = s * stripe_w, x1 = std::min(width, x0 + stripe_w);
+            if(x0 >= x1)
+                continue;
+            const int ex0 = std::max(0, x0 - overlap), ex1 = std::min(width, x1 + overlap);
+            const int ew = ex1 - ex0;
+
+            // 每个方向两行（上一行/当前行）路径代价，外加一个"路径起点"用的全零向量
+            const size_t buf_size = (size_t)(2 * ndirs * ew + 1) * Ls;
+            PathState& down = down_state[s];
+            if(y0 == 0)
+            {
+                down.L.assign(buf_size, COST_INF);
+                down.minL.assign((size_t)2 * ndirs * ew, 0);
+                down.cur = 0;
+                std::fill(&down.L[buf_size - Ls + L_PAD], &down.L[buf_size - Ls + L_PAD] + D, (CostType)0);
+            }
+            vector<CostType> up_L(buf_size, COST_INF), up_minL((size_t)2 * ndirs * ew, 0);
+            std::fill(&up_L[buf_size - Ls + L_PAD], &up_L[buf_size - Ls + L_PAD] + D, (CostType)0);
+            vector<SumType> acc(D);
+
+            for(int pass = 0; pass < 2; pass++)
+            {
+                CostType* L = pass == 0 ? &down.L[0] : &up_L[0];
+                CostType* minL = pass == 0 ? &down.minL[0] : &up_minL[0];
+                const CostType* zero = L + buf_size - Ls + L_PAD;
+                const int y_first = pass == 0 ? 0 : std::min(height, y1 + BAND_OVERLAP) - 1;
+                const int y_begin = pass == 0 ? y0 : y_first;
+                const int y_end = pass == 0 ? y1 : y0 - 1;
+                const int y_step = pass == 0 ? 1 : -1;
+                int cur = pass == 0 ? down.cur : 0;
+                for(int y = y_begin; y != y_end; y += y_step)
+                {
+                    const uchar* C = costPtr(y, width);
+                    const bool in_band = y >= y0 && y < y1;
+                    SumType* S = in_band ? &sum[(size_t)(y - y0) * width * D] : 0;
+                    for(int x = ex0; x < ex1; x++)
+                    {
+                        // 同一像素的各方向先累加到acc（留在L1中），最后只读写一次S
+                        for(int k = 0; k < ndirs; k++)
+                        {
+                            // k=0竖直，k=1/2分别从左上/右上（反向时为右下/左下）方向延续
+                            const int dx = k == 0 ? 0 : (k == 1 ? -y_step : y_step);
+                            const CostType* prev = L + (size_t)((2 * k + (cur ^ 1)) * ew) * Ls + L_PAD;
+                            CostType* curr = L + (size_t)((2 * k + cur) * ew) * Ls + L_PAD;
+                            const CostType* prev_min = minL + (size_t)(2 * k + (cur ^ 1)) * ew;
+                            CostType* curr_min = minL + (size_t)(2 * k + cur) * ew;
+                            const int px = x + dx - ex0;
+                            const bool start = (y == y_first) || px < 0 || px >= ew;
+                            const CostType* Lp = start ? zero : prev + (size_t)px * Ls;
+                            const int minLp = start ? 0 : prev_min[px];
+                            curr_min[x - ex0] = update(C + (size_t)x * D, Lp, minLp, curr + (size_t)(x - ex0) * Ls,
+                                                       &acc[0], D, P1, P2, k == 0);
+                        }
+                        if(in_band && x >= x0 && x < x1)
+                            add_sum(S + (size_t)x * D, &acc[0], D);
+                    }
+                    cur ^= 1;
+                }
+                if(pass == 0)
+                    down.cur = cur;
+            }
+        }
+    });
+}
+
+void StereoCensusSGMImpl::selectDisparities(int width, int y0, int y1, Mat& disp, Mat* disp_right)
+{
+    const int D = numDisparities;
+    const int minD = minDisparity;
+    const short invalid = (short)((minD - 1) * StereoMatcher::DISP_SCALE);
+    const short invalid_right = (short)(-(minD + D) * StereoMatcher::DISP_SCALE);
+    const bool need_right = disp_right != 0 || disp12MaxDiff >= 0;
+    const SelectFn select = select_fn;
+    const ScatterRightFn scatter = scatter_right_fn;
+    parallel_for_(Range(y0, y1), [&](const Range& r)
+    {
+        vector<short> rcost, rdisp;
+        if(need_right)
+        {
+            rcost.resize(width);
+            rdisp.resize(width);
+        }
+        for(int y = r.start; y < r.end; y++)
+        {
+            const SumType* S = &sum[(size_t)(y - y0) * width * D];
+            short* dptr = disp.ptr<short>(y);
+            if(need_right)
+            {
+                std::fill(rcost.begin(), rcost.end(), (short)0x7FFF);
+                std::fill(rdisp.begin(), rdisp.end(), (short)-1);
+            }
+            for(int x = 0; x < width; x++)
+            {
+                const SumType* Sp = S + (size_t)x * D;
+                if(need_right)
+                    scatter(Sp, x - minD, D, width, &rcost[0], &rdisp[0]);
+
+                int best_cost, second;
+                const int best = select(Sp, D, best_cost, second);
+                if(uniquenessRatio > 0 && second * (100 - uniquenessRatio) < best_cost * 100)
+                {
+                    dptr[x] = invalid;
+                    continue;
+                }
+                // 抛物线拟合得到亚像素视差，与StereoSGBM的定点公式一致
+                int d16 = best * StereoMatcher::DISP_SCALE;
+                if(best > 0 && best < D - 1)
+                {
+                    int denom2 = std::max(Sp[best-1] + Sp[best+1] - 2 * Sp[best], 1);
+                    d16 += ((Sp[best-1] - Sp[best+1]) * StereoMatcher::DISP_SCALE + denom2) / (denom2 * 2);
+                }
+                dptr[x] = (short)(minD * StereoMatcher::DISP_SCALE + d16);
+            }
+
+            if(!need_right)
+                continue;
+
+            short* rptr = disp_right_int.ptr<short>(y);
+            for(int xr = 0; xr < width; xr++)
+                rptr[xr] = (short)(rdisp[xr] < 0 ? SHRT_MIN : minD + rdisp[xr]);
+
+            // 左右一致性检查，规则与StereoSGBM相同
+            if(disp12MaxDiff >= 0)
+            {
+                for(int x = 0; x < width; x++)
+                {
+                    int d = dptr[x];
+                    if(d == invalid)
+                        continue;
+                    int d0 = d >> StereoMatcher::DISP_SHIFT;
+                    int d1 = (d + StereoMatcher::DISP_SCALE - 1) >> StereoMatcher::DISP_SHIFT;
+                    int x0 = x - d0, x1 = x - d1;
+                    if(0 <= x0 && x0 < width && rptr[x0] != SHRT_MIN && std::abs(rptr[x0] - d0) > disp12MaxDiff &&
+                       0 <= x1 && x1 < width && rptr[x1] != SHRT_MIN && std::abs(rptr[x1] - d1) > disp12MaxDiff)
+                        dptr[x] = invalid;
+                }
+            }
+
+            if(disp_right)
+            {
+                short* out = disp_right->ptr<short>(y);
+                for(int xr = 0; xr < width; xr++)
+                    out[xr] = rptr[xr] == SHRT_MIN ? invalid_right : (short)(-rptr[xr] * StereoMatcher::DISP_SCALE);
+            }
+        }
+    });
+}
+
+void StereoCensusSGMImpl::computeImpl(InputArray leftarr, InputArray rightarr, OutputArray disparr,
+                                      const _OutputArray* disparr_right)
+{
+    Mat left = leftarr.getMat(), right = rightarr.getMat();
+    CV_Assert(left.size() == right.size() && left.type() == right.type() && left.depth() == CV_8U);
+    CV_Assert(numDisparities > 0 && numDisparities % 16 == 0);
+    CV_Assert(blockSize >= 3 && blockSize <= 9 && blockSize % 2 == 1);
+    CV_Assert(paths == 4 || paths == 8);
+    // 保证8个方向之和仍小于0x8000，WTA可以使用有符号16位比较
+    CV_Assert(P1 > 0 && P2 > P1 && 8 * (64 + P2) < 0x8000);
+
+    kernel = KERNEL_SCALAR;
+    update_path = updatePathScalar;
+    add_sum_fn = addSumScalar;
+    select_fn = selectScalar;
+    scatter_right_fn = scatterRightScalar;
+    kernel_name = "scalar";
+#if CENSUS_X86
+    if(useOptimized())
+    {
+        if(checkHardwareSupport(CV_CPU_AVX2))
+        {
+            kernel = KERNEL_AVX2;
+            update_path = updatePathAVX2;
+            add_sum_fn = addSumAVX2;
+            select_fn = selectAVX2;
+            scatter_right_fn = scatterRightAVX2;
+            kernel_name = "avx2";
+        }
+        else if(checkHardwareSupport(CV_CPU_SSE2))
+        {
+            kernel = KERNEL_SSE2;
+            update_path = updatePathSSE2;
+            add_sum_fn = addSumSSE2;
+            select_fn = selectSSE2;
+            scatter_right_fn = scatterRightSSE2;
+            kernel_name = "sse2";
+        }
+    }
+#endif
+
+    if(left.channels() == 1)
+    {
+        gray_l = left;
+        gray_r = right;
+    }
+    else
+    {
+        cvtColor(left, gray_l, left.channels() == 4 ? COLOR_BGRA2GRAY : COLOR_BGR2GRAY);
+        cvtColor(right, gray_r, right.channels() == 4 ? COLOR_BGRA2GRAY : COLOR_BGR2GRAY);
+    }
+
+    const int width = left.cols, height = left.rows;
+    const int D = numDisparities;
+    const CensusWindow w = makeCensusWindow(blockSize);
+    census(gray_l, pad_l, census_l, w);
+    census(gray_r, pad_r, census_r, w);
+
+    max_cost = (int)w.dx.size();
+    cost_ring.resize((size_t)std::min(height, COST_RING_ROWS) * width * D);
+    sum.resize((size_t)std::min(height, BAND_ROWS) * width * D);
+
+    disparr.create(left.size(), CV_16S);
+    Mat disp = disparr.getMat();
+    Mat disp_right;
+    if(disparr_right)
+    {
+        disparr_right->create(left.size(), CV_16S);
+        disp_right = disparr_right->getMat();
+    }
+    if(disparr_right || disp12MaxDiff >= 0)
+        disp_right_int.create(height, width, CV_16S);
+    // 每个行带用到[y0, y1 + BAND_OVERLAP)行的代价，其中前一个行带已经算过的行仍在环形缓冲区中
+    for(int y0 = 0, cost_end = 0; y0 < height; y0 += BAND_ROWS)
+    {
+        const int y1 = std::min(height, y0 + BAND_ROWS);
+        const int need = std::min(height, y1 + BAND_OVERLAP);
+        computeCostRows(cost_end, need, width);
+        cost_end = need;
+        aggregateHorizontal(width, y0, y1);
+        aggregateVertical(width, height, y0, y1);
+        selectDisparities(width, y0, y1, disp, disparr_right ? &disp_right : 0);
+    }
+
+    if(speckleWindowSize > 0)
+        filterSpeckles(disp, (minDisparity - 1) * StereoMatcher::DISP_SCALE, speckleWindowSize,
+                       StereoMatcher::DISP_SCALE * speckleRange, speckle_buf);
+}
+
+} // namespace
+
+Ptr<StereoCensusSGM> StereoCensusSGM::create(int minDisparity, int numDisparities, int blockSize,
+                                             int P1, int P2, int uniquenessRatio, int paths)
+{
+    return makePtr<StereoCensusSGMImpl>(minDisparity, numDisparities, blockSize, P1, P2, uniquenessRatio, paths);
+}
@@ -0,0 +1,40 @@
+#ifndef DISPARITY_CENSUS_SGM_HPP
+#define DISPARITY_CENSUS_SGM_HPP
+
+#include "opencv2/calib3d.hpp"
+
+// 基于Census变换和半全局聚合(SGM)的立体匹配器。
+// 匹配代价为Census描述子之间的汉明距离，沿4或8个方向做路径聚合。
+// 输出与StereoBM/StereoSGBM相同的CV_16S定点视差（真实视差*16），无效像素为(minDisparity-1)*16，
+// 因此可以直接配合computeROI和DisparityWLSFilter使用。
+// 聚合按128行的行带进行，只保存一个行带的代价和聚合代价（约448*W*D字节），内存不随图像高度增长。
+class StereoCensusSGM : public cv::StereoMatcher
+{
+public:
+    virtual int getP1() const = 0;
+    virtual void setP1(int P1) = 0;
+
+    virtual int getP2() const = 0;
+    virtual void setP2(int P2) = 0;
+
+    virtual int getUniquenessRatio() const = 0;
+    virtual void setUniquenessRatio(int uniquenessRatio) = 0;
+
+    // 聚合方向数：4（水平+竖直）或8（再加四个对角方向）
+    virtual int getPaths() const = 0;
+    virtual void setPaths(int paths) = 0;
+
+    // 同时计算左右视差。右视差沿用createRightMatcher的约定（负视差），
+    // 直接从同一个聚合代价体中取出，几乎不增加计算量，可作为带置信度WLS滤波的右视差输入。
+    virtual void computeBoth(cv::InputArray left, cv::InputArray right,
+                             cv::OutputArray disparity_left, cv::OutputArray disparity_right) = 0;
+
+    // 上一次compute使用的内核："avx2"、"sse2"或"scalar"（cv::setUseOptimized(false)时强制使用scalar）
+    virtual const char* getKernelName() const = 0;
+
+    // blockSize为Census窗口宽度（3/5/7/9，窗口高度不超过7，描述子最多62位）
+    static cv::Ptr<StereoCensusSGM> create(int minDisparity = 0, int numDisparities = 64, int blockSize = 9,
+                                          int P1 = 10, int P2 = 120, int uniquenessRatio = 10, int paths = 8);
+};
+
+#endif
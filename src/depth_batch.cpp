@@ -0,0 +1,334 @@
+#include "depth_batch.hpp"
+#include "depth_io.hpp"
+#include "raw_depth.hpp"
+#include "blocking_queue.hpp"
+#include "buffer_pool.hpp"
+#include "trace.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/core/utils/filesystem.hpp"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <map>
+
+using namespace cv;
+using namespace std;
+
+namespace
+{
+
+// 一个文件在流水线中占用的全部缓冲区；槽在文件之间复用
+struct DepthJob
+{
+    int index;
+    vector<uchar> bytes; // 编码数据（读入时为输入文件，写出时为输出文件）
+    Mat decoded;
+    Mat depth32f, filtered32f, out;
+    int orig_depth;
+    bool ok;
+};
+
+String lowerExt(const String& path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if(dot == String::npos || (slash != String::npos && dot < slash))
+        return String();
+    String ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+String baseName(const String& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == String::npos ? path : path.substr(slash + 1);
+}
+
+// 输出文件名：原文件名，ext非空时替换扩展名
+String outputName(const String& path, const String& ext)
+{
+    String name = baseName(path);
+    if(ext.empty())
+        return name;
+    size_t dot = name.find_last_of('.');
+    return (dot == String::npos ? name : name.substr(0, dot)) + (ext[0] == '.' ? ext : "." + ext);
+}
+
+// 比较用的路径：目录部分解析为规范路径，Windows上不区分大小写
+String pathKey(const String& dir, const String& name)
+{
+    String key = utils::fs::join(utils::fs::canonical(dir.empty() ? String(".") : dir), name);
+#ifdef _WIN32
+    std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+#endif
+    return key;
+}
+
+String dirName(const String& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == String::npos ? String() : path.substr(0, slash + 1);
+}
+
+// 启动前检查输出路径：两个输入映射到同一个输出（重名、或out_ext使a.png和a.rdm同名），
+// 或输出会覆盖某个输入（out_dir就是输入所在目录）时拒绝整个批次
+bool checkOutputPaths(const vector<String>& files, const String& out_dir, const String& out_ext)
+{
+    map<String, size_t> inputs, outputs;
+    for(size_t i = 0; i < files.size(); i++)
+        inputs[pathKey(dirName(files[i]), baseName(files[i]))] = i;
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        const String key = pathKey(out_dir, outputName(files[i], out_ext));
+        map<String, size_t>::const_iterator it = inputs.find(key);
+        if(it != inputs.end())
+        {
+            cerr << "Output for " << files[i] << " would overwrite input " << files[it->second]
+                 << "; choose another out_dir or out_ext" << endl;
+            return false;
+        }
+        it = outputs.find(key);
+        if(it != outputs.end())
+        {
+            cerr << "Inputs " << files[it->second] << " and " << files[i] << " map to the same output " << key << endl;
+            return false;
+        }
+        outputs[key] = i;
+    }
+    return true;
+}
+
+// 依次关闭下一阶段的队列：最后一个退出的线程负责close
+struct StageCloser
+{
+    atomic<int> alive;
+    BlockingQueue<DepthJob*>* next;
+    void done() { if(--alive == 0) next->close(); }
+};
+
+} // namespace
+
+bool isDepthBatchInput(const String& input)
+{
+    String ext = lowerExt(input);
+    return utils::fs::isDirectory(input) || ext == ".txt" || ext == ".lst";
+}
+
+bool listDepthInputs(const String& input, vector<String>& files)
+{
+    files.clear();
+    if(utils::fs::isDirectory(input))
+    {
+        static const char* patterns[] = { "*.png", "*.pgm", "*.tif", "*.tiff", "*.exr", "*.pfm", "*.jpg", "*.bmp", "*.rdm" };
+        for(size_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++)
+        {
+            vector<String> found;
+            glob(utils::fs::join(input, patterns[i]), found, false);
+            files.insert(files.end(), found.begin(), found.end());
+        }
+        std::sort(files.begin(), files.end());
+        files.erase(std::unique(files.begin(), files.end()), files.end());
+    }
+    else
+    {
+        ifstream list(input.c_str());
+        if(!list)
+        {
+            cerr << "Cannot read file list: " << input << endl;
+            return false;
+        }
+        string line;
+        while(getline(list, line))
+        {
+            line.erase(line.find_last_not_of(" \t\r\n") + 1);
+            if(!line.empty() && line[0] != '#')
+                files.push_back(line);
+        }
+    }
+    if(files.empty())
+    {
+        cerr << "No depth files found in: " << input << endl;
+        return false;
+    }
+    return true;
+}
+
+bool runDepthBatch(const vector<String>& files, const String& out_dir,
+                   const function<DepthFilterFn()>& make_filter,
+                   const DepthBatchOptions& opts, DepthBatchStats& stats)
+{
+    stats.files = (int)files.size();
+    stats.failed = 0;
+    stats.seconds = 0.0;
+    stats.bytes_read = stats.bytes_written = 0.0;
+    if(!utils::fs::isDirectory(out_dir) && !utils::fs::createDirectories(out_dir))
+    {
+        cerr << "Cannot create output directory: " << out_dir << endl;
+        return false;
+    }
+    if(!checkOutputPaths(files, out_dir, opts.out_ext))
+    {
+        stats.failed = (int)files.size();
+        return false;
+    }
+
+    const int workers = opts.workers > 0 ? opts.workers : std::max(getNumberOfCPUs(), 1);
+    const int io_threads = std::max(opts.io_threads, 1);
+    const int in_flight = opts.in_flight > 0 ? opts.in_flight : 2 * (workers + io_threads);
+
+    // 并行度来自文件级别，关闭OpenCV内部的线程池以免互相争抢
+    const int saved_threads = getNumThreads();
+    if(workers > 1)
+        setNumThreads(1);
+
+    vector<DepthJob> slots(in_flight);
+    BlockingQueue<DepthJob*> free_q, filter_q, encode_q;
+    for(size_t i = 0; i < slots.size(); i++)
+        free_q.push(&slots[i]);
+
+    atomic<int> next_file(0), failed(0);
+    atomic<long long> bytes_read(0), bytes_written(0);
+    StageCloser decoders_left, workers_left;
+    decoders_left.alive = io_threads;
+    decoders_left.next = &filter_q;
+    workers_left.alive = workers;
+    workers_left.next = &encode_q;
+
+    int64 start = getTickCount();
+    vector<thread> threads;
+
+    // 解码：读入整个文件再imdecode，每个文件只解码一次
+    for(int t = 0; t < io_threads; t++)
+        threads.push_back(thread([&]()
+        {
+            for(;;)
+            {
+                int i = next_file++;
+                if(i >= (int)files.size())
+                    break;
+                DepthJob* job;
+                if(!free_q.pop(job))
+                    break;
+                job->index = i;
+                if(isRawDepthPath(files[i]))
+                {
+                    // 原始格式：映射后直接转换到槽内的缓冲区，没有读入和解码
+                    TraceScope decode_scope("decode");
+                    MappedDepth mapped;
+                    job->ok = mapped.open(files[i]);
+                    decode_scope.end();
+                    if(job->ok)
+                    {
+                        TraceScope convert_scope("convert");
+                        bytes_read += (long long)mapped.fileSize();
+                        job->orig_depth = mapped.mat().depth();
+                        job->ok = rawDepthToFloat(mapped.mat(), job->depth32f);
+                    }
+                    filter_q.push(job);
+                    continue;
+                }
+                TraceScope decode_scope("decode");
+                job->ok = readFileBytes(files[i], job->bytes);
+                if(job->ok)
+                {
+                    bytes_read += (long long)job->bytes.size();
+                    job->decoded = imdecode(job->bytes, IMREAD_UNCHANGED);
+                    job->ok = !job->decoded.empty();
+                }
+                decode_scope.end();
+                if(job->ok)
+                {
+                    TraceScope convert_scope("convert");
+                    job->orig_depth = job->decoded.depth();
+                    job->ok = depthToFloat(job->decoded, job->depth32f);
+                }
+                if(!job->ok)
+                    cerr << "Cannot read depth file: " << files[i] << endl;
+                filter_q.push(job);
+            }
+            decoders_left.done();
+        }));
+
+    // 滤波：每个线程持有自己的滤波器实例
+    for(int t = 0; t < workers; t++)
+        threads.push_back(thread([&]()
+        {
+            DepthFilterFn filter = make_filter();
+            DepthJob* job;
+            while(filter_q.pop(job))
+            {
+                if(job->ok && !filter(job->depth32f, job->filtered32f))
+                {
+                    job->ok = false;
+                    cerr << "Failed to filter: " << files[job->index] << endl;
+                }
+                encode_q.push(job);
+            }
+            workers_left.done();
+        }));
+
+    // 编码并写出，之后把槽归还给解码线程
+    for(int t = 0; t < io_threads; t++)
+        threads.push_back(thread([&]()
+        {
+            DepthJob* job;
+            while(encode_q.pop(job))
+            {
+                const String out_path = utils::fs::join(out_dir, outputName(files[job->index], opts.out_ext));
+                if(job->ok)
+                {
+                    const bool raw = isRawDepthPath(out_path);
+                    TraceScope convert_scope("convert");
+                    job->ok = depthFromFloat(job->filtered32f, job->orig_depth, job->out);
+                    convert_scope.end();
+                    TraceScope encode_scope("encode");
+                    job->ok = job->ok &&
+                              (raw ? writeRawDepth(out_path, job->out) :
+                                     imencode(lowerExt(out_path), job->out, job->bytes) &&
+                                     writeFileBytes(out_path, job->bytes));
+                    encode_scope.end();
+                    if(job->ok)
+                        bytes_written += raw ? (long long)(sizeof(RawDepthHeader) + job->out.total() * job->out.elemSize()) :
+                                               (long long)job->bytes.size();
+                    else
+                        cerr << "Failed to save: " << out_path << endl;
+                }
+                if(!job->ok)
+                    failed++;
+                free_q.push(job);
+            }
+        }));
+
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    if(workers > 1)
+        setNumThreads(saved_threads);
+
+    stats.failed = failed;
+    stats.seconds = (getTickCount() - start) / getTickFrequency();
+    stats.bytes_read = (double)bytes_read;
+    stats.bytes_written = (double)bytes_written;
+    return stats.failed == 0;
+}
+
+void printDepthBatchStats(const DepthBatchStats& stats)
+{
+    const double secs = std::max(stats.seconds, 1e-9);
+    cout.precision(4);
+    cout << "Files:      " << stats.files << " (" << stats.failed << " failed)" << endl;
+    cout << "Time:       " << stats.seconds << "s" << endl;
+    cout << "Throughput: " << stats.files / secs << " files/s, "
+         << stats.bytes_read / secs / (1024.0 * 1024.0) << " MB/s read, "
+         << stats.bytes_written / secs / (1024.0 * 1024.0) << " MB/s written" << endl;
+    if(bufferPoolInstalled())
+    {
+        const BufferPoolStats pool = bufferPoolStats();
+        cout << "Buffers:    " << pool.hits << " reused, " << pool.misses << " heap allocations, "
+             << pool.pooled_mb << " MB idle" << endl;
+    }
+}
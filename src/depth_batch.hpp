@@ -0,0 +1,45 @@
+#ifndef DISPARITY_DEPTH_BATCH_HPP
+#define DISPARITY_DEPTH_BATCH_HPP
+
+#include "opencv2/core.hpp"
+#include <functional>
+#include <vector>
+
+// 单个深度图的滤波函数：输入输出均为单通道CV_32F。
+// 每个工作线程通过工厂函数创建自己的实例，因此实现内部可以持有不可共享的滤波器对象。
+typedef std::function<bool(const cv::Mat& depth32f, cv::Mat& filtered32f)> DepthFilterFn;
+
+struct DepthBatchOptions
+{
+    int workers;    // 滤波线程数（0表示CPU核数）
+    int io_threads; // 解码线程数和编码线程数（各自）
+    int in_flight;  // 同时驻留内存的文件数上限（0表示自动）
+    cv::String out_ext; // 非空时替换输出文件的扩展名（例如".rdm"），否则与输入相同
+};
+
+struct DepthBatchStats
+{
+    int files;
+    int failed;
+    double seconds;
+    double bytes_read;
+    double bytes_written;
+};
+
+// 输入是目录，或扩展名为.txt/.lst的文件列表（每行一个路径）时使用批处理模式
+bool isDepthBatchInput(const cv::String& input);
+
+// 展开目录（按文件名排序的常见图像格式）或文件列表
+bool listDepthInputs(const cv::String& input, std::vector<cv::String>& files);
+
+// 批处理流水线：解码线程 -> 滤波线程池 -> 编码线程。
+// 每个文件只解码一次（.rdm直接映射），结果以原文件名和原始位深写入out_dir。
+// 启动前检查输出路径：多个输入得到同一个输出名，或输出会覆盖输入时不处理任何文件并返回false。
+// 固定数量的缓冲槽在各阶段间循环，内存占用不随文件数增长。
+bool runDepthBatch(const std::vector<cv::String>& files, const cv::String& out_dir,
+                   const std::function<DepthFilterFn()>& make_filter,
+                   const DepthBatchOptions& opts, DepthBatchStats& stats);
+
+void printDepthBatchStats(const DepthBatchStats& stats);
+
+#endif
@@ -0,0 +1,104 @@
+#include "depth_filters.hpp"
+#include "trace.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/ximgproc/edge_filter.hpp"
+#include <cmath>
+#include <iostream>
+
+using namespace cv;
+using namespace cv::ximgproc;
+using namespace std;
+
+void DepthWLS::init()
+{
+    wls = createDisparityWLSFilterGeneric(false);
+    wls->setLambda(lambda);
+    wls->setSigmaColor(sigma);
+    wls->setDepthDiscontinuityRadius((int)ceil(0.33 * wsize));
+
+    tiled.lambda = lambda;
+    tiled.sigma  = sigma;
+    tiled.radius = (int)ceil(0.33 * wsize);
+
+    if (lowres.factor > 1) {
+        lowres.tiled = tiled;
+        lowres.init(lambda, sigma, tiled.radius);
+    }
+}
+
+bool DepthWLS::apply(const Mat& depth, Mat& filtered32f)
+{
+    if (wls.empty()) init();
+
+    // 中值预滤波（减少斑点）、类型转换、值域统计和定点输入在一遍内完成，
+    // 再由值域生成以深度自身归一化的8位引导图
+    TraceScope prep_scope("depth_prep");
+    if (!prep.run(depth, fixed_point)) {
+        cerr << "Unsupported depth type: depth=" << depth.depth() << endl;
+        return false;
+    }
+    prep_scope.end();
+    const Mat& median = prep.median;
+    const Mat& guide8u = prep.guide8u;
+
+    TraceScope filter_scope("filter");
+    if (!fixed_point) {
+        // 直接在浮点深度上求解，结果就是输出，不需要定点映射和换算回来的两次整图转换
+        if (lowres.factor > 1)
+            lowres.filter(median, guide8u, filtered32f);
+        else if (tiled.tile > 0)
+            filterWLSTiled(median, guide8u, filtered32f, tiled);
+        else
+            fastGlobalSmootherFilter(guide8u, median, filtered32f, lambda, sigma);
+        return true;
+    }
+
+    // WLS期望的CV_16S域（固定比例16，与视差定点一致），prep中已生成
+    const double s = 16.0;
+    const Mat& depth16s = prep.depth16s;
+
+    // 应用WLS
+    if (lowres.factor > 1) {
+        lowres.filter(depth16s, guide8u, filtered16s);
+    } else if (tiled.tile > 0) {
+        filterWLSTiled(depth16s, guide8u, filtered16s, tiled);
+    } else {
+        Rect ROI(0, 0, depth16s.cols, depth16s.rows);
+        wls->filter(depth16s, guide8u, filtered16s, Mat(), ROI);
+    }
+
+    filter_scope.end();
+
+    // 转换回原始数值比例
+    TraceScope convert_scope("convert");
+    filtered16s.convertTo(filtered32f, CV_32F, 1.0/s);
+    return true;
+}
+
+double autoSigmaColor(const Mat& depth32f, double sigmaColor)
+{
+    if (sigmaColor >= 0.0) return sigmaColor;
+    double minV = 0.0, maxV = 0.0;
+    minMaxLoc(depth32f, &minV, &maxV);
+    double range = maxV - minV;
+    return (range > 0.0) ? 0.10 * range : 1.0;
+}
+
+void DepthBilateral::apply(const Mat& depth32f, Mat& dst)
+{
+    TraceScope scope("filter");
+    const double sc = autoSigmaColor(depth32f, sigmaColor);
+    const int n = std::max(iterations, 1);
+    if (use_grid) {
+        // 网格的空间核不截断，diameter不起作用
+        grid.filter(depth32f, dst, sigmaSpace, sc, n);
+        return;
+    }
+    // bilateralFilter不支持原地操作，中间结果写到ping/pong，最后一次写到dst
+    const Mat* current = &depth32f;
+    for (int i = 0; i < n; ++i) {
+        Mat& out = (i == n - 1) ? dst : (i % 2 == 0 ? ping : pong);
+        bilateralFilter(*current, out, diameter, sc, sigmaSpace);
+        current = &out;
+    }
+}
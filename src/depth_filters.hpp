@@ -0,0 +1,61 @@
+#ifndef DISPARITY_DEPTH_FILTERS_HPP
+#define DISPARITY_DEPTH_FILTERS_HPP
+
+#include "opencv2/core.hpp"
+#include "opencv2/ximgproc/disparity_filter.hpp"
+#include "bilateral_grid.hpp"
+#include "tiled_wls.hpp"
+#include "lowres_wls.hpp"
+#include "depth_prep.hpp"
+
+// 单通道深度图的WLS滤波（only_wls）：中值预滤波，以深度自身归一化后的8位图为引导（两者由DepthPrep融合生成），
+// 直接在CV_32F上用快速全局平滑求解（即不带置信度的WLS滤波器内部的求解），没有定点换算，任意深度值都不会饱和。
+// fixed_point时沿用旧做法：映射到x16定点后用通用WLS滤波器滤波，深度超过2047会饱和。
+// tiled.tile>0时分块并行滤波，否则整图一次滤波。
+// lowres.factor>1时在缩小的图上求解，再由原尺寸引导图上采样（见LowResWLS），可与分块同时使用。
+// 滤波器实例保存在对象内，在多次调用之间复用；一个实例不能同时被多个线程使用。
+struct DepthWLS
+{
+    double lambda;
+    double sigma;
+    int wsize;           // 影响不连续半径
+    bool fixed_point;    // 经CV_16S定点滤波（旧行为）
+    TiledWLSParams tiled;
+    LowResWLS lowres;
+
+    DepthWLS() : lambda(20000.0), sigma(0.5), wsize(15), fixed_point(false) {}
+
+    // 按lambda/sigma/wsize创建滤波器，并同步tiled、lowres中的对应参数
+    void init();
+
+    // depth为任意位深的单通道深度图（不必先转换为CV_32F），输出CV_32F
+    bool apply(const cv::Mat& depth, cv::Mat& filtered32f);
+
+    cv::Ptr<cv::ximgproc::DisparityWLSFilter> wls;
+    DepthPrep prep;
+    cv::Mat filtered16s;
+};
+
+// sigmaColor小于0时取数据范围的10%
+double autoSigmaColor(const cv::Mat& depth32f, double sigmaColor);
+
+// 单通道CV_32F深度图的双边滤波（bilateral_filter），可迭代。中间结果在ping/pong之间交替，
+// 多次调用之间复用缓冲区；每个线程各持有一个实例
+struct DepthBilateral
+{
+    bool use_grid;       // true：双边网格近似，耗时与diameter无关
+    int diameter;
+    double sigmaColor;   // <0表示数据范围的10%
+    double sigmaSpace;
+    int iterations;
+
+    DepthBilateral() : use_grid(false), diameter(9), sigmaColor(-1.0), sigmaSpace(15.0), iterations(1) {}
+
+    // dst不能与depth32f共用内存
+    void apply(const cv::Mat& depth32f, cv::Mat& dst);
+
+    BilateralGrid grid;
+    cv::Mat ping, pong;
+};
+
+#endif
@@ -0,0 +1,143 @@
+#include "depth_io.hpp"
+#include "raw_depth.hpp"
+#include "trace.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include <iostream>
+#include <fstream>
+
+using namespace cv;
+using namespace std;
+
+bool depthToFloat(const Mat& src, Mat& depth32f)
+{
+    Mat single;
+    if (src.channels() == 1) {
+        single = src;
+    } else if (src.channels() == 3) {
+        cvtColor(src, single, COLOR_BGR2GRAY);
+    } else if (src.channels() == 4) {
+        cvtColor(src, single, COLOR_BGRA2GRAY);
+    } else {
+        Mat ch0; extractChannel(src, ch0, 0); single = ch0;
+    }
+
+    switch (single.depth()) {
+        case CV_8U:  single.convertTo(depth32f, CV_32F, 1.0); break;
+        case CV_16U: single.convertTo(depth32f, CV_32F, 1.0); break;
+        case CV_16S: single.convertTo(depth32f, CV_32F, 1.0); break;
+        case CV_32S: single.convertTo(depth32f, CV_32F, 1.0); break;
+        case CV_32F: depth32f = single;                       break;
+        case CV_64F: single.convertTo(depth32f, CV_32F, 1.0); break;
+        default:
+            cerr << "Unsupported depth type: depth=" << single.depth() << endl;
+            return false;
+    }
+    return true;
+}
+
+bool rawDepthToFloat(const Mat& mapped, Mat& depth32f)
+{
+    // depthToFloat对CV_32F单通道只共享数据，映射关闭后就失效了，这里拷进depth32f自己的缓冲区（可复用）
+    if (mapped.type() == CV_32FC1) {
+        mapped.copyTo(depth32f);
+        return true;
+    }
+    return depthToFloat(mapped, depth32f);
+}
+
+bool depthFromFloat(const Mat& depth32f, int likeDepth, Mat& out)
+{
+    switch (likeDepth) {
+        case CV_8U:  depth32f.convertTo(out, CV_8U);  break;
+        case CV_16U: depth32f.convertTo(out, CV_16U); break;
+        case CV_16S: depth32f.convertTo(out, CV_16S); break;
+        case CV_32S: depth32f.convertTo(out, CV_32S); break;
+        case CV_32F: out = depth32f;                  break;
+        case CV_64F: depth32f.convertTo(out, CV_64F); break;
+        default:
+            cerr << "Unsupported output type" << endl;
+            return false;
+    }
+    return true;
+}
+
+bool loadDepthAsFloat(const String& path, Mat& depth32f, int& origDepthType)
+{
+    if (isRawDepthPath(path)) {
+        // 原始格式：映射后直接转换，没有解码
+        TraceScope decode_scope("decode");
+        MappedDepth mapped;
+        if (!mapped.open(path)) return false;
+        decode_scope.end();
+        origDepthType = mapped.mat().depth();
+        TraceScope convert_scope("convert");
+        return rawDepthToFloat(mapped.mat(), depth32f);
+    }
+
+    TraceScope decode_scope("decode");
+    Mat src = imread(path, IMREAD_UNCHANGED);
+    decode_scope.end();
+    if (src.empty()) {
+        cerr << "Cannot read depth file: " << path << endl;
+        return false;
+    }
+    origDepthType = src.depth();
+    TraceScope convert_scope("convert");
+    return depthToFloat(src, depth32f);
+}
+
+bool loadDepthUnconverted(const String& path, Mat& depth, MappedDepth& mapped, int& origDepthType)
+{
+    TraceScope decode_scope("decode");
+    if (isRawDepthPath(path)) {
+        if (!mapped.open(path)) return false;
+        depth = mapped.mat();
+    } else {
+        depth = imread(path, IMREAD_UNCHANGED);
+        if (depth.empty()) {
+            cerr << "Cannot read depth file: " << path << endl;
+            return false;
+        }
+    }
+    decode_scope.end();
+    origDepthType = depth.depth();
+    if (depth.channels() == 1) return true;
+    TraceScope convert_scope("convert");
+    Mat src = depth;
+    return depthToFloat(src, depth);
+}
+
+bool saveDepthLike(const Mat& depth32f, const String& outPath, int likeDepth)
+{
+    TraceScope convert_scope("convert");
+    Mat out;
+    if (!depthFromFloat(depth32f, likeDepth, out))
+        return false;
+    convert_scope.end();
+    TraceScope encode_scope("encode");
+    if (isRawDepthPath(outPath))
+        return writeRawDepth(outPath, out);
+    return imwrite(outPath, out);
+}
+
+bool readFileBytes(const String& path, vector<uchar>& buf)
+{
+    ifstream in(path.c_str(), ios::binary | ios::ate);
+    if (!in)
+        return false;
+    streamsize size = in.tellg();
+    in.seekg(0, ios::beg);
+    buf.resize((size_t)std::max<streamsize>(size, 0));
+    return size <= 0 || (bool)in.read((char*)&buf[0], size);
+}
+
+bool writeFileBytes(const String& path, const vector<uchar>& buf)
+{
+    ofstream out(path.c_str(), ios::binary);
+    if (!out)
+        return false;
+    if (!buf.empty())
+        out.write((const char*)&buf[0], (streamsize)buf.size());
+    return (bool)out;
+}
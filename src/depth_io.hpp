@@ -0,0 +1,31 @@
+#ifndef DISPARITY_DEPTH_IO_HPP
+#define DISPARITY_DEPTH_IO_HPP
+
+#include "opencv2/core.hpp"
+#include "raw_depth.hpp"
+#include <vector>
+
+// 把已解码的深度图（任意通道数/位深）转换为单通道CV_32F
+bool depthToFloat(const cv::Mat& src, cv::Mat& depth32f);
+
+// 同depthToFloat，但结果总是拥有自己的内存（src可以是随后会被关闭的文件映射）
+bool rawDepthToFloat(const cv::Mat& mapped, cv::Mat& depth32f);
+
+// 把浮点深度转换回likeDepth位深
+bool depthFromFloat(const cv::Mat& depth32f, int likeDepth, cv::Mat& out);
+
+// 将深度图加载为单通道CV_32F并返回原始位深（文件只解码一次）；.rdm文件直接映射，不解码
+bool loadDepthAsFloat(const cv::String& path, cv::Mat& depth32f, int& origDepthType);
+
+// 加载深度图但不转换位深：单通道保持原类型（.rdm映射到mapped中，depth在mapped关闭前有效），
+// 多通道按depthToFloat转为CV_32F。用于自己做类型转换的融合预处理
+bool loadDepthUnconverted(const cv::String& path, cv::Mat& depth, MappedDepth& mapped, int& origDepthType);
+
+// 按原始位深保存浮点深度；扩展名为.rdm时写原始格式
+bool saveDepthLike(const cv::Mat& depth32f, const cv::String& outPath, int likeDepth);
+
+// 整个文件读入/写出内存，便于统计I/O字节数并把解码、编码与磁盘读写分开
+bool readFileBytes(const cv::String& path, std::vector<uchar>& buf);
+bool writeFileBytes(const cv::String& path, const std::vector<uchar>& buf);
+
+#endif
@@ -0,0 +1,114 @@
+#include "opencv2/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/core/utils/filesystem.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "depth_io.hpp"
+#include "raw_depth.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+// 深度图读写耗时对比：编码格式（PNG/TIFF）与.rdm原始映射格式，走工具实际使用的saveDepthLike/loadDepthAsFloat
+const String keys =
+    "{help h usage ? |      | print this message                                               }"
+    "{dir            |.     | directory for the temporary files                                }"
+    "{runs           |5     | repetitions per measurement (median is reported)                 }"
+    "{keep           |      | keep the written files                                           }"
+    ;
+
+// 合成深度（毫米）：平滑斜面 + 几个台阶 + 传感器噪声，压缩率接近真实深度图
+static Mat syntheticDepth(Size size)
+{
+    Mat depth(size, CV_32F);
+    RNG rng(12345);
+    for (int y = 0; y < size.height; y++) {
+        float* d = depth.ptr<float>(y);
+        for (int x = 0; x < size.width; x++) {
+            float v = 800.f + 3000.f * y / size.height + 500.f * x / size.width;
+            if ((x / (size.width / 5)) % 2 == 1 && y > size.height / 3) v -= 400.f;
+            d[x] = std::floor(v + (float)rng.gaussian(4.0));
+        }
+    }
+    return depth;
+}
+
+static double medianOf(vector<double> v)
+{
+    std::sort(v.begin(), v.end());
+    return v[v.size() / 2];
+}
+
+static double fileMB(const String& path)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return 0.0;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fclose(f);
+    return n / (1024.0 * 1024.0);
+}
+
+int main(int argc, char** argv)
+{
+    CommandLineParser parser(argc, argv, keys);
+    parser.about("Usage: depth_io_bench [--dir=/tmp] [--runs=5]");
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    const String dir = parser.get<String>("dir");
+    const int runs = std::max(parser.get<int>("runs"), 1);
+    const bool keep = parser.has("keep");
+    if (!utils::fs::isDirectory(dir) && !utils::fs::createDirectories(dir)) {
+        cerr << "Cannot create directory: " << dir << endl;
+        return -1;
+    }
+
+    struct Case { const char* type_name; int depth; const char* ext; };
+    const Case cases[] = {
+        { "16U", CV_16U, ".png" }, { "16U", CV_16U, ".tiff" }, { "16U", CV_16U, ".rdm" },
+        { "32F", CV_32F, ".tiff" }, { "32F", CV_32F, ".rdm" },
+    };
+    const Size sizes[] = { Size(1280, 720), Size(3840, 2160) };
+
+    // 文件在页缓存中（反复读写同一文件），测的是编解码和拷贝的开销，不是磁盘带宽
+    printf("%-10s %-5s %-6s %10s %10s %9s  %s\n", "size", "type", "format", "save ms", "load ms", "MB", "round-trip");
+    bool all_exact = true;
+    for (size_t si = 0; si < sizeof(sizes) / sizeof(sizes[0]); si++) {
+        const Mat depth32f = syntheticDepth(sizes[si]);
+        for (size_t ci = 0; ci < sizeof(cases) / sizeof(cases[0]); ci++) {
+            const Case& c = cases[ci];
+            const String path = utils::fs::join(dir, String("depth_io_bench") + c.ext);
+            vector<double> save_ms, load_ms;
+            Mat loaded;
+            int loaded_depth = -1;
+            bool ok = true;
+            for (int r = 0; r < runs && ok; r++) {
+                int64 t0 = getTickCount();
+                ok = saveDepthLike(depth32f, path, c.depth);
+                int64 t1 = getTickCount();
+                ok = ok && loadDepthAsFloat(path, loaded, loaded_depth);
+                int64 t2 = getTickCount();
+                save_ms.push_back((t1 - t0) * 1000.0 / getTickFrequency());
+                load_ms.push_back((t2 - t1) * 1000.0 / getTickFrequency());
+            }
+            char size_str[32];
+            snprintf(size_str, sizeof(size_str), "%dx%d", sizes[si].width, sizes[si].height);
+            if (!ok) {
+                // 例如OpenCV编译时没有TIFF支持
+                printf("%-10s %-5s %-6s %10s %10s %9s  %s\n", size_str, c.type_name, c.ext, "-", "-", "-", "unsupported");
+                continue;
+            }
+            const bool exact = loaded_depth == c.depth && norm(loaded, depth32f, NORM_INF) == 0.0;
+            all_exact = all_exact && exact;
+            printf("%-10s %-5s %-6s %10.2f %10.2f %9.2f  %s\n", size_str, c.type_name, c.ext,
+                   medianOf(save_ms), medianOf(load_ms), fileMB(path), exact ? "exact" : "MISMATCH");
+            if (!keep) remove(path.c_str());
+        }
+    }
+    return all_exact ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+#include "depth_prep.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <mutex>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+namespace
+{
+
+template<typename T> static inline void sort3(T& a, T& b, T& c)
+{
+    if(b < a) std::swap(a, b);
+    if(c < b) std::swap(b, c);
+    if(b < a) std::swap(a, b);
+}
+
+template<typename T> static inline T med3(T a, T b, T c)
+{
+    return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
+
+// 行带[y0, y1)：中值写入median（CV_32F），fixed非空时同时写x16定点，并更新行带内的最小/最大值。
+// 3x3中值：先把每列的上中下三个值排好序，中值 = med3(左中右三列最小值的最大者, 中间值的中值, 最大值的最小者)
+template<typename T>
+static void prepRows(const Mat& src, int y0, int y1, Mat& median, Mat* fixed, float& vmin, float& vmax)
+{
+    const int width = src.cols, rows = src.rows;
+    vector<T> buf((size_t)(width + 2) * 3);
+    T* lo = &buf[1];
+    T* mid = &buf[width + 3];
+    T* hi = &buf[2 * (width + 2) + 1];
+    for(int y = y0; y < y1; y++)
+    {
+        const T* r0 = src.ptr<T>(std::max(y - 1, 0));
+        const T* r1 = src.ptr<T>(y);
+        const T* r2 = src.ptr<T>(std::min(y + 1, rows - 1));
+        for(int x = 0; x < width; x++)
+        {
+            T a = r0[x], b = r1[x], c = r2[x];
+            sort3(a, b, c);
+            lo[x] = a;
+            mid[x] = b;
+            hi[x] = c;
+        }
+        // BORDER_REPLICATE
+        lo[-1] = lo[0]; mid[-1] = mid[0]; hi[-1] = hi[0];
+        lo[width] = lo[width - 1]; mid[width] = mid[width - 1]; hi[width] = hi[width - 1];
+
+        float* m = median.ptr<float>(y);
+        short* f = fixed ? fixed->ptr<short>(y) : 0;
+        for(int x = 0; x < width; x++)
+        {
+            const T a = std::max(std::max(lo[x - 1], lo[x]), lo[x + 1]);
+            const T b = med3(mid[x - 1], mid[x], mid[x + 1]);
+            const T c = std::min(std::min(hi[x - 1], hi[x]), hi[x + 1]);
+            const float v = (float)med3(a, b, c);
+            m[x] = v;
+            vmin = std::min(vmin, v);
+            vmax = std::max(vmax, v);
+            if(f) f[x] = saturate_cast<short>(v * 16.f);
+        }
+    }
+}
+
+typedef void (*PrepRowsFn)(const Mat& src, int y0, int y1, Mat& median, Mat* fixed, float& vmin, float& vmax);
+
+static PrepRowsFn selectPrepKernel(int depth)
+{
+    switch(depth)
+    {
+        case CV_8U:  return prepRows<uchar>;
+        case CV_16U: return prepRows<ushort>;
+        case CV_16S: return prepRows<short>;
+        case CV_32S: return prepRows<int>;
+        case CV_32F: return prepRows<float>;
+        case CV_64F: return prepRows<double>;
+        default:     return 0;
+    }
+}
+
+} // namespace
+
+bool DepthPrep::run(const Mat& depth, bool fixed_point)
+{
+    CV_Assert(!depth.empty() && depth.channels() == 1 && depth.data != median.data);
+    const PrepRowsFn prep = selectPrepKernel(depth.depth());
+    if(!prep)
+        return false;
+
+    const int width = depth.cols, height = depth.rows;
+    median.create(depth.size(), CV_32F);
+    if(fixed_point)
+        depth16s.create(depth.size(), CV_16S);
+
+    // 第一遍：转换、中值、值域和定点输入，每个行带各自统计后合并
+    mutex lock;
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    const int nstripes = std::max(1, std::min(height / 16, getNumThreads() * 4));
+    parallel_for_(Range(0, height), [&](const Range& r)
+    {
+        float vmin = FLT_MAX, vmax = -FLT_MAX;
+        prep(depth, r.start, r.end, median, fixed_point ? &depth16s : 0, vmin, vmax);
+        lock_guard<mutex> g(lock);
+        lo = std::min(lo, vmin);
+        hi = std::max(hi, vmax);
+    }, nstripes);
+    min_val = lo;
+    max_val = hi;
+
+    // 第二遍：由值域把median映射为8位引导图
+    guide8u.create(depth.size(), CV_8U);
+    if(max_val - min_val < 1e-6)
+    {
+        guide8u = Scalar(128);
+        return true;
+    }
+    const float a = (float)(255.0 / (max_val - min_val)), b = (float)(-min_val * 255.0 / (max_val - min_val));
+    parallel_for_(Range(0, height), [&](const Range& r)
+    {
+        for(int y = r.start; y < r.end; y++)
+        {
+            const float* m = median.ptr<float>(y);
+            uchar* g = guide8u.ptr<uchar>(y);
+            for(int x = 0; x < width; x++)
+                g[x] = saturate_cast<uchar>(m[x] * a + b);
+        }
+    }, nstripes);
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef DISPARITY_DEPTH_PREP_HPP
+#define DISPARITY_DEPTH_PREP_HPP
+
+#include "opencv2/core.hpp"
+
+// only_wls的融合预处理。按行带流式处理原始位深的单通道深度图，一遍同时完成：
+//   类型转换 + 3x3中值滤波（与medianBlur(depth32f, median, 3)逐像素相同，边界BORDER_REPLICATE）、
+//   值域统计（min/max）、可选的x16定点输入（saturate_cast<short>(median * 16)）。
+// 引导图依赖整幅的值域，只能在第二遍由median生成（guide = (median - min) * 255 / (max - min)）。
+// 每种输入位深各有一个模板实例化的内核，中值直接在原始类型上比较，转换只在写出时做一次。
+// 缓冲区保存在对象内，多次调用之间复用；一个实例不能同时被多个线程使用。
+struct DepthPrep
+{
+    cv::Mat median;     // CV_32F
+    cv::Mat guide8u;    // 值域为0时全为128
+    cv::Mat depth16s;   // 仅fixed_point时生成
+    double min_val, max_val;
+
+    DepthPrep() : min_val(0.0), max_val(0.0) {}
+
+    // depth为单通道CV_8U/16U/16S/32S/32F/64F。depth不能与median共用内存
+    bool run(const cv::Mat& depth, bool fixed_point);
+};
+
+#endif
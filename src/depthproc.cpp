@@ -0,0 +1,99 @@
+#include "depthproc.hpp"
+#include <iostream>
+
+using namespace cv;
+using namespace std;
+
+Mat wrapImage(const ImageView& view)
+{
+    return Mat(view.height, view.width, view.type, view.data, view.step ? view.step : (size_t)Mat::AUTO_STEP);
+}
+
+static bool checkView(const ImageView& view, Size size, int type, const char* what)
+{
+    if (!view.data || view.width != size.width || view.height != size.height || view.type != type) {
+        cerr << "depthproc: " << what << " buffer has the wrong size or type (expected "
+             << size.width << "x" << size.height << ", type " << type << ")" << endl;
+        return false;
+    }
+    return true;
+}
+
+// 阶段内部一般会直接写进out的内存；如果某个OpenCV函数重新分配了输出，结果再拷回调用方的缓冲区
+static void deliver(const Mat& produced, const ImageView& view)
+{
+    if (produced.data != view.data) {
+        Mat dst = wrapImage(view);
+        produced.copyTo(dst);
+    }
+}
+
+bool StereoStage::init(const StereoParams& params)
+{
+    frame.index = 0;
+    return createStereoContext(params, ctx);
+}
+
+bool StereoStage::process(const ImageView& left, const ImageView& right, const ImageView& disparity,
+                          const ImageView* raw, const ImageView* conf)
+{
+    const Size size(left.width, left.height);
+    if (!checkView(left, size, CV_8UC3, "left") || !checkView(right, size, CV_8UC3, "right") ||
+        !checkView(disparity, size, CV_16SC1, "disparity"))
+        return false;
+    if (raw && !checkView(*raw, size, CV_16SC1, "raw"))
+        return false;
+    if (conf && !checkView(*conf, size, ctx.use_conf ? CV_32FC1 : CV_8UC1, "conf"))
+        return false;
+
+    frame.left = wrapImage(left);
+    frame.right = wrapImage(right);
+    frame.filtered_disp = wrapImage(disparity);
+    matchFrame(ctx, frame);
+    filterFrame(ctx, frame);
+    deliver(frame.filtered_disp, disparity);
+    if (raw) deliver(frame.raw_disp, *raw);
+    if (conf) deliver(frame.conf_map, *conf);
+    frame.index++;
+    return true;
+}
+
+bool wlsDepth(DepthWLS& filter, const ImageView& depth, const ImageView& out)
+{
+    const Size size(depth.width, depth.height);
+    if (!checkView(depth, size, CV_32FC1, "depth") || !checkView(out, size, CV_32FC1, "out"))
+        return false;
+    Mat dst = wrapImage(out);
+    if (!filter.apply(wrapImage(depth), dst)) return false;
+    deliver(dst, out);
+    return true;
+}
+
+bool bilateralDepth(DepthBilateral& filter, const ImageView& depth, const ImageView& out)
+{
+    const Size size(depth.width, depth.height);
+    if (!checkView(depth, size, CV_32FC1, "depth") || !checkView(out, size, CV_32FC1, "out"))
+        return false;
+    Mat dst = wrapImage(out);
+    filter.apply(wrapImage(depth), dst);
+    deliver(dst, out);
+    return true;
+}
+
+bool edgeGradient(const ImageView& gray, GradientOperator op, GradientMagnitude norm, const ImageView& magnitude,
+                  const ImageView* dx, const ImageView* dy)
+{
+    const Size size(gray.width, gray.height);
+    if (!checkView(gray, size, CV_8UC1, "gray") || !checkView(magnitude, size, CV_8UC1, "magnitude"))
+        return false;
+    if ((dx && !checkView(*dx, size, CV_16SC1, "dx")) || (dy && !checkView(*dy, size, CV_16SC1, "dy")))
+        return false;
+    Mat mag = wrapImage(magnitude), mdx, mdy;
+    if (dx) mdx = wrapImage(*dx);
+    if (dy) mdy = wrapImage(*dy);
+    fusedGradient(wrapImage(gray), op, norm, mag, dx ? &mdx : 0, dy ? &mdy : 0);
+    deliver(mag, magnitude);
+    if (dx) deliver(mdx, *dx);
+    if (dy) deliver(mdy, *dy);
+    return true;
+}
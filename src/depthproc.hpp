@@ -0,0 +1,61 @@
+#ifndef DISPARITY_DEPTHPROC_HPP
+#define DISPARITY_DEPTHPROC_HPP
+
+// depthproc：匹配、WLS、双边和边缘各阶段的进程内接口。
+// 各命令行工具只是这些接口外面的一层文件读写；服务可以直接链接depthproc，逐帧在内存中调用，
+// 不需要经过PNG编解码和子进程。
+
+#include "opencv2/core.hpp"
+#include "stereo_pipeline.hpp"
+#include "depth_filters.hpp"
+#include "fused_gradient.hpp"
+
+// 调用方持有的图像缓冲区：只描述内存布局，库内在这块内存上直接构造cv::Mat头，不拷贝。
+// 输入缓冲区只读；输出缓冲区必须已分配好，结果直接写入其中。
+struct ImageView
+{
+    void* data;
+    int width, height;
+    size_t step; // 每行字节数，0表示紧密排列
+    int type;    // OpenCV类型：CV_8UC1、CV_8UC3、CV_16SC1、CV_32FC1等
+
+    ImageView() : data(0), width(0), height(0), step(0), type(0) {}
+    ImageView(void* _data, int _width, int _height, int _type, size_t _step = 0)
+        : data(_data), width(_width), height(_height), step(_step), type(_type) {}
+};
+
+// 共享view内存的cv::Mat头
+cv::Mat wrapImage(const ImageView& view);
+
+// 立体匹配+WLS后滤波。匹配器、滤波器和各级中间缓冲区在init时创建，之后每帧复用。
+// 一个实例同一时刻只能处理一帧。
+class StereoStage
+{
+public:
+    bool init(const StereoParams& params);
+
+    // left/right：CV_8UC3（BGR），同尺寸。disparity：CV_16SC1（x16定点），与left同尺寸。
+    // raw（可选）：滤波前的视差，CV_16SC1，与left同尺寸。conf（可选）：置信度图，CV_32FC1（wls_conf）或CV_8UC1（wls_no_conf）。
+    bool process(const ImageView& left, const ImageView& right, const ImageView& disparity,
+                 const ImageView* raw = 0, const ImageView* conf = 0);
+
+    // 上一帧的耗时等统计
+    const StereoFrame& lastFrame() const { return frame; }
+    const StereoContext& context() const { return ctx; }
+
+private:
+    StereoContext ctx;
+    StereoFrame frame;
+};
+
+// 深度WLS（only_wls）：depth与out均为CV_32FC1，同尺寸，不能共用内存
+bool wlsDepth(DepthWLS& filter, const ImageView& depth, const ImageView& out);
+
+// 深度双边滤波（bilateral_filter）：depth与out均为CV_32FC1，同尺寸，不能共用内存
+bool bilateralDepth(DepthBilateral& filter, const ImageView& depth, const ImageView& out);
+
+// 3x3 Sobel/Scharr梯度（edge_detection）：gray与magnitude为CV_8UC1；dx、dy（可选）为CV_16SC1
+bool edgeGradient(const ImageView& gray, GradientOperator op, GradientMagnitude norm, const ImageView& magnitude,
+                  const ImageView* dx = 0, const ImageView* dy = 0);
+
+#endif
@@ -0,0 +1,519 @@
+#include "opencv2/imgproc.hpp"
+#include "opencv2/core/utility.hpp"
+#include "depthproc.hpp"
+#include "disparity_range.hpp"
+#include "buffer_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define BENCH_POSIX 1
+#else
+#define BENCH_POSIX 0
+#endif
+
+using namespace cv;
+using namespace std;
+
+// 合成立体对上的速度/精度基准。每个算法/滤波组合默认在单独的子进程中运行，峰值RSS互不影响。
+// 结果每个组合一行JSON写到stdout（或--out文件），便于脚本比较；stderr上打印一张可读的表。
+const String keys =
+    "{help h usage ? |            | print this message                                                }"
+    "{width          |1280        | synthetic image width                                             }"
+    "{height         |720         | synthetic image height                                            }"
+    "{max_disparity  |48          | matcher disparity range (ground truth spans 10%..60% of it)       }"
+    "{scene          |all         | planes (fronto-parallel layers), slanted (slanted planes) or all  }"
+    "{reps           |5           | timed repetitions per combination (after one warm-up run)         }"
+    "{algos          |bm,sgbm,census | comma-separated matchers to run                               }"
+    "{bad_thresh     |1.0         | bad pixel: |disparity - ground truth| > bad_thresh                }"
+    "{pyramid        |0           | coarse-to-fine levels passed to the matcher (0 = off)             }"
+    "{auto_range     |            | estimate the matcher range from ORB matches instead of max_disparity }"
+    "{out            |            | write the JSON lines to this file instead of stdout               }"
+    "{in_process     |            | run all combinations in this process (peak RSS is then cumulative) }"
+    "{buffer_pool_mb |512         | cap on idle Mat buffers reused across repetitions (0 = no pool, every repetition allocates) }"
+    "{allow_alloc    |            | with the buffer pool, do not fail combinations that still allocate from the heap after the warm-up run }"
+    "{selective      |            | also run wls_conf with selective refinement (WLS only around low-confidence regions) }"
+    "{hole_fill      |            | also run wls_no_conf with scanline hole filling before a lighter smoothing pass }"
+    "{fill_lambda    |            | hole_fill: wls_lambda of the combinations with hole filling (default 8000, as the others) }"
+    "{fill_iters     |            | hole_fill: smoothing iterations after hole filling (default 3, as in the WLS filter) }"
+    "{combo          |            | internal: run a single algo/filter/downscale combination          }"
+    ;
+
+//////////////////////////////////////////////////////////////////////////////
+// 合成场景：若干带纹理的平面层，视差在左图坐标下为d = a*x + b*y + c。
+// 纹理固定在左图坐标上，右图像素xr看到的是满足x - d(x) = xr的层点，多层重叠时取视差最大（最近）的层。
+// 左图中在右图被遮挡或落到右图之外的像素，真值记为无效。
+
+struct PlaneLayer
+{
+    Rect2d rect;     // 左图中的范围
+    double a, b, c;  // d = a*x + b*y + c
+    Mat texture;     // CV_32F，列方向比图像宽2*margin
+};
+
+struct SyntheticPair
+{
+    Mat left, right; // CV_8UC3
+    Mat gt;          // CV_32F，无效为NaN
+    double valid_fraction;
+};
+
+static Mat makeTexture(Size size, RNG& rng)
+{
+    Mat noise(size, CV_32F);
+    rng.fill(noise, RNG::UNIFORM, 0.0, 255.0);
+    Mat smooth;
+    GaussianBlur(noise, smooth, Size(0, 0), 1.0);
+    normalize(smooth, smooth, 20.0, 235.0, NORM_MINMAX);
+    return smooth;
+}
+
+static inline float sampleBilinear(const Mat& tex, double x, int y, int margin)
+{
+    const double u = std::min(std::max(x + margin, 0.0), (double)tex.cols - 1.001);
+    const int u0 = (int)u;
+    const float t = (float)(u - u0);
+    const float* row = tex.ptr<float>(y);
+    return row[u0] * (1.f - t) + row[u0 + 1] * t;
+}
+
+// 右图(xr, y)处可见的层及其左图坐标，没有层覆盖时返回-1
+static int visibleInRight(const vector<PlaneLayer>& layers, double xr, int y, double& x_left)
+{
+    int best = -1;
+    double best_d = -1e9;
+    for(size_t i = 0; i < layers.size(); i++)
+    {
+        const PlaneLayer& L = layers[i];
+        const double x = (xr + L.b * y + L.c) / (1.0 - L.a);
+        if(x < L.rect.x || x >= L.rect.x + L.rect.width || y < L.rect.y || y >= L.rect.y + L.rect.height)
+            continue;
+        const double d = L.a * x + L.b * y + L.c;
+        if(d > best_d)
+        {
+            best_d = d;
+            best = (int)i;
+            x_left = x;
+        }
+    }
+    return best;
+}
+
+static SyntheticPair renderScene(const String& scene, Size size, int max_disp, unsigned seed)
+{
+    const double w = size.width, h = size.height, D = max_disp;
+    const int margin = max_disp + 2;
+    vector<PlaneLayer> layers;
+    RNG rng(seed);
+    auto add = [&](Rect2d r, double a, double b, double c)
+    {
+        PlaneLayer L;
+        L.rect = r;
+        L.a = a; L.b = b; L.c = c;
+        L.texture = makeTexture(Size(size.width + 2 * margin, size.height), rng);
+        layers.push_back(L);
+    };
+    const Rect2d all(-1e9, -1e9, 2e9, 2e9);
+    if(scene == "slanted")
+    {
+        // 倾斜背景（水平方向视差10%~40%），纵向倾斜的中景板，正对的前景块
+        add(all, 0.3 * D / w, 0.0, 0.1 * D);
+        add(Rect2d(0.15 * w, 0.2 * h, 0.35 * w, 0.55 * h), 0.0, 0.1 * D / h, 0.4 * D);
+        add(Rect2d(0.6 * w, 0.35 * h, 0.25 * w, 0.4 * h), -0.05 * D / w, 0.05 * D / h, 0.55 * D);
+    }
+    else
+    {
+        // 正对的背景和三个不同深度的前景块
+        add(all, 0.0, 0.0, 0.15 * D);
+        add(Rect2d(0.1 * w, 0.15 * h, 0.3 * w, 0.35 * h), 0.0, 0.0, 0.3 * D);
+        add(Rect2d(0.5 * w, 0.1 * h, 0.35 * w, 0.3 * h), 0.0, 0.0, 0.45 * D);
+        add(Rect2d(0.35 * w, 0.55 * h, 0.3 * w, 0.35 * h), 0.0, 0.0, 0.6 * D);
+    }
+
+    SyntheticPair pair;
+    Mat left(size, CV_8U), right(size, CV_8U);
+    pair.gt.create(size, CV_32F);
+    size_t valid = 0;
+    for(int y = 0; y < size.height; y++)
+    {
+        uchar* l = left.ptr<uchar>(y);
+        uchar* r = right.ptr<uchar>(y);
+        float* g = pair.gt.ptr<float>(y);
+        for(int x = 0; x < size.width; x++)
+        {
+            // 左图：覆盖该像素、视差最大的层
+            int top = 0;
+            double d_top = -1e9;
+            for(size_t i = 0; i < layers.size(); i++)
+            {
+                const PlaneLayer& L = layers[i];
+                if(x < L.rect.x || x >= L.rect.x + L.rect.width || y < L.rect.y || y >= L.rect.y + L.rect.height)
+                    continue;
+                const double d = L.a * x + L.b * y + L.c;
+                if(d > d_top) { d_top = d; top = (int)i; }
+            }
+            l[x] = saturate_cast<uchar>(sampleBilinear(layers[top].texture, x, y, margin));
+
+            // 真值：对应点在右图内，且右图该处可见的正是同一层
+            double xl = 0.0;
+            const double xr = x - d_top;
+            const bool visible = xr >= 0.0 && visibleInRight(layers, xr, y, xl) == top && std::abs(xl - x) < 1e-3;
+            g[x] = visible ? (float)d_top : std::numeric_limits<float>::quiet_NaN();
+            valid += visible;
+
+            const int li = visibleInRight(layers, x, y, xl);
+            r[x] = saturate_cast<uchar>(sampleBilinear(layers[li].texture, xl, y, margin));
+        }
+    }
+    cvtColor(left, pair.left, COLOR_GRAY2BGR);
+    cvtColor(right, pair.right, COLOR_GRAY2BGR);
+    pair.valid_fraction = (double)valid / size.area();
+    return pair;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+struct Combo
+{
+    String algo, filter;
+    bool downscale;
+    bool selective; // 仅wls_conf：选择性细化
+    bool hole_fill; // 仅wls_no_conf：滤波前填洞
+    double lambda;
+    int fill_iters;
+};
+
+struct ComboResult
+{
+    bool ok;
+    vector<double> match_ms, filter_ms, total_ms;
+    double bad_raw, invalid_raw, bad_filtered;
+    double peak_rss_mb;
+    int min_disp, num_disp; // 实际使用的视差范围（原图尺度）
+    long long heap_allocs;  // 预热之后所有计时重复中的Mat堆分配次数
+    double refined_fraction; // 选择性细化最后一次的求解面积比例（整图滤波为1）
+
+    ComboResult() : ok(false), bad_raw(0.0), invalid_raw(0.0), bad_filtered(0.0), peak_rss_mb(0.0), min_disp(0), num_disp(0),
+                    heap_allocs(0), refined_fraction(1.0) {}
+};
+
+static double percentile(vector<double> v, double p)
+{
+    if(v.empty()) return 0.0;
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+// 有真值的像素中|disp/16 - gt| > thresh的比例。disp低于min_disp*16（各匹配器的无效值(min_disp-1)*16，
+// auto_range给出正的min_disp时它也是正数）记为无效，同时计入错误。min_disp为原图尺度
+static void badPixelRate(const Mat& disp16s, const Mat& gt, int min_disp, double thresh, double& bad, double& invalid)
+{
+    const int valid = min_disp * 16;
+    size_t n = 0, nbad = 0, ninvalid = 0;
+    for(int y = 0; y < gt.rows; y++)
+    {
+        const float* g = gt.ptr<float>(y);
+        const short* d = disp16s.ptr<short>(y);
+        for(int x = 0; x < gt.cols; x++)
+        {
+            if(g[x] != g[x]) continue; // NaN
+            n++;
+            if(d[x] < valid) { ninvalid++; nbad++; continue; }
+            nbad += std::abs(d[x] / 16.0 - g[x]) > thresh;
+        }
+    }
+    bad = n ? (double)nbad / n : 0.0;
+    invalid = n ? (double)ninvalid / n : 0.0;
+}
+
+static String comboName(const Combo& c)
+{
+    return c.algo + "," + c.filter + "," + (c.downscale ? "downscale" : "full") + (c.selective ? ",selective" : "") +
+           (c.hole_fill ? ",fill" : "");
+}
+
+static ComboResult runCombo(const Combo& c, const SyntheticPair& pair, int max_disp, bool auto_range, int pyramid, int reps,
+                            double thresh, bool expect_zero_alloc)
+{
+    ComboResult res;
+    res.min_disp = defaultMinDisparity(c.algo, c.filter);
+    res.num_disp = max_disp;
+
+    // 估计失败时保留--max_disparity给出的范围
+    DisparityRangeResult range;
+    if(auto_range && estimateDisparityRange(pair.left, pair.right, DisparityRangeOptions(), range))
+    {
+        res.min_disp = range.min_disp;
+        res.num_disp = range.num_disp;
+    }
+
+    StereoParams params;
+    params.algo = c.algo;
+    params.filter = c.filter;
+    params.no_downscale = !c.downscale;
+    params.min_disp = matcherMinDisparity(res.min_disp, c.filter, params.no_downscale);
+    params.max_disp = matcherMaxDisparity(res.num_disp, c.filter, params.no_downscale);
+    params.lambda = c.lambda;
+    params.sigma = 1.0;
+    params.wsize = defaultWindowSize(c.algo, c.filter, params.no_downscale);
+    params.left_threads = params.right_threads = 1;
+    params.pyr_levels = pyramid;
+    params.selective = c.selective;
+    params.hole_fill = c.hole_fill;
+    params.fill_iters = c.fill_iters;
+
+    StereoStage stage;
+    if(!stage.init(params))
+        return res;
+
+    const Size size = pair.left.size();
+    Mat filtered(size, CV_16S), raw(size, CV_16S);
+    ImageView lv(pair.left.data, size.width, size.height, CV_8UC3, pair.left.step);
+    ImageView rv(pair.right.data, size.width, size.height, CV_8UC3, pair.right.step);
+    ImageView fv(filtered.data, size.width, size.height, CV_16SC1, filtered.step);
+    ImageView raw_v(raw.data, size.width, size.height, CV_16SC1, raw.step);
+
+    MatAllocCounts warm = matAllocCounts();
+    for(int r = 0; r <= reps; r++)
+    {
+        int64 t0 = getTickCount();
+        if(!stage.process(lv, rv, fv, &raw_v))
+            return res;
+        const double total = (getTickCount() - t0) * 1000.0 / getTickFrequency();
+        if(r == 0) // 预热：首次调用包含缓冲区分配
+        {
+            warm = matAllocCounts();
+            continue;
+        }
+        res.match_ms.push_back(stage.lastFrame().matching_time * 1000.0);
+        res.filter_ms.push_back(stage.lastFrame().filtering_time * 1000.0);
+        res.total_ms.push_back(total);
+    }
+    res.heap_allocs = matAllocCounts().allocs - warm.allocs;
+    res.refined_fraction = stage.lastFrame().refined_fraction;
+    double unused;
+    badPixelRate(raw, pair.gt, res.min_disp, thresh, res.bad_raw, res.invalid_raw);
+    badPixelRate(filtered, pair.gt, res.min_disp, thresh, res.bad_filtered, unused);
+    res.peak_rss_mb = peakRSSMB();
+    res.ok = true;
+    if(expect_zero_alloc && res.heap_allocs > 0)
+    {
+        cerr << comboName(c) << ": " << res.heap_allocs << " Mat heap allocations after the warm-up run" << endl;
+        res.ok = false;
+    }
+    return res;
+}
+
+static String jsonLine(const String& scene, Size size, int max_disp, const Combo& c, const ComboResult& r)
+{
+    const double mp = size.area() / 1e6;
+    return format("{\"scene\":\"%s\",\"width\":%d,\"height\":%d,\"max_disparity\":%d,\"min_disp\":%d,\"num_disp\":%d,"
+                  "\"algo\":\"%s\",\"filter\":\"%s\",\"downscale\":%s,\"selective\":%s,\"hole_fill\":%s,\"lambda\":%g,\"ok\":%s,\"reps\":%d,"
+                  "\"match_ms_median\":%.3f,\"filter_ms_median\":%.3f,\"total_ms_median\":%.3f,\"total_ms_p95\":%.3f,"
+                  "\"ms_per_mp_median\":%.3f,\"ms_per_mp_p95\":%.3f,"
+                  "\"bad_raw\":%.5f,\"invalid_raw\":%.5f,\"bad_filtered\":%.5f,\"peak_rss_mb\":%.1f,"
+                  "\"refined_fraction\":%.4f,\"heap_allocs_per_rep\":%.2f,\"buffer_pool\":%s,\"threads\":%d}",
+                  scene.c_str(), size.width, size.height, max_disp, r.min_disp, r.num_disp, c.algo.c_str(), c.filter.c_str(),
+                  c.downscale ? "true" : "false", c.selective ? "true" : "false",
+                  c.hole_fill ? "true" : "false", c.lambda, r.ok ? "true" : "false", (int)r.total_ms.size(),
+                  percentile(r.match_ms, 0.5), percentile(r.filter_ms, 0.5),
+                  percentile(r.total_ms, 0.5), percentile(r.total_ms, 0.95),
+                  percentile(r.total_ms, 0.5) / mp, percentile(r.total_ms, 0.95) / mp,
+                  r.bad_raw, r.invalid_raw, r.bad_filtered, r.peak_rss_mb, r.refined_fraction,
+                  r.total_ms.empty() ? 0.0 : (double)r.heap_allocs / r.total_ms.size(), bufferPoolInstalled() ? "true" : "false",
+                  getNumThreads());
+}
+
+// 在子进程中运行一个组合，返回其JSON行；失败时返回空串
+static String runIsolated(const String& self, const vector<String>& args, const Combo& c)
+{
+    String cmd = "\"" + self + "\"";
+    for(size_t i = 0; i < args.size(); i++)
+        cmd += " \"" + args[i] + "\"";
+    cmd += " \"--combo=" + comboName(c) + "\"";
+#if BENCH_POSIX
+    FILE* p = popen(cmd.c_str(), "r");
+#else
+    FILE* p = _popen(cmd.c_str(), "r");
+#endif
+    if(!p) return String();
+    String out;
+    char buf[4096];
+    while(fgets(buf, sizeof(buf), p))
+        out += buf;
+#if BENCH_POSIX
+    pclose(p);
+#else
+    _pclose(p);
+#endif
+    while(!out.empty() && (out[out.size() - 1] == '\n' || out[out.size() - 1] == '\r'))
+        out.erase(out.size() - 1);
+    // 只取最后一行（前面可能有匹配器的提示信息）
+    size_t nl = out.find_last_of('\n');
+    return nl == String::npos ? out : out.substr(nl + 1);
+}
+
+// 从JSON行中取出一个数值字段，用于stderr上的表格
+static double jsonNumber(const String& line, const String& key)
+{
+    size_t pos = line.find("\"" + key + "\":");
+    return pos == String::npos ? 0.0 : atof(line.c_str() + pos + key.size() + 3);
+}
+
+int main(int argc, char** argv)
+{
+    CommandLineParser parser(argc, argv, keys);
+    parser.about("Usage: disparity_bench [--width=1280 --height=720 --max_disparity=48 --scene=all --reps=5 --out=results.jsonl]");
+    if(parser.has("help"))
+    {
+        parser.printMessage();
+        return 0;
+    }
+    const Size size(parser.get<int>("width"), parser.get<int>("height"));
+    const int max_disp = parser.get<int>("max_disparity");
+    const int reps = std::max(parser.get<int>("reps"), 1);
+    const int pyramid = parser.get<int>("pyramid");
+    const bool auto_range = parser.has("auto_range");
+    const double thresh = parser.get<double>("bad_thresh");
+    const String scene_arg = parser.get<String>("scene");
+    const double pool_mb = parser.get<double>("buffer_pool_mb");
+    // 有缓冲区池时预热之后不应再有堆分配，默认作为失败处理
+    const bool expect_zero_alloc = pool_mb > 0.0 && !parser.has("allow_alloc");
+    if(!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+    if(size.width < 64 || size.height < 32 || max_disp <= 0 || max_disp % 16 != 0 || max_disp >= size.width / 2)
+    {
+        cerr << "Incorrect size or max_disparity (positive multiple of 16, less than width/2)" << endl;
+        return -1;
+    }
+
+    // 堆分配总是计数；有缓冲区池时计数的是池向堆申请的部分
+    if(pool_mb > 0.0)
+        installBufferPool(pool_mb);
+    installMatAllocCounter();
+
+    vector<String> scenes;
+    if(scene_arg == "all") { scenes.push_back("planes"); scenes.push_back("slanted"); }
+    else if(scene_arg == "planes" || scene_arg == "slanted") scenes.push_back(scene_arg);
+    else
+    {
+        cerr << "Unknown scene: " << scene_arg << endl;
+        return -1;
+    }
+
+    // 组合：每个匹配器 x {wls_no_conf, wls_conf全尺寸, wls_conf缩小匹配}；缩小只对wls_conf有意义
+    vector<Combo> combos;
+    String algos = parser.get<String>("algos") + ",";
+    for(size_t start = 0, comma; (comma = algos.find(',', start)) != String::npos; start = comma + 1)
+    {
+        String a = algos.substr(start, comma - start);
+        if(a.empty()) continue;
+        Combo c;
+        c.algo = a;
+        c.selective = false;
+        c.hole_fill = false;
+        c.lambda = 8000.0;
+        c.fill_iters = HOLE_FILL_ITERS;
+        c.filter = "wls_no_conf"; c.downscale = false; combos.push_back(c);
+        if(parser.has("hole_fill"))
+        {
+            Combo fill = c;
+            fill.hole_fill = true;
+            fill.lambda = parser.has("fill_lambda") ? parser.get<double>("fill_lambda") : c.lambda;
+            fill.fill_iters = std::max(parser.has("fill_iters") ? parser.get<int>("fill_iters") : HOLE_FILL_ITERS, 1);
+            combos.push_back(fill);
+        }
+        c.filter = "wls_conf";    c.downscale = false; combos.push_back(c);
+        c.filter = "wls_conf";    c.downscale = true;  combos.push_back(c);
+        if(parser.has("selective"))
+        {
+            c.selective = true;
+            c.downscale = false; combos.push_back(c);
+            c.downscale = true;  combos.push_back(c);
+        }
+    }
+
+    // 子进程模式：只运行--combo指定的一个组合，结果写到stdout
+    if(parser.has("combo"))
+    {
+        const String name = parser.get<String>("combo");
+        for(size_t s = 0; s < scenes.size(); s++)
+        {
+            const SyntheticPair pair = renderScene(scenes[s], size, max_disp, 1234u + (unsigned)s);
+            for(size_t i = 0; i < combos.size(); i++)
+                if(comboName(combos[i]) == name)
+                {
+                    ComboResult r = runCombo(combos[i], pair, max_disp, auto_range, pyramid, reps, thresh, expect_zero_alloc);
+                    cout << jsonLine(scenes[s], size, max_disp, combos[i], r) << endl;
+                    return r.ok ? 0 : 1;
+                }
+        }
+        cerr << "Unknown combo: " << name << endl;
+        return -1;
+    }
+
+    FILE* out = stdout;
+    if(parser.has("out") && !(out = fopen(parser.get<String>("out").c_str(), "w")))
+    {
+        cerr << "Cannot write: " << parser.get<String>("out") << endl;
+        return -1;
+    }
+    const bool in_process = parser.has("in_process") || !BENCH_POSIX;
+
+    // filter ms和refined两列用于对照选择性细化的求解面积与滤波耗时
+    fprintf(stderr, "%-8s %-8s %-12s %-10s %10s %10s %10s %8s %8s %8s %8s %8s %10s\n", "scene", "algo", "filter", "matching",
+            "ms/MP p50", "ms/MP p95", "filter ms", "refined", "bad raw", "bad wls", "valid gt", "RSS MB", "allocs/rep");
+    int failures = 0;
+    for(size_t s = 0; s < scenes.size(); s++)
+    {
+        // 子进程按相同的种子各自生成场景；父进程这里生成的一份用于进程内模式和表格中的真值覆盖率
+        const SyntheticPair pair = renderScene(scenes[s], size, max_disp, 1234u + (unsigned)s);
+        for(size_t i = 0; i < combos.size(); i++)
+        {
+            String line;
+            if(in_process)
+            {
+                line = jsonLine(scenes[s], size, max_disp, combos[i],
+                                runCombo(combos[i], pair, max_disp, auto_range, pyramid, reps, thresh, expect_zero_alloc));
+            }
+            else
+            {
+                // 子进程参数：原参数去掉--scene/--out，只跑当前场景
+                vector<String> args;
+                for(int a = 1; a < argc; a++)
+                {
+                    String arg = argv[a];
+                    if(arg.compare(0, 7, "--scene") != 0 && arg.compare(0, 5, "--out") != 0)
+                        args.push_back(arg);
+                }
+                args.push_back("--scene=" + scenes[s]);
+                line = runIsolated(argv[0], args, combos[i]);
+            }
+            if(line.empty() || line.find("\"ok\":true") == String::npos)
+            {
+                failures++;
+                if(line.empty())
+                    line = jsonLine(scenes[s], size, max_disp, combos[i], ComboResult());
+            }
+            fprintf(out, "%s\n", line.c_str());
+            fflush(out);
+            fprintf(stderr, "%-8s %-8s %-12s %-10s %10.1f %10.1f %10.2f %7.1f%% %7.2f%% %7.2f%% %7.1f%% %8.1f %10.1f\n", scenes[s].c_str(),
+                    combos[i].algo.c_str(), (combos[i].filter + (combos[i].selective ? "+sel" : "") + (combos[i].hole_fill ? "+fill" : "")).c_str(), combos[i].downscale ? "downscale" : "full",
+                    jsonNumber(line, "ms_per_mp_median"), jsonNumber(line, "ms_per_mp_p95"),
+                    jsonNumber(line, "filter_ms_median"), 100.0 * jsonNumber(line, "refined_fraction"),
+                    100.0 * jsonNumber(line, "bad_raw"), 100.0 * jsonNumber(line, "bad_filtered"),
+                    100.0 * pair.valid_fraction, jsonNumber(line, "peak_rss_mb"), jsonNumber(line, "heap_allocs_per_rep"));
+        }
+    }
+    if(out != stdout) fclose(out);
+    return failures == 0 ? 0 : 1;
+}
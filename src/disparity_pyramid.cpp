@@ -0,0 +1,262 @@
+#include "disparity_pyramid.hpp"
+#include "census_sgm.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <climits>
+
+using namespace cv;
+using namespace std;
+
+Ptr<StereoMatcher> cloneMatcher(const Ptr<StereoMatcher>& src)
+{
+    Ptr<StereoMatcher> dst;
+    if(Ptr<StereoBM> bm = src.dynamicCast<StereoBM>())
+    {
+        Ptr<StereoBM> c = StereoBM::create(bm->getNumDisparities(), bm->getBlockSize());
+        c->setPreFilterType(bm->getPreFilterType());
+        c->setPreFilterSize(bm->getPreFilterSize());
+        c->setPreFilterCap(bm->getPreFilterCap());
+        c->setTextureThreshold(bm->getTextureThreshold());
+        c->setUniquenessRatio(bm->getUniquenessRatio());
+        c->setSmallerBlockSize(bm->getSmallerBlockSize());
+        dst = c;
+    }
+    else if(Ptr<StereoSGBM> sgbm = src.dynamicCast<StereoSGBM>())
+    {
+        dst = StereoSGBM::create(sgbm->getMinDisparity(), sgbm->getNumDisparities(), sgbm->getBlockSize(),
+                                 sgbm->getP1(), sgbm->getP2(), sgbm->getDisp12MaxDiff(), sgbm->getPreFilterCap(),
+                                 sgbm->getUniquenessRatio(), sgbm->getSpeckleWindowSize(), sgbm->getSpeckleRange(),
+                                 sgbm->getMode());
+    }
+    else if(Ptr<StereoCensusSGM> census = src.dynamicCast<StereoCensusSGM>())
+    {
+        dst = StereoCensusSGM::create(census->getMinDisparity(), census->getNumDisparities(), census->getBlockSize(),
+                                      census->getP1(), census->getP2(), census->getUniquenessRatio(), census->getPaths());
+    }
+    else
+    {
+        return Ptr<StereoMatcher>();
+    }
+    dst->setMinDisparity(src->getMinDisparity());
+    dst->setSpeckleWindowSize(src->getSpeckleWindowSize());
+    dst->setSpeckleRange(src->getSpeckleRange());
+    dst->setDisp12MaxDiff(src->getDisp12MaxDiff());
+    return dst;
+}
+
+static inline int floorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static inline int alignUp16(int v)
+{
+    return (v + 15) & ~15;
+}
+
+// 第level层的视差范围：minDisparity按比例向下取整，numDisparities向上取整到16的倍数
+static void levelRange(int min_disp, int num_disp, int level, int& lmin, int& lnum)
+{
+    lmin = floorDiv(min_disp, 1 << level);
+    lnum = std::max(16, alignUp16((num_disp + (1 << level) - 1) >> level));
+}
+
+TileRangeMatcher::TileRangeMatcher() : tile(64)
+{
+}
+
+void TileRangeMatcher::init(const Ptr<StereoMatcher>& _proto, int threads, int _tile)
+{
+    CV_Assert(!_proto.empty() && _tile >= 16);
+    proto = _proto;
+    tile = _tile;
+
+    // 每块会修改视差范围，所以不直接使用proto，而是每个并行块组持有一个克隆
+    const int n = std::max(threads > 0 ? threads : getNumThreads(), 1);
+    matchers.clear();
+    for(int i = 0; i < n; i++)
+    {
+        Ptr<StereoMatcher> m = cloneMatcher(proto);
+        if(m.empty())
+            CV_Error(Error::StsNotImplemented, "TileRangeMatcher: unsupported matcher type");
+        matchers.push_back(m);
+    }
+    tile_disp.resize(n);
+}
+
+double TileRangeMatcher::compute(const Mat& left, const Mat& right, int lmin, int lnum, const TileRangeFn& range, Mat& disp)
+{
+    CV_Assert(!matchers.empty());
+    const int lmax = lmin + lnum - 1;
+    const short invalid = (short)((lmin - 1) * StereoMatcher::DISP_SCALE);
+
+    // 裁剪区在块四周多留的像素：覆盖匹配窗口，并给SGM的路径聚合留出预热距离
+    const int halo = proto->getBlockSize() / 2 + 8;
+    const int pad_left = std::max(lnum, lmax + 1) + halo;
+    const int pad_right = halo + std::max(0, -lmin);
+    copyMakeBorder(left, pad_l, halo, halo, pad_left, pad_right, BORDER_REPLICATE);
+    copyMakeBorder(right, pad_r, halo, halo, pad_left, pad_right, BORDER_REPLICATE);
+
+    const int width = left.cols, height = left.rows;
+    disp.create(left.size(), CV_16S);
+    const int tiles_x = (width + tile - 1) / tile, tiles_y = (height + tile - 1) / tile;
+    const int ntiles = tiles_x * tiles_y;
+    const int nm = (int)matchers.size();
+    vector<double> work(nm, 0.0);
+
+    parallel_for_(Range(0, nm), [&](const Range& r)
+    {
+        for(int i = r.start; i < r.end; i++)
+        {
+            StereoMatcher& m = *matchers[i];
+            Mat& td = tile_disp[i];
+            for(int t = i; t < ntiles; t += nm)
+            {
+                const int x0 = (t % tiles_x) * tile, x1 = std::min(width, x0 + tile);
+                const int y0 = (t / tiles_x) * tile, y1 = std::min(height, y0 + tile);
+
+                int dlo = lmin, dhi = lmax;
+                if(!range(Rect(x0, y0, x1 - x0, y1 - y0), dlo, dhi))
+                    continue;
+                dlo = std::max(dlo, lmin);
+                dhi = std::max(std::min(dhi, lmax), dlo);
+                const int n = alignUp16(dhi - dlo + 1);
+                dlo = std::max(lmin, std::min(dlo, lmax - n + 1));
+
+                // 右图裁剪区整体平移dlo，块内视差范围变为[0, n)
+                const int cw = (x1 - x0) + n + 2 * halo, ch = (y1 - y0) + 2 * halo;
+                const int ax = pad_left + x0 - n - halo;
+                m.setMinDisparity(0);
+                m.setNumDisparities(n);
+                m.compute(pad_l(Rect(ax, y0, cw, ch)), pad_r(Rect(ax - dlo, y0, cw, ch)), td);
+                work[i] += (double)(x1 - x0) * (y1 - y0) * n;
+
+                const int base = dlo * StereoMatcher::DISP_SCALE;
+                for(int y = y0; y < y1; y++)
+                {
+                    const short* src = td.ptr<short>(y - y0 + halo) + n + halo;
+                    short* dst = disp.ptr<short>(y);
+                    for(int x = x0; x < x1; x++)
+                    {
+                        int v = src[x - x0];
+                        // 裁剪区的匹配器minDisparity为0，负值即无效；对应点落在右图之外（填充区）的同样无效
+                        int xr16 = x * StereoMatcher::DISP_SCALE - (v + base);
+                        dst[x] = (v < 0 || xr16 < 0 || xr16 > (width - 1) * StereoMatcher::DISP_SCALE) ?
+                                 invalid : (short)(v + base);
+                    }
+                }
+            }
+        }
+    }, nm);
+
+    double total = 0.0;
+    for(int i = 0; i < nm; i++)
+        total += work[i];
+    return total;
+}
+
+PyramidMatcher::PyramidMatcher()
+    : levels(1), radius(4), min_disp(0), num_disp(16), search_fraction(1.0)
+{
+}
+
+void PyramidMatcher::init(const Ptr<StereoMatcher>& _proto, int _levels, int threads, int _tile, int _radius)
+{
+    CV_Assert(!_proto.empty() && _tile >= 16 && _radius >= 0);
+    proto = _proto;
+    levels = std::max(_levels, 1);
+    radius = _radius;
+    min_disp = proto->getMinDisparity();
+    num_disp = proto->getNumDisparities();
+    if(levels > 1)
+    {
+        coarse = cloneMatcher(proto);
+        tiles.init(proto, threads, _tile);
+    }
+}
+
+void PyramidMatcher::compute(const Mat& left, const Mat& right, Mat& disp)
+{
+    if(levels <= 1)
+    {
+        proto->compute(left, right, disp);
+        search_fraction = 1.0;
+        return;
+    }
+
+    pyr_l.resize(levels);
+    pyr_r.resize(levels);
+    pyr_disp.resize(levels);
+    pyr_l[0] = left;
+    pyr_r[0] = right;
+    for(int l = 1; l < levels; l++)
+    {
+        pyrDown(pyr_l[l-1], pyr_l[l]);
+        pyrDown(pyr_r[l-1], pyr_r[l]);
+    }
+
+    // 最粗一层：完整范围
+    const int top = levels - 1;
+    int lmin, lnum;
+    levelRange(min_disp, num_disp, top, lmin, lnum);
+    coarse->setMinDisparity(lmin);
+    coarse->setNumDisparities(lnum);
+    coarse->compute(pyr_l[top], pyr_r[top], pyr_disp[top]);
+
+    for(int l = top - 1; l >= 0; l--)
+        matchLevel(pyr_l[l], pyr_r[l], pyr_disp[l+1], l, l == 0 ? disp : pyr_disp[l]);
+}
+
+void PyramidMatcher::matchLevel(const Mat& left, const Mat& right, const Mat& coarse, int level, Mat& disp)
+{
+    int lmin, lnum, pmin, pnum;
+    levelRange(min_disp, num_disp, level, lmin, lnum);
+    levelRange(min_disp, num_disp, level + 1, pmin, pnum);
+    const int coarse_invalid = (pmin - 1) * StereoMatcher::DISP_SCALE;
+
+    double work = tiles.compute(left, right, lmin, lnum, [&](const Rect& t, int& dlo, int& dhi) -> bool
+    {
+        // 上一层对应区域的有效视差范围
+        int vmin = INT_MAX, vmax = INT_MIN;
+        const int cy1 = std::min(coarse.rows, (t.y + t.height + 1) / 2), cx1 = std::min(coarse.cols, (t.x + t.width + 1) / 2);
+        for(int cy = t.y / 2; cy < cy1; cy++)
+        {
+            const short* c = coarse.ptr<short>(cy);
+            for(int cx = t.x / 2; cx < cx1; cx++)
+                if(c[cx] > coarse_invalid)
+                {
+                    vmin = std::min(vmin, (int)c[cx]);
+                    vmax = std::max(vmax, (int)c[cx]);
+                }
+        }
+        if(vmin <= vmax)
+        {
+            // 放大2倍后的定点视差(x16)换算为整数视差
+            dlo = floorDiv(2 * vmin, StereoMatcher::DISP_SCALE) - radius;
+            dhi = -floorDiv(-2 * vmax, StereoMatcher::DISP_SCALE) + radius;
+        }
+        return true;
+    }, disp);
+
+    if(level == 0)
+        search_fraction = work / ((double)left.cols * left.rows * lnum);
+}
+
+void PyramidMatcher::computeRight(const Mat& left, const Mat& right, Mat& disp_right)
+{
+    // 右图像素xr在左图中的对应点为xr+d；翻转后变为普通的左视差问题
+    flip(left, flip_l, 1);
+    flip(right, flip_r, 1);
+    compute(flip_r, flip_l, flip_disp);
+    flip(flip_disp, disp_right, 1);
+
+    const short invalid = (short)((min_disp - 1) * StereoMatcher::DISP_SCALE);
+    const short invalid_right = (short)(-(min_disp + num_disp) * StereoMatcher::DISP_SCALE);
+    for(int y = 0; y < disp_right.rows; y++)
+    {
+        short* d = disp_right.ptr<short>(y);
+        for(int x = 0; x < disp_right.cols; x++)
+            d[x] = d[x] <= invalid ? invalid_right : (short)-d[x];
+    }
+}
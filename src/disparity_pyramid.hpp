@@ -0,0 +1,84 @@
+#ifndef DISPARITY_PYRAMID_HPP
+#define DISPARITY_PYRAMID_HPP
+
+#include "opencv2/calib3d.hpp"
+#include <functional>
+#include <vector>
+
+// 复制StereoBM/StereoSGBM/StereoCensusSGM的全部参数，得到一个可以在其他线程上独立运行的实例。
+// 不支持的匹配器类型返回空指针。
+cv::Ptr<cv::StereoMatcher> cloneMatcher(const cv::Ptr<cv::StereoMatcher>& src);
+
+// 每块的视差搜索范围：rect为块在图像中的位置，dlo/dhi为整数视差的闭区间，调用前已设为该层的完整范围。
+// 返回false时跳过该块，输出中对应区域保持调用前的内容。会在多个线程上同时调用
+typedef std::function<bool(const cv::Rect& rect, int& dlo, int& dhi)> TileRangeFn;
+
+// 按块限定视差范围的匹配：图像切成tile x tile的块，每块只在自己的范围内搜索（宽度向上对齐到16），
+// 用minDisparity为0的匹配器在平移后的裁剪图像上计算。块之间并行，每组块一个匹配器实例。
+// PyramidMatcher的每一层和TemporalMatcher都基于它
+class TileRangeMatcher
+{
+public:
+    TileRangeMatcher();
+
+    // threads为匹配器实例数（0表示cv::getNumThreads()）
+    void init(const cv::Ptr<cv::StereoMatcher>& proto, int threads = 0, int tile = 64);
+    bool empty() const { return matchers.empty(); }
+
+    // [lmin, lmin+lnum)为完整范围；输出CV_16S定点视差，无效像素为(lmin-1)*16。
+    // disp已经是同尺寸的CV_16S时不重新分配，被跳过的块保留原值。
+    // 返回实际搜索的代价体大小（像素数x视差数）
+    double compute(const cv::Mat& left, const cv::Mat& right, int lmin, int lnum, const TileRangeFn& range, cv::Mat& disp);
+
+private:
+    cv::Ptr<cv::StereoMatcher> proto;
+    std::vector<cv::Ptr<cv::StereoMatcher> > matchers;
+    int tile;
+
+    // 以下缓冲区在多次compute之间复用
+    cv::Mat pad_l, pad_r;
+    std::vector<cv::Mat> tile_disp;
+};
+
+// 由粗到细的金字塔匹配。
+// 最粗一层用完整（按比例缩小的）视差范围匹配；之后每一层把上一层的视差放大2倍，
+// 按块统计其范围，只在该范围附近（±radius）搜索，块内用minDisparity偏移后的裁剪图像匹配。
+// 这样最精细一层每个像素只需搜索很少的视差，代价体的规模不再与numDisparities成正比。
+// 输出与原型匹配器相同的CV_16S定点视差，无效像素为(minDisparity-1)*16。
+class PyramidMatcher
+{
+public:
+    PyramidMatcher();
+
+    // proto给出全分辨率下的视差范围和匹配参数；levels<=1时退化为直接调用proto。
+    // threads为并行处理块的匹配器实例数（0表示cv::getNumThreads()）
+    void init(const cv::Ptr<cv::StereoMatcher>& proto, int levels, int threads = 0, int tile = 64, int radius = 4);
+
+    // 左视差：compute(left, right)
+    void compute(const cv::Mat& left, const cv::Mat& right, cv::Mat& disp);
+
+    // 右视差，约定与createRightMatcher相同（负视差）。把两幅图水平翻转后复用左视差的匹配流程，
+    // 因此对任何匹配器（包括没有右匹配器的census）都适用。
+    void computeRight(const cv::Mat& left, const cv::Mat& right, cv::Mat& disp_right);
+
+    // 上一次compute在最精细一层实际搜索的代价体占完整代价体(W*H*numDisparities)的比例
+    double getSearchFraction() const { return search_fraction; }
+
+    int getLevels() const { return levels; }
+
+private:
+    void matchLevel(const cv::Mat& left, const cv::Mat& right, const cv::Mat& coarse, int level, cv::Mat& disp);
+
+    cv::Ptr<cv::StereoMatcher> proto;
+    cv::Ptr<cv::StereoMatcher> coarse; // 最粗一层，完整范围
+    TileRangeMatcher tiles;
+    int levels, radius;
+    int min_disp, num_disp;
+    double search_fraction;
+
+    // 以下缓冲区在多次compute之间复用
+    std::vector<cv::Mat> pyr_l, pyr_r, pyr_disp;
+    cv::Mat flip_l, flip_r, flip_disp;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include "disparity_range.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/features2d.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+static void prepareView(const Mat& src, double scale, Mat& dst)
+{
+    if(src.channels() == 3)
+        cvtColor(src, dst, COLOR_BGR2GRAY);
+    else
+        dst = src;
+    if(scale < 1.0)
+        resize(dst, dst, Size(), scale, scale, INTER_AREA);
+}
+
+bool estimateDisparityRange(const Mat& left, const Mat& right, const DisparityRangeOptions& opts,
+                            DisparityRangeResult& result)
+{
+    CV_Assert(left.size() == right.size() && left.depth() == CV_8U);
+    int64 start = getTickCount();
+    result.min_disp = 0;
+    result.num_disp = 16;
+    result.lo = result.hi = 0.0;
+    result.matches = result.inliers = 0;
+
+    const double scale = std::min(1.0, (double)opts.max_width / left.cols);
+    Mat gl, gr;
+    prepareView(left, scale, gl);
+    prepareView(right, scale, gr);
+
+    Ptr<ORB> orb = ORB::create(opts.features);
+    vector<KeyPoint> kl, kr;
+    Mat dl, dr;
+    orb->detectAndCompute(gl, noArray(), kl, dl);
+    orb->detectAndCompute(gr, noArray(), kr, dr);
+
+    vector<DMatch> matches;
+    if(!dl.empty() && !dr.empty())
+        BFMatcher(NORM_HAMMING, true).match(dl, dr, matches);
+    result.matches = (int)matches.size();
+
+    // 校正后同名点在同一行；视差换算回原图像素
+    vector<double> disp;
+    const double max_dy = std::max(opts.max_dy * scale, 1.0);
+    for(size_t i = 0; i < matches.size(); i++)
+    {
+        const Point2f& pl = kl[matches[i].queryIdx].pt;
+        const Point2f& pr = kr[matches[i].trainIdx].pt;
+        if(std::abs(pl.y - pr.y) <= max_dy)
+            disp.push_back((pl.x - pr.x) / scale);
+    }
+    result.inliers = (int)disp.size();
+    result.ms = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    if(result.inliers < std::max(opts.min_matches, 1))
+        return false;
+
+    std::sort(disp.begin(), disp.end());
+    const size_t cut = (size_t)(opts.trim * disp.size());
+    result.lo = disp[cut];
+    result.hi = disp[disp.size() - 1 - cut];
+
+    // 余量再加上缩小带来的量化误差
+    const double margin = opts.margin + 1.0 / scale;
+    const int lo = (int)floor(result.lo - margin);
+    const int hi = (int)ceil(result.hi + margin);
+    result.min_disp = lo;
+    result.num_disp = std::max(16, (hi - lo + 1 + 15) & ~15);
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef DISPARITY_RANGE_HPP
+#define DISPARITY_RANGE_HPP
+
+#include "opencv2/core.hpp"
+
+// 由稀疏特征匹配估计视差范围：在缩小的灰度图上提取ORB特征，交叉验证的汉明距离匹配中
+// 只保留满足极线约束（行差很小）的点对，取其视差的两端分位数，再加余量。
+// 结果换算为minDisparity和对齐到16的numDisparities，用于代替按最坏情况猜测的固定范围。
+struct DisparityRangeOptions
+{
+    int max_width;      // 估计时图像缩小到的最大宽度
+    int features;       // ORB特征点数
+    double max_dy;      // 同名点允许的行差（原图像素），图像应已校正
+    double trim;        // 两端各舍弃的匹配比例（排除误匹配）
+    double margin;      // 范围两侧各加的余量（原图像素）
+    int min_matches;    // 可用匹配少于此数时认为估计失败
+
+    DisparityRangeOptions()
+        : max_width(640), features(2000), max_dy(2.0), trim(0.02), margin(8.0), min_matches(20) {}
+};
+
+struct DisparityRangeResult
+{
+    int min_disp;       // minDisparity
+    int num_disp;       // numDisparities，16的倍数
+    double lo, hi;      // 舍弃两端之后的视差范围（原图像素，不含余量）
+    int matches;        // 交叉验证后的匹配数
+    int inliers;        // 满足极线约束的匹配数
+    double ms;          // 估计耗时
+};
+
+// left/right为同尺寸的校正后视图（8位灰度或BGR）。匹配不足时返回false，result中的计数仍然有效
+bool estimateDisparityRange(const cv::Mat& left, const cv::Mat& right, const DisparityRangeOptions& opts,
+                            DisparityRangeResult& result);
+
+#endif
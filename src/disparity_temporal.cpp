@@ -0,0 +1,168 @@
+#include "disparity_temporal.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdlib>
+
+using namespace cv;
+using namespace std;
+
+// a与b在rect内的平均绝对差（所有通道）
+static double meanAbsDiff(const Mat& a, const Mat& b, const Rect& rect)
+{
+    const int cn = a.channels();
+    double sum = 0.0;
+    for(int y = rect.y; y < rect.y + rect.height; y++)
+    {
+        const uchar* pa = a.ptr<uchar>(y) + rect.x * cn;
+        const uchar* pb = b.ptr<uchar>(y) + rect.x * cn;
+        int s = 0;
+        for(int x = 0; x < rect.width * cn; x++)
+            s += std::abs(pa[x] - pb[x]);
+        sum += s;
+    }
+    return rect.area() > 0 ? sum / ((double)rect.area() * cn) : 0.0;
+}
+
+TemporalMatcher::TemporalMatcher()
+    : min_disp(0), num_disp(16), radius(2), static_thresh(3.0), diff_thresh(8.0), keyframe_interval(30), frames(0),
+      search_fraction(1.0), reused_fraction(0.0), fallback_fraction(1.0)
+{
+}
+
+void TemporalMatcher::init(const Ptr<StereoMatcher>& proto, int threads, int tile, int _radius,
+                           double _static_thresh, double _diff_thresh, int _keyframe_interval)
+{
+    CV_Assert(!proto.empty() && _radius >= 0);
+    tiles.init(proto, threads, tile);
+    full = cloneMatcher(proto);
+    min_disp = proto->getMinDisparity();
+    num_disp = proto->getNumDisparities();
+    radius = _radius;
+    static_thresh = _static_thresh;
+    diff_thresh = _diff_thresh;
+    keyframe_interval = std::max(_keyframe_interval, 0);
+    reset();
+}
+
+void TemporalMatcher::reset()
+{
+    frames = 0;
+    prev_ref.release();
+    prev_other.release();
+    prev_disp.release();
+}
+
+void TemporalMatcher::compute(const Mat& left, const Mat& right, const Mat& prior, const Mat& mask, Mat& disp)
+{
+    CV_Assert(!tiles.empty() && left.depth() == CV_8U && left.type() == right.type() && left.size() == right.size());
+    CV_Assert(prior.empty() || (prior.type() == CV_16SC1 && prior.size() == left.size()));
+    CV_Assert(mask.empty() || (mask.type() == CV_8UC1 && mask.size() == left.size()));
+
+    const bool keyframe = frames == 0 || (keyframe_interval > 0 && frames % keyframe_interval == 0);
+    const bool predict = !keyframe && prev_ref.size() == left.size() && prev_ref.type() == left.type() &&
+                         prev_disp.size() == left.size();
+    const int invalid = (min_disp - 1) * StereoMatcher::DISP_SCALE;
+    const int max_disp = min_disp + num_disp - 1;
+    atomic<int> reused(0), fallback(0), total(0);
+
+    if(!predict)
+    {
+        // 整帧完整匹配不分块，省去块四周重叠区的重复计算
+        full->compute(left, right, disp);
+        search_fraction = 1.0;
+        reused_fraction = 0.0;
+        fallback_fraction = 1.0;
+        left.copyTo(prev_ref);
+        right.copyTo(prev_other);
+        disp.copyTo(prev_disp);
+        frames++;
+        return;
+    }
+
+    // 被跳过的块保留上一帧的视差
+    prev_disp.copyTo(disp);
+
+    double work = tiles.compute(left, right, min_disp, num_disp, [&](const Rect& t, int& dlo, int& dhi) -> bool
+    {
+        total++;
+        // 另一视图中块内像素可能的对应点：[x0 - maxDisparity, x1 - minDisparity)
+        const int ox0 = std::max(0, t.x - max_disp), ox1 = std::min(left.cols, t.x + t.width - min_disp);
+        const Rect other(ox0, t.y, std::max(ox1 - ox0, 0), t.height);
+        const double diff = std::max(meanAbsDiff(left, prev_ref, t), meanAbsDiff(right, prev_other, other));
+        if(diff < static_thresh)
+        {
+            reused++;
+            return false;
+        }
+        if(diff > diff_thresh || prior.empty())
+        {
+            fallback++;
+            return true;
+        }
+
+        int vmin = INT_MAX, vmax = INT_MIN, n = 0;
+        for(int y = t.y; y < t.y + t.height; y++)
+        {
+            const short* p = prior.ptr<short>(y);
+            const uchar* m = mask.empty() ? 0 : mask.ptr<uchar>(y);
+            for(int x = t.x; x < t.x + t.width; x++)
+                if(p[x] > invalid && (!m || m[x]))
+                {
+                    vmin = std::min(vmin, (int)p[x]);
+                    vmax = std::max(vmax, (int)p[x]);
+                    n++;
+                }
+        }
+        if(2 * n < t.area())
+        {
+            fallback++;
+            return true;
+        }
+        dlo = (int)floor((double)vmin / StereoMatcher::DISP_SCALE) - radius;
+        dhi = (int)ceil((double)vmax / StereoMatcher::DISP_SCALE) + radius;
+        return true;
+    }, disp);
+
+    search_fraction = work / ((double)left.cols * left.rows * num_disp);
+    reused_fraction = total > 0 ? (double)reused / total : 0.0;
+    fallback_fraction = total > 0 ? (double)fallback / total : 1.0;
+    left.copyTo(prev_ref);
+    right.copyTo(prev_other);
+    disp.copyTo(prev_disp);
+    frames++;
+}
+
+void TemporalMatcher::computeRight(const Mat& left, const Mat& right, const Mat& prior_right, Mat& disp_right)
+{
+    const short invalid = (short)((min_disp - 1) * StereoMatcher::DISP_SCALE);
+    const short invalid_right = (short)(-(min_disp + num_disp) * StereoMatcher::DISP_SCALE);
+
+    // 右视差翻转并取反后就是翻转图像上的左视差
+    flip(left, flip_l, 1);
+    flip(right, flip_r, 1);
+    if(!prior_right.empty())
+    {
+        flip(prior_right, flip_prior, 1);
+        for(int y = 0; y < flip_prior.rows; y++)
+        {
+            short* d = flip_prior.ptr<short>(y);
+            for(int x = 0; x < flip_prior.cols; x++)
+                d[x] = d[x] <= invalid_right ? invalid : (short)-d[x];
+        }
+    }
+    else
+    {
+        flip_prior.release();
+    }
+    compute(flip_r, flip_l, flip_prior, Mat(), flip_disp);
+    flip(flip_disp, disp_right, 1);
+
+    for(int y = 0; y < disp_right.rows; y++)
+    {
+        short* d = disp_right.ptr<short>(y);
+        for(int x = 0; x < disp_right.cols; x++)
+            d[x] = d[x] <= invalid ? invalid_right : (short)-d[x];
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef DISPARITY_TEMPORAL_HPP
+#define DISPARITY_TEMPORAL_HPP
+
+#include "opencv2/calib3d.hpp"
+#include "disparity_pyramid.hpp"
+
+// 时域复用的匹配，用于固定机位、场景大部分静止的视频流。按块与上一帧比较两幅视图
+// （参考视图取块本身，另一视图取块向左延伸numDisparities的区域，即块内像素所有可能的对应点）：
+//   平均绝对差 < static_thresh：块没有变化，直接沿用上一帧的视差，不匹配；
+//   平均绝对差 > diff_thresh、或块内可信的预测像素少于一半：完整范围匹配；
+//   其余：只在上一帧视差的范围附近（±radius）匹配。
+// 没有上一帧或到了关键帧时整帧完整匹配。静止场景下大多数块被跳过，匹配耗时约与变化的面积成正比。
+class TemporalMatcher
+{
+public:
+    TemporalMatcher();
+
+    // proto给出完整视差范围和匹配参数；keyframe_interval帧强制整帧完整匹配一次（0表示从不）
+    void init(const cv::Ptr<cv::StereoMatcher>& proto, int threads = 0, int tile = 64, int radius = 2,
+              double static_thresh = 3.0, double diff_thresh = 8.0, int keyframe_interval = 30);
+    bool empty() const { return tiles.empty(); }
+
+    // 左视差：compute(left, right)。prior为上一帧参考视图的视差（x16定点，与left同尺寸，例如滤波后的结果），
+    // 用于预测搜索范围，为空时不缩小范围；mask可选（CV_8U，非0表示prior可信）
+    void compute(const cv::Mat& left, const cv::Mat& right, const cv::Mat& prior, const cv::Mat& mask, cv::Mat& disp);
+
+    // 右视差，约定与createRightMatcher相同（负视差）；prior_right为上一帧的右视差，同样约定。
+    // 与PyramidMatcher::computeRight一样翻转后按左视差处理，一个实例只能用于左视差或右视差之一
+    void computeRight(const cv::Mat& left, const cv::Mat& right, const cv::Mat& prior_right, cv::Mat& disp_right);
+
+    // 丢弃上一帧，下一次compute整帧完整匹配
+    void reset();
+
+    // 上一次compute实际搜索的代价体占完整代价体的比例，以及沿用上一帧、完整范围匹配的块的比例
+    double getSearchFraction() const { return search_fraction; }
+    double getReusedFraction() const { return reused_fraction; }
+    double getFallbackFraction() const { return fallback_fraction; }
+
+private:
+    TileRangeMatcher tiles;
+    cv::Ptr<cv::StereoMatcher> full; // 整帧完整匹配（关键帧）
+    int min_disp, num_disp;
+    int radius;
+    double static_thresh, diff_thresh;
+    int keyframe_interval, frames;
+    double search_fraction, reused_fraction, fallback_fraction;
+
+    cv::Mat prev_ref, prev_other, prev_disp;
+    cv::Mat flip_l, flip_r, flip_prior, flip_disp;
+};
+
+#endif
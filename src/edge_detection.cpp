@@ -1,6 +1,8 @@
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/highgui.hpp"
 #include "opencv2/imgproc.hpp"
+#include "fused_gradient.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <string>
 #include <algorithm>
@@ -12,15 +14,33 @@ static void showHelp() {
     cout << "Usage:\n"
             "  edge_detection [image] [method] [out] [params...]\n\n"
             "Methods and params (all optional with defaults):\n"
-            "  sobel [ksize=3 dx=1 dy=1 scale=1.0 delta=0.0]\n"
-            "  scharr [dx=1 dy=0]\n"
+            "  sobel [ksize=3 dx=1 dy=1 scale=1.0 delta=0.0 norm=mean]\n"
+            "  scharr [dx=1 dy=1 norm=mean]\n"
             "  laplacian [ksize=3 scale=1.0 delta=0.0]\n"
-            "  canny [threshold1=100 threshold2=200 apertureSize=3 L2gradient=0]\n\n"
+            "  canny [threshold1=100 threshold2=200 apertureSize=3 L2gradient=0]\n"
+            "  gradients [operator=sobel norm=mean threshold1=100 threshold2=200 L2gradient=0]\n"
+            "    one gradient pass shared by magnitude (out), orientation (out_orientation.png)\n"
+            "    and Canny (out_canny.png)\n\n"
+            "norm: mean ((|dx|+|dy|)/2, the default output), l1 or l2. sobel with ksize=3 dx=1 dy=1\n"
+            "scale=1 delta=0, and scharr with dx=1 dy=1, use the fused single-pass kernel (norm\n"
+            "only applies there; other settings keep the two-pass mean).\n\n"
             "Examples:\n"
             "  ./edge_detection ../l.jpg sobel edges.png 3 1 1 1.0 0.0\n"
             "  ./edge_detection ../l.jpg scharr edges.png 1 0\n"
             "  ./edge_detection ../l.jpg laplacian edges.png 3 1.0 0.0\n"
-            "  ./edge_detection ../l.jpg canny edges.png 50 150 3 1\n";
+            "  ./edge_detection ../l.jpg canny edges.png 50 150 3 1\n"
+            "  ./edge_detection ../l.jpg gradients edges.png scharr l2 50 150 1\n\n"
+            "--trace=<file.json> anywhere on the command line writes a per-stage Chrome trace-event JSON\n"
+            "and prints a time/allocation/RSS summary.\n";
+}
+
+static bool parseNorm(const string& s, GradientMagnitude& norm)
+{
+    if (s == "mean") norm = GRADIENT_MAG_MEAN;
+    else if (s == "l1") norm = GRADIENT_MAG_L1;
+    else if (s == "l2") norm = GRADIENT_MAG_L2;
+    else return false;
+    return true;
 }
 
 int main(int argc, char** argv)
@@ -29,21 +49,29 @@ int main(int argc, char** argv)
     string method  = "sobel"; // default
     string outPath = "../edges.png";
 
+    // --trace=<file>不占位置参数
+    TraceSession trace(takeTraceArg(argc, argv));
+
     if (argc >= 2) method  = argv[1];
     if (argc >= 3) inPath  = argv[2];
     if (argc >= 4) outPath = argv[3];
 
+    TraceScope decode_scope("decode");
     Mat src = imread(inPath, IMREAD_COLOR);
+    decode_scope.end();
     if (src.empty()) {
         cerr << "Cannot read image: " << inPath << endl;
         showHelp();
         return -1;
     }
 
+    TraceScope convert_scope("color_convert");
     Mat gray;
     cvtColor(src, gray, COLOR_BGR2GRAY);
+    convert_scope.end();
 
     Mat edges;
+    TraceScope edges_scope("edges");
 
     if (method == "sobel") {
         int ksize = (argc >= 5) ? atoi(argv[4]) : 3; // 1,3,5,7
@@ -53,24 +81,45 @@ int main(int argc, char** argv)
         double delta = (argc >= 9) ? atof(argv[8]) : 0.0;
         if (ksize % 2 == 0) ksize += 1;
         if (ksize <= 0) ksize = 3;
+        GradientMagnitude norm = GRADIENT_MAG_MEAN;
+        if (argc >= 10 && !parseNorm(argv[9], norm)) {
+            cerr << "Unknown norm: " << argv[9] << endl;
+            showHelp();
+            return -1;
+        }
 
-        Mat grad_x, grad_y, abs_x, abs_y;
-        Sobel(gray, grad_x, CV_16S, dx, 0, ksize, scale, delta);
-        Sobel(gray, grad_y, CV_16S, 0, dy, ksize, scale, delta);
-        convertScaleAbs(grad_x, abs_x);
-        convertScaleAbs(grad_y, abs_y);
-        addWeighted(abs_x, 0.5, abs_y, 0.5, 0, edges);
+        if (ksize == 3 && dx == 1 && dy == 1 && scale == 1.0 && delta == 0.0) {
+            // 单遍融合内核：dx、dy和幅值一次算出，不生成中间图像
+            fusedGradient(gray, GRADIENT_SOBEL, norm, edges);
+        } else {
+            Mat grad_x, grad_y, abs_x, abs_y;
+            Sobel(gray, grad_x, CV_16S, dx, 0, ksize, scale, delta);
+            Sobel(gray, grad_y, CV_16S, 0, dy, ksize, scale, delta);
+            convertScaleAbs(grad_x, abs_x);
+            convertScaleAbs(grad_y, abs_y);
+            addWeighted(abs_x, 0.5, abs_y, 0.5, 0, edges);
+        }
     }
     else if (method == "scharr") {
         int dx = (argc >= 5) ? atoi(argv[4]) : 1; 
         int dy = (argc >= 6) ? atoi(argv[5]) : 1; 
-        
-        Mat grad_x, grad_y, abs_x, abs_y;
-        Scharr(gray, grad_x, CV_16S, dx, 0);
-        Scharr(gray, grad_y, CV_16S, 0, dy);
-        convertScaleAbs(grad_x, abs_x);
-        convertScaleAbs(grad_y, abs_y);
-        addWeighted(abs_x, 0.5, abs_y, 0.5, 0, edges);
+        GradientMagnitude norm = GRADIENT_MAG_MEAN;
+        if (argc >= 7 && !parseNorm(argv[6], norm)) {
+            cerr << "Unknown norm: " << argv[6] << endl;
+            showHelp();
+            return -1;
+        }
+
+        if (dx == 1 && dy == 1) {
+            fusedGradient(gray, GRADIENT_SCHARR, norm, edges);
+        } else {
+            Mat grad_x, grad_y, abs_x, abs_y;
+            Scharr(gray, grad_x, CV_16S, dx, 0);
+            Scharr(gray, grad_y, CV_16S, 0, dy);
+            convertScaleAbs(grad_x, abs_x);
+            convertScaleAbs(grad_y, abs_y);
+            addWeighted(abs_x, 0.5, abs_y, 0.5, 0, edges);
+        }
     }
     else if (method == "laplacian") {
         int ksize   = (argc >= 5) ? atoi(argv[4]) : 5; 
@@ -88,7 +137,38 @@ int main(int argc, char** argv)
         double th2 = (argc >= 6) ? atof(argv[5]) : 200.0;
         int aperture = (argc >= 7) ? atoi(argv[6]) : 5; 
         bool L2 = (argc >= 8) ? (atoi(argv[7]) != 0) : false;
-        Canny(blur, edges, th1, th2, aperture, L2);
+        Canny(gray, edges, th1, th2, aperture, L2);
+    }
+    else if (method == "gradients") {
+        // 多输出：一次梯度计算，幅值、方向和Canny共用同一份dx/dy
+        string opName = (argc >= 5) ? argv[4] : "sobel";
+        GradientMagnitude norm = GRADIENT_MAG_MEAN;
+        if ((opName != "sobel" && opName != "scharr") || (argc >= 6 && !parseNorm(argv[5], norm))) {
+            cerr << "Unknown operator or norm" << endl;
+            showHelp();
+            return -1;
+        }
+        double th1 = (argc >= 7) ? atof(argv[6]) : 100.0;
+        double th2 = (argc >= 8) ? atof(argv[7]) : 200.0;
+        bool L2 = (argc >= 9) ? (atoi(argv[8]) != 0) : false;
+
+        Mat dx, dy, orientation, canny;
+        fusedGradient(gray, opName == "scharr" ? GRADIENT_SCHARR : GRADIENT_SOBEL, norm, edges, &dx, &dy, &orientation);
+        Canny(dx, dy, canny, th1, th2, L2);
+
+        // 方向0~360度映射到0~255保存
+        edges_scope.end();
+        TraceScope encode_scope("encode");
+        Mat orientation8u;
+        orientation.convertTo(orientation8u, CV_8U, 255.0 / 360.0);
+        // 只去掉最后一个路径分隔符之后的扩展名，"../edges"这样没有扩展名的路径保持不变
+        string base = outPath;
+        size_t dot = base.find_last_of('.'), slash = base.find_last_of("/\\");
+        if (dot != string::npos && (slash == string::npos || dot > slash))
+            base.erase(dot);
+        imwrite(base + "_orientation.png", orientation8u);
+        imwrite(base + "_canny.png", canny);
+        cout << "Gradient kernel: " << fusedGradientKernelName() << endl;
     }
     else {
         cerr << "Unknown method: " << method << endl;
@@ -96,7 +176,12 @@ int main(int argc, char** argv)
         return -1;
     }
 
-    imwrite(outPath, edges);
+    edges_scope.end();
+    {
+        TraceScope encode_scope("encode");
+        imwrite(outPath, edges);
+    }
+    trace.finish();
 
     imshow("Edges - " + method, edges);
     waitKey(0);
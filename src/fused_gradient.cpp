@@ -0,0 +1,213 @@
+#include "fused_gradient.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <emmintrin.h>
+#define GRADIENT_X86 1
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <emmintrin.h>
+#define GRADIENT_X86 1
+#else
+#define GRADIENT_X86 0
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace
+{
+
+// 一行的计算：r0/r1/r2为上、中、下三行（已按边界规则选好），vs/vd为该行的垂直平滑/垂直差分缓冲区，
+// 两端各留一个元素用于水平方向的边界。a、b为平滑核[a b a]的系数
+typedef void (*GradientRowFn)(const uchar* r0, const uchar* r1, const uchar* r2, int width, int a, int b,
+                              short* vs, short* vd, short* gx, short* gy, uchar* mag, int norm);
+
+static inline uchar magnitudeScalar(int gx, int gy, int norm)
+{
+    const int ax = std::abs(gx), ay = std::abs(gy);
+    if(norm == GRADIENT_MAG_MEAN)
+    {
+        // addWeighted在8U上按浮点计算后四舍六入五成双，这里用整数复现
+        const int s = std::min(ax, 255) + std::min(ay, 255);
+        return (uchar)((s + ((s >> 1) & 1)) >> 1);
+    }
+    if(norm == GRADIENT_MAG_L1)
+        return saturate_cast<uchar>(ax + ay);
+    return saturate_cast<uchar>(cvRound(std::sqrt((float)(gx * gx + gy * gy))));
+}
+
+// 把vs/vd两端按BORDER_REFLECT_101补上
+static inline void padRow(short* v, int width)
+{
+    v[-1] = v[width > 1 ? 1 : 0];
+    v[width] = v[width > 1 ? width - 2 : 0];
+}
+
+static void gradientRowScalar(const uchar* r0, const uchar* r1, const uchar* r2, int width, int a, int b,
+                              short* vs, short* vd, short* gx, short* gy, uchar* mag, int norm)
+{
+    for(int x = 0; x < width; x++)
+    {
+        vs[x] = (short)(a * (r0[x] + r2[x]) + b * r1[x]);
+        vd[x] = (short)(r2[x] - r0[x]);
+    }
+    padRow(vs, width);
+    padRow(vd, width);
+    for(int x = 0; x < width; x++)
+    {
+        const int dx = vs[x+1] - vs[x-1];
+        const int dy = a * (vd[x-1] + vd[x+1]) + b * vd[x];
+        gx[x] = (short)dx;
+        gy[x] = (short)dy;
+        mag[x] = magnitudeScalar(dx, dy, norm);
+    }
+}
+
+#if GRADIENT_X86
+static inline __m128i abs16(__m128i v)
+{
+    return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+static void gradientRowSSE2(const uchar* r0, const uchar* r1, const uchar* r2, int width, int a, int b,
+                            short* vs, short* vd, short* gx, short* gy, uchar* mag, int norm)
+{
+    const __m128i z = _mm_setzero_si128();
+    const __m128i va = _mm_set1_epi16((short)a), vb = _mm_set1_epi16((short)b);
+
+    // 垂直方向：每次8个像素，8U扩展到16位后相乘（Scharr最大16*255，不会溢出）
+    int x = 0;
+    for(; x <= width - 8; x += 8)
+    {
+        const __m128i p0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r0 + x)), z);
+        const __m128i p1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r1 + x)), z);
+        const __m128i p2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(r2 + x)), z);
+        const __m128i s = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(p0, p2), va), _mm_mullo_epi16(p1, vb));
+        _mm_storeu_si128((__m128i*)(vs + x), s);
+        _mm_storeu_si128((__m128i*)(vd + x), _mm_sub_epi16(p2, p0));
+    }
+    for(; x < width; x++)
+    {
+        vs[x] = (short)(a * (r0[x] + r2[x]) + b * r1[x]);
+        vd[x] = (short)(r2[x] - r0[x]);
+    }
+    padRow(vs, width);
+    padRow(vd, width);
+
+    // 水平方向和幅值
+    const __m128i c255 = _mm_set1_epi16(255), one = _mm_set1_epi16(1);
+    for(x = 0; x <= width - 8; x += 8)
+    {
+        const __m128i sl = _mm_loadu_si128((const __m128i*)(vs + x - 1));
+        const __m128i sr = _mm_loadu_si128((const __m128i*)(vs + x + 1));
+        const __m128i dl = _mm_loadu_si128((const __m128i*)(vd + x - 1));
+        const __m128i dc = _mm_loadu_si128((const __m128i*)(vd + x));
+        const __m128i dr = _mm_loadu_si128((const __m128i*)(vd + x + 1));
+        const __m128i dx = _mm_sub_epi16(sr, sl);
+        const __m128i dy = _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(dl, dr), va), _mm_mullo_epi16(dc, vb));
+        _mm_storeu_si128((__m128i*)(gx + x), dx);
+        _mm_storeu_si128((__m128i*)(gy + x), dy);
+
+        __m128i m;
+        if(norm == GRADIENT_MAG_MEAN)
+        {
+            const __m128i s = _mm_add_epi16(_mm_min_epi16(abs16(dx), c255), _mm_min_epi16(abs16(dy), c255));
+            m = _mm_srli_epi16(_mm_add_epi16(s, _mm_and_si128(_mm_srli_epi16(s, 1), one)), 1);
+        }
+        else if(norm == GRADIENT_MAG_L1)
+        {
+            m = _mm_add_epi16(abs16(dx), abs16(dy)); // packus饱和到255
+        }
+        else
+        {
+            // (gx, gy)交错后madd得到gx^2+gy^2（32位），开方后取整
+            const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(dx, dy), _mm_unpacklo_epi16(dx, dy));
+            const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(dx, dy), _mm_unpackhi_epi16(dx, dy));
+            const __m128i ml = _mm_cvtps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(lo)));
+            const __m128i mh = _mm_cvtps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(hi)));
+            m = _mm_packs_epi32(ml, mh);
+        }
+        _mm_storel_epi64((__m128i*)(mag + x), _mm_packus_epi16(m, m));
+    }
+    for(; x < width; x++)
+    {
+        const int dx = vs[x+1] - vs[x-1];
+        const int dy = a * (vd[x-1] + vd[x+1]) + b * vd[x];
+        gx[x] = (short)dx;
+        gy[x] = (short)dy;
+        mag[x] = magnitudeScalar(dx, dy, norm);
+    }
+}
+#endif
+
+static GradientRowFn selectRowKernel(const char** name)
+{
+#if GRADIENT_X86
+    if(useOptimized() && checkHardwareSupport(CV_CPU_SSE2))
+    {
+        if(name) *name = "sse2";
+        return gradientRowSSE2;
+    }
+#endif
+    if(name) *name = "scalar";
+    return gradientRowScalar;
+}
+
+// BORDER_REFLECT_101的行号
+static inline int reflectRow(int y, int rows)
+{
+    if(rows == 1) return 0;
+    return y < 0 ? -y : (y >= rows ? 2 * rows - 2 - y : y);
+}
+
+} // namespace
+
+const char* fusedGradientKernelName()
+{
+    const char* name = 0;
+    selectRowKernel(&name);
+    return name;
+}
+
+void fusedGradient(const Mat& gray, GradientOperator op, GradientMagnitude norm, Mat& magnitude,
+                   Mat* dx, Mat* dy, Mat* orientation)
+{
+    CV_Assert(gray.type() == CV_8UC1 && !gray.empty());
+    const int width = gray.cols, height = gray.rows;
+    const int a = op == GRADIENT_SCHARR ? 3 : 1;
+    const int b = op == GRADIENT_SCHARR ? 10 : 2;
+    const GradientRowFn row_fn = selectRowKernel(0);
+
+    magnitude.create(gray.size(), CV_8U);
+    if(dx) dx->create(gray.size(), CV_16S);
+    if(dy) dy->create(gray.size(), CV_16S);
+    if(orientation) orientation->create(gray.size(), CV_32F);
+
+    // 每个条带一组行缓冲区：vs/vd两端各多1个元素，不需要输出dx/dy时gx/gy也写到行缓冲区里
+    const int nstripes = std::max(1, std::min(height / 16, getNumThreads() * 4));
+    parallel_for_(Range(0, height), [&](const Range& r)
+    {
+        vector<short> buf((size_t)(width + 2) * 2 + (size_t)width * 2);
+        short* vs = &buf[1];
+        short* vd = &buf[width + 3];
+        short* gx_row = &buf[(size_t)(width + 2) * 2];
+        short* gy_row = gx_row + width;
+        for(int y = r.start; y < r.end; y++)
+        {
+            short* gx = dx ? dx->ptr<short>(y) : gx_row;
+            short* gy = dy ? dy->ptr<short>(y) : gy_row;
+            row_fn(gray.ptr<uchar>(reflectRow(y - 1, height)), gray.ptr<uchar>(y),
+                   gray.ptr<uchar>(reflectRow(y + 1, height)), width, a, b, vs, vd, gx, gy,
+                   magnitude.ptr<uchar>(y), norm);
+            if(orientation)
+            {
+                float* o = orientation->ptr<float>(y);
+                for(int x = 0; x < width; x++)
+                    o[x] = fastAtan2((float)gy[x], (float)gx[x]);
+            }
+        }
+    }, nstripes);
+}
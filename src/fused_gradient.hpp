@@ -0,0 +1,30 @@
+#ifndef DISPARITY_FUSED_GRADIENT_HPP
+#define DISPARITY_FUSED_GRADIENT_HPP
+
+#include "opencv2/core.hpp"
+
+enum GradientOperator
+{
+    GRADIENT_SOBEL,  // 3x3 Sobel：[1 2 1]平滑
+    GRADIENT_SCHARR  // 3x3 Scharr：[3 10 3]平滑
+};
+
+enum GradientMagnitude
+{
+    GRADIENT_MAG_MEAN, // (sat8(|gx|) + sat8(|gy|)) / 2，与convertScaleAbs+addWeighted(0.5, 0.5)逐像素一致
+    GRADIENT_MAG_L1,   // sat8(|gx| + |gy|)
+    GRADIENT_MAG_L2    // sat8(round(sqrt(gx^2 + gy^2)))
+};
+
+// 单遍融合的一阶梯度：按行流式处理8U灰度图，每行只在缓存内的行缓冲区上做垂直和水平两步可分离卷积，
+// 同时得到dx、dy和幅值，不生成整幅的中间图像。边界为BORDER_REFLECT_101，与cv::Sobel/cv::Scharr默认一致，
+// dx/dy与Sobel(gray, CV_16S, 1, 0, 3)/Sobel(gray, CV_16S, 0, 1, 3)（或Scharr）逐像素相同。
+// magnitude为CV_8U；dx、dy（CV_16S）和orientation（CV_32F，角度0~360，同cv::phase(..., true)）可选，
+// 传空指针则不输出。dx/dy可以直接交给cv::Canny(dx, dy, ...)，在幅值、方向和Canny之间共享同一份梯度。
+void fusedGradient(const cv::Mat& gray, GradientOperator op, GradientMagnitude norm, cv::Mat& magnitude,
+                   cv::Mat* dx = 0, cv::Mat* dy = 0, cv::Mat* orientation = 0);
+
+// 当前使用的内核（"scalar"或"sse2"）
+const char* fusedGradientKernelName();
+
+#endif
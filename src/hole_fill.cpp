@@ -0,0 +1,112 @@
+#include "hole_fill.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/ximgproc/edge_filter.hpp"
+#include <algorithm>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <emmintrin.h>
+#define HOLE_FILL_X86 1
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <emmintrin.h>
+#define HOLE_FILL_X86 1
+#else
+#define HOLE_FILL_X86 0
+#endif
+
+using namespace cv;
+using namespace cv::ximgproc;
+using namespace std;
+
+namespace
+{
+
+// 从x开始第一个满足(d < valid) == want_invalid的位置，没有时返回width
+static int scanRow(const short* d, int x, int width, short valid, bool want_invalid)
+{
+#if HOLE_FILL_X86
+    // 块内全部不满足时整块跳过，否则在块内逐个查找
+    const __m128i thr = _mm_set1_epi16(valid);
+    const int skip = want_invalid ? 0 : 0xFFFF;
+    for(; x <= width - 8; x += 8)
+        if(_mm_movemask_epi8(_mm_cmplt_epi16(_mm_loadu_si128((const __m128i*)(d + x)), thr)) != skip)
+            break;
+#endif
+    for(; x < width; x++)
+        if((d[x] < valid) == want_invalid)
+            break;
+    return x;
+}
+
+static void fillRow(short* d, int width, short valid, int max_gap)
+{
+    for(int x = scanRow(d, 0, width, valid, true); x < width; )
+    {
+        const int end = scanRow(d, x, width, valid, false);
+        if((x > 0 || end < width) && (max_gap <= 0 || end - x <= max_gap))
+        {
+            const short left = x > 0 ? d[x - 1] : d[end];
+            const short right = end < width ? d[end] : d[x - 1];
+            std::fill(d + x, d + end, std::min(left, right));
+        }
+        x = scanRow(d, end, width, valid, true);
+    }
+}
+
+} // namespace
+
+void fillDisparityHoles(const Mat& src, Mat& dst, int min_disp, int max_gap)
+{
+    CV_Assert(src.type() == CV_16SC1);
+    if(dst.data != src.data)
+        src.copyTo(dst);
+    const short valid = saturate_cast<short>(min_disp * 16);
+    parallel_for_(Range(0, dst.rows), [&](const Range& r)
+    {
+        for(int y = r.start; y < r.end; y++)
+            fillRow(dst.ptr<short>(y), dst.cols, valid, max_gap);
+    });
+}
+
+void smoothFilledDisparity(const Mat& filled, const Mat& guide, Rect roi, int min_disp, double lambda, double sigma,
+                           int iters, Mat& dst)
+{
+    CV_Assert(filled.type() == CV_16SC1 && guide.size() == filled.size() && dst.data != filled.data);
+    const Rect r = roi.area() > 0 ? (roi & Rect(Point(), filled.size())) : Rect(Point(), filled.size());
+    const short invalid = saturate_cast<short>((min_disp - 1) * 16);
+    dst.create(filled.size(), CV_16S);
+    dst.setTo(Scalar(invalid));
+    if(r.area() <= 0)
+        return;
+
+    const Mat src = filled(r);
+    Mat valid;
+    compare(src, Scalar(min_disp * 16), valid, CMP_GE);
+    Mat out = dst(r);
+    if(countNonZero(valid) == r.area())
+    {
+        Mat smoothed;
+        fastGlobalSmootherFilter(guide(r), src, smoothed, lambda, sigma, 0.25, iters);
+        smoothed.copyTo(out);
+        return;
+    }
+
+    Mat disp32, conf32, num, den;
+    valid.convertTo(conf32, CV_32F, 1.0 / 255.0);
+    src.convertTo(disp32, CV_32F);
+    multiply(disp32, conf32, disp32);
+    fastGlobalSmootherFilter(guide(r), disp32, num, lambda, sigma, 0.25, iters);
+    fastGlobalSmootherFilter(guide(r), conf32, den, lambda, sigma, 0.25, iters);
+    parallel_for_(Range(0, r.height), [&](const Range& range)
+    {
+        for(int y = range.start; y < range.end; y++)
+        {
+            const float* n = num.ptr<float>(y);
+            const float* d = den.ptr<float>(y);
+            short* o = out.ptr<short>(y);
+            for(int x = 0; x < r.width; x++)
+                if(d[x] > 1e-3f)
+                    o[x] = saturate_cast<short>(n[x] / d[x]);
+        }
+    });
+}
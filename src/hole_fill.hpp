@@ -0,0 +1,27 @@
+#ifndef DISPARITY_HOLE_FILL_HPP
+#define DISPARITY_HOLE_FILL_HPP
+
+#include "opencv2/core.hpp"
+
+// 滤波前的扫描线填洞。StereoBM的纹理阈值、唯一性检查和斑点滤波会留下大片无效视差（(min_disp-1)*16），
+// 不填时只能靠大lambda的WLS把周围的值抹进去。这里逐行找出无效段，用两端有效视差中较小的一个（背景，
+// 遮挡和弱纹理区域通常属于较远的表面）填满整段；贴着图像左右边界的段只有一侧可用，整行无效时保持不变。
+// 行之间parallel_for_并行，行内用SSE2一次检查8个像素，连续有效或连续无效的块整块跳过。
+// 填洞之后WLS只需要去噪，原则上较小的lambda和较少的迭代就够用。
+//
+// 填洞模式的默认平滑迭代次数，disparity和disparity_bench共用。默认lambda就是wls_lambda，迭代与WLS内部相同，
+// 即与wls_no_conf同样的求解量；更便宜的设置（fill_lambda/fill_iters）要先用
+// disparity_bench --hole_fill在bench的图像对上与wls_no_conf比较耗时和误差后再改为默认
+const int HOLE_FILL_ITERS = 3;
+
+// src/dst为CV_16S的x16定点视差，可以是同一个Mat；max_gap>0时长于max_gap像素的段保持无效
+void fillDisparityHoles(const cv::Mat& src, cv::Mat& dst, int min_disp, int max_gap = 0);
+
+// 填洞之后的平滑（代替不带置信度的WLS，即快速全局平滑），只在roi内求解，roi之外写回无效值(min_disp-1)*16。
+// roi内已全部有效时直接对roi做一次iters次迭代的平滑；仍有无效像素（整行无效、长于max_gap的段）时
+// 改为带置信度的求解FGS(d * c) / FGS(c)，c在无效像素上为0，无效值不会被抹进周围的视差，
+// 求解后仍没有有效邻域的像素保持无效。roi为空时表示整幅。filled与dst不能是同一个Mat
+void smoothFilledDisparity(const cv::Mat& filled, const cv::Mat& guide, cv::Rect roi, int min_disp, double lambda,
+                           double sigma, int iters, cv::Mat& dst);
+
+#endif
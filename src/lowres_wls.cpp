@@ -0,0 +1,166 @@
+#include "lowres_wls.hpp"
+#include "trace.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/ximgproc/edge_filter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace cv;
+using namespace cv::ximgproc;
+using namespace std;
+
+void LowResWLS::init(double lambda, double sigma, int discontinuity_radius)
+{
+    const int f = std::max(factor, 1);
+    const double small_lambda = lambda / ((double)f * f);
+    const int small_radius = std::max(1, (discontinuity_radius + f - 1) / f);
+
+    wls = createDisparityWLSFilterGeneric(false);
+    wls->setLambda(small_lambda);
+    wls->setSigmaColor(sigma);
+    wls->setDepthDiscontinuityRadius(small_radius);
+
+    small_tiled = tiled;
+    small_tiled.lambda = small_lambda;
+    small_tiled.sigma = sigma;
+    small_tiled.radius = small_radius;
+    small_tiled.tile = tiled.tile > 0 ? std::max(tiled.tile / f, 64) : 0;
+    small_tiled.halo = tiled.halo >= 0 ? (tiled.halo + f - 1) / f : -1;
+    small_tiled.blend = std::max(tiled.blend / f, 4);
+}
+
+void LowResWLS::filter(const Mat& disp, const Mat& guide, Mat& filtered)
+{
+    CV_Assert(!wls.empty() && (disp.type() == CV_16SC1 || disp.type() == CV_32FC1) && guide.size() == disp.size() &&
+              guide.depth() == CV_8U);
+    const Size size = disp.size();
+    if(factor <= 1)
+    {
+        solve(disp, guide, filtered);
+        return;
+    }
+
+    const Size small((size.width + factor - 1) / factor, (size.height + factor - 1) / factor);
+    resize(guide, small_guide, small, 0, 0, INTER_AREA);
+    resize(disp, small_disp, small, 0, 0, INTER_AREA);
+    solve(small_disp, small_guide, small_filtered);
+    TraceScope scope("upsample");
+
+    if(upsample == UPSAMPLE_JOINT_BILATERAL)
+    {
+        small_filtered.convertTo(p, CV_32F);
+        resize(p, up, size, 0, 0, INTER_LINEAR);
+        guide.convertTo(I, CV_32F); // jointBilateralFilter要求引导图与源图深度相同
+        jointBilateralFilter(I, up, up_filtered, 2 * factor + 1, sigma_color, factor);
+        up_filtered.convertTo(filtered, disp.type());
+        return;
+    }
+
+    // 引导滤波的系数在小图上求：a = cov(I, p) / (var(I) + eps)，b = mean(p) - a * mean(I)
+    if(guide.channels() == 3)
+    {
+        cvtColor(guide, gray, COLOR_BGR2GRAY);
+        cvtColor(small_guide, small_gray, COLOR_BGR2GRAY);
+    }
+    else
+    {
+        gray = guide;
+        small_gray = small_guide;
+    }
+    const int r = std::max(1, radius / factor);
+    const Size win(2 * r + 1, 2 * r + 1);
+    small_gray.convertTo(I, CV_32F);
+    small_filtered.convertTo(p, CV_32F);
+    boxFilter(I, mean_I, -1, win);
+    boxFilter(p, mean_p, -1, win);
+    multiply(I, p, corr);
+    boxFilter(corr, corr, -1, win);
+    multiply(I, I, var);
+    boxFilter(var, var, -1, win);
+    a.create(small, CV_32F);
+    b.create(small, CV_32F);
+    for(int y = 0; y < small.height; y++)
+    {
+        const float* mi = mean_I.ptr<float>(y);
+        const float* mp = mean_p.ptr<float>(y);
+        const float* c = corr.ptr<float>(y);
+        const float* v = var.ptr<float>(y);
+        float* pa = a.ptr<float>(y);
+        float* pb = b.ptr<float>(y);
+        for(int x = 0; x < small.width; x++)
+        {
+            pa[x] = (c[x] - mi[x] * mp[x]) / (v[x] - mi[x] * mi[x] + (float)eps);
+            pb[x] = mp[x] - pa[x] * mi[x];
+        }
+    }
+    boxFilter(a, a, -1, win);
+    boxFilter(b, b, -1, win);
+    resize(a, up_a, size, 0, 0, INTER_LINEAR);
+    resize(b, up_b, size, 0, 0, INTER_LINEAR);
+
+    // q = a * I + b，直接读原尺寸8位引导图，不再转换整幅浮点图
+    filtered.create(size, disp.type());
+    for(int y = 0; y < size.height; y++)
+    {
+        const uchar* g = gray.ptr<uchar>(y);
+        const float* pa = up_a.ptr<float>(y);
+        const float* pb = up_b.ptr<float>(y);
+        if(disp.depth() == CV_32F)
+        {
+            float* d = filtered.ptr<float>(y);
+            for(int x = 0; x < size.width; x++)
+                d[x] = pa[x] * g[x] + pb[x];
+        }
+        else
+        {
+            short* d = filtered.ptr<short>(y);
+            for(int x = 0; x < size.width; x++)
+                d[x] = saturate_cast<short>(pa[x] * g[x] + pb[x]);
+        }
+    }
+}
+
+void LowResWLS::solve(const Mat& disp, const Mat& guide, Mat& filtered)
+{
+    if(small_tiled.tile > 0)
+        filterWLSTiled(disp, guide, filtered, small_tiled);
+    else if(disp.depth() == CV_32F)
+        fastGlobalSmootherFilter(guide, disp, filtered, wls->getLambda(), wls->getSigmaColor());
+    else
+        wls->filter(disp, guide, filtered, Mat(), Rect(0, 0, disp.cols, disp.rows));
+}
+
+bool parseUpsample(const String& name, int& upsample)
+{
+    if(name == "guided")
+        upsample = UPSAMPLE_GUIDED;
+    else if(name == "joint_bilateral")
+        upsample = UPSAMPLE_JOINT_BILATERAL;
+    else
+        return false;
+    return true;
+}
+
+DepthDiff compareDepth(const Mat& a, const Mat& b)
+{
+    CV_Assert(!a.empty() && a.size() == b.size() && a.channels() == 1 && b.channels() == 1);
+    Mat fa, fb, diff;
+    a.convertTo(fa, CV_32F);
+    b.convertTo(fb, CV_32F);
+    absdiff(fa, fb, diff);
+
+    DepthDiff d;
+    d.mae = mean(diff)[0];
+    double maxv = 0.0;
+    minMaxLoc(diff, 0, &maxv);
+    d.max_abs = maxv;
+    vector<float> v;
+    v.reserve(diff.total());
+    for(int y = 0; y < diff.rows; y++)
+        v.insert(v.end(), diff.ptr<float>(y), diff.ptr<float>(y) + diff.cols);
+    const size_t k = std::min(v.size() - 1, (size_t)(0.99 * v.size()));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    d.p99 = v[k];
+    return d;
+}
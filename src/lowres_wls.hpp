@@ -0,0 +1,56 @@
+#ifndef DISPARITY_LOWRES_WLS_HPP
+#define DISPARITY_LOWRES_WLS_HPP
+
+#include "opencv2/core.hpp"
+#include "opencv2/ximgproc/disparity_filter.hpp"
+#include "tiled_wls.hpp"
+
+// 低分辨率WLS求解 + 原尺寸引导图驱动的上采样。视差和引导图按factor缩小（INTER_AREA）后求解WLS，再重建原尺寸：
+//   guided：在小图上求引导滤波的线性系数q = a*I + b，a、b双线性放大后作用于原尺寸引导图（fast guided filter），
+//           深度边缘跟随原尺寸引导图的边缘；
+//   joint_bilateral：小图结果双线性放大后，以原尺寸引导图做一次联合双边滤波（直径2*factor+1），较慢。
+// 缩小后像素间距变为factor倍，lambda除以factor^2、不连续半径除以factor，使平滑的空间范围与原尺寸求解一致。
+// 全局求解的像素数减少factor^2倍，上采样只是O(N)的局部滤波。
+enum LowResUpsample { UPSAMPLE_GUIDED = 0, UPSAMPLE_JOINT_BILATERAL = 1 };
+
+struct LowResWLS
+{
+    int factor;           // 缩小倍数，<=1表示原尺寸求解
+    int upsample;         // LowResUpsample
+    int radius;           // guided：窗口半径（原图像素）
+    double eps;           // guided：正则项（引导图灰度的平方），越小越贴合引导图边缘
+    double sigma_color;   // joint_bilateral：颜色sigma
+    TiledWLSParams tiled; // tile>0时小图也分块求解，halo>=0时按原图像素给出
+
+    LowResWLS() : factor(1), upsample(UPSAMPLE_GUIDED), radius(8), eps(16.0), sigma_color(8.0) {}
+
+    // lambda/sigma/discontinuity_radius为原尺寸下的WLS参数
+    void init(double lambda, double sigma, int discontinuity_radius);
+
+    // disp为CV_16S（定点x16）或CV_32F（直接用fastGlobalSmootherFilter求解），guide为与之同尺寸的8位单通道或三通道图，
+    // 输出与disp同类型
+    void filter(const cv::Mat& disp, const cv::Mat& guide, cv::Mat& filtered);
+
+    // 原尺寸或缩小后的一次求解（分块或整图）
+    void solve(const cv::Mat& disp, const cv::Mat& guide, cv::Mat& filtered);
+
+    cv::Ptr<cv::ximgproc::DisparityWLSFilter> wls;
+    TiledWLSParams small_tiled;
+    cv::Mat gray, small_guide, small_gray, small_disp, small_filtered;
+    cv::Mat I, p, mean_I, mean_p, corr, var, a, b, up_a, up_b, up, up_filtered;
+};
+
+// "guided"或"joint_bilateral"
+bool parseUpsample(const cv::String& name, int& upsample);
+
+// 两幅同尺寸单通道深度图的差异（转为CV_32F比较），用于与原尺寸求解的结果对比
+struct DepthDiff
+{
+    double mae;
+    double p99;
+    double max_abs;
+};
+
+DepthDiff compareDepth(const cv::Mat& a, const cv::Mat& b);
+
+#endif
@@ -1,266 +1,860 @@
 #include "opencv2/calib3d.hpp"
 #include "opencv2/imgproc.hpp"
 #include "opencv2/imgcodecs.hpp"
+#include "opencv2/videoio.hpp"
 #include "opencv2/highgui.hpp"
 #include "opencv2/core/utility.hpp"
 #include "opencv2/ximgproc/disparity_filter.hpp"
+#include "stereo_pipeline.hpp"
+#include "wls_sweep.hpp"
+#include "stereo_rectify.hpp"
+#include "disparity_range.hpp"
+#include "stereo_strips.hpp"
+#include "rig_scheduler.hpp"
+#include "buffer_pool.hpp"
+#include "point_cloud.hpp"
+#include "raw_depth.hpp"
+#include "depth_io.hpp"
+#include "blocking_queue.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
 
 using namespace cv;
 using namespace cv::ximgproc;
 using namespace std;
 
-Rect computeROI(Size2i src_sz, Ptr<StereoMatcher> matcher_instance);
+const String keys =
+    "{help h usage ? |                  | print this message                                                }"
+    "{@left          |../l.jpg          | left view of the stereopair (video file or image sequence such as left_%04d.png with --video) }"
+    "{@right         |../r.jpg          | right view of the stereopair                                      }"
+    "{dst_path       |../filter.jpg     | optional path to save the resulting filtered disparity map (printf pattern with --video) }"
+    "{dst_raw_path   |../origin.jpg     | optional path to save raw disparity map before filtering          }"
+    "{dst_conf_path  |None              | optional path to save the confidence map used in filtering        }"
+    "{dst_cloud      |None              | point cloud reprojected from the filtered disparity with the calibration's Q: .ply = binary PLY, other = raw float x,y,z[,uchar r,g,b] records (printf pattern with --video) }"
+    "{cloud_no_color |                  | write point positions only, without the left view's color          }"
+    "{cloud_min_conf |1                 | skip points whose filtering confidence is below this (0..255)      }"
+    "{cloud_max_depth|0                 | skip points farther than this, in the units of the calibration's T (0 = no limit) }"
+    "{algo           |bm                | stereo matching method (bm, sgbm or census)                       }"
+    "{filter         |wls_no_conf       | used post-filtering (wls_conf or wls_no_conf)                     }"
+    "{downscale      |                  | downscale views for matching in the wls_conf mode (faster, lower quality) }"
+    "{max_disparity  |48                | parameter of stereo matching                                      }"
+    "{min_disparity  |                  | parameter of stereo matching (default: -16 for sgbm with wls_no_conf, otherwise 0) }"
+    "{auto_range     |                  | estimate min/max disparity from ORB matches on the (first) pair; falls back to the values above }"
+    "{window_size    |-1                | parameter of stereo matching                                      }"
+    "{wls_lambda     |8000.0            | parameter of post-filtering                                       }"
+    "{wls_sigma      |1.0               | parameter of post-filtering                                       }"
+    "{video          |                  | treat left/right as synchronized frame streams                    }"
+    "{max_frames     |0                 | stop the stream after this many frames (0 = until the end)        }"
+    "{queue_depth    |3                 | number of frame buffers cycling through the stream pipeline       }"
+    "{show           |                  | display every filtered frame of the stream                        }"
+    "{lr_threads     |0:0               | row bands for the left:right matchers in wls_conf (0 = one call each); bands approximate the full-image result near the seams, mostly sub-pixel for sgbm }"
+    "{pyramid        |0                 | coarse-to-fine levels (0 = off); finer levels only search around the upsampled coarser disparity }"
+    "{temporal       |0                 | with --video: reuse the previous frame's disparity for unchanged tiles and narrow the search elsewhere; value = keyframe interval (0 = off) }"
+    "{temporal_radius|2                 | temporal: disparities searched on each side of the predicted range  }"
+    "{temporal_static|3.0               | temporal: mean abs difference to the previous frame below which a tile keeps its previous disparity }"
+    "{temporal_diff  |8.0               | temporal: mean abs difference to the previous frame above which a tile searches the full range }"
+    "{temporal_smooth|0.3               | temporal: blend factor towards the previous output for pixels that changed less than 1 px (0 = off) }"
+    "{selective      |                  | wls_conf: solve WLS only around low left-right-confidence regions and keep the raw disparity elsewhere }"
+    "{selective_tile |32                | selective: tile size of the low-confidence mask                    }"
+    "{selective_margin|8                | selective: dilation of the low-confidence mask in pixels           }"
+    "{selective_halo |-1                | selective: context pixels solved around each region (-1 = auto from wls_lambda) }"
+    "{selective_max  |0.5               | selective: fraction of the image above which the whole image is filtered instead }"
+    "{hole_fill      |                  | wls_no_conf: fill invalid disparities along scanlines from the background side, then smooth with fill_lambda/fill_iters }"
+    "{fill_max_gap   |0                 | hole_fill: leave invalid runs longer than this many pixels (0 = fill all) }"
+    "{fill_lambda    |                  | hole_fill: smoothing lambda (default: wls_lambda) }"
+    "{fill_iters     |                  | hole_fill: smoothing iterations after filling (default 3, as in the WLS filter) }"
+    "{sweep_lambda   |                  | comma-separated wls_lambda values; any sweep_* list matches once and re-runs only WLS per combination }"
+    "{sweep_sigma    |                  | comma-separated wls_sigma values                                  }"
+    "{sweep_radius   |                  | comma-separated depth discontinuity radii (default: the filter's own) }"
+    "{sweep_out      |../wls_sweep.csv  | sweep results table (filter_ms is measured while combinations run in parallel) }"
+    "{sweep_gt       |                  | ground-truth disparity for the bad/mae columns (<=0 or NaN = unknown) }"
+    "{sweep_gt_scale |1.0               | multiply sweep_gt values by this to get pixels (e.g. 0.0625 for x16 fixed point) }"
+    "{bad_thresh     |1.0               | sweep: error in pixels above which a pixel counts as bad           }"
+    "{calib          |                  | stereo calibration YAML/XML (K1 D1 K2 D2 R T, optionally R1 R2 P1 P2); views are rectified before matching }"
+    "{rect_cache     |../rect_cache     | directory caching the fixed-point remap tables per calibration and resolution (empty = no cache) }"
+    "{rect_alpha     |-1                | stereoRectify free scaling when the calibration has no R1/R2/P1/P2 (-1 = default) }"
+    "{match_cache    |                  | directory caching the left/right disparities; reused while matcher parameters and inputs are unchanged }"
+    "{strips         |0                 | process the pair in horizontal strips of this many rows with bounded memory (0 = off); .rdm views are read and .rdm outputs written strip by strip }"
+    "{strip_overlap  |-1                | strips: rows read above and below each strip (-1 = auto from window size and wls_lambda) }"
+    "{strip_workers  |0                 | strips: strips processed in parallel (0 = number of CPUs) }"
+    "{rigs           |                  | text file with one stereo stream per line: <left> <right> [dst pattern|None] [priority] [deadline_ms]; all streams share one worker pool }"
+    "{pool_threads   |0                 | rigs: worker threads shared by all streams (0 = number of CPUs) }"
+    "{cv_threads     |1                 | rigs: OpenCV threads inside each match/filter job (pool_threads x cv_threads should not exceed the cores) }"
+    "{buffer_pool_mb |512               | video/rigs/strips: cap on idle Mat buffers kept for reuse by later frames (0 = off) }"
+    "{trace          |                  | write per-stage Chrome trace-event JSON to this file and print a time/allocation/RSS summary }"
+    ;
+
+static void printStageStats(const String& name, vector<double> ms)
+{
+    if(ms.empty())
+        return;
+    sort(ms.begin(), ms.end());
+    double total = 0.0;
+    for(size_t i = 0; i < ms.size(); i++)
+        total += ms[i];
+    cout << "  " << name << ": mean " << total / ms.size() << " ms"
+         << ", p50 " << ms[ms.size() / 2] << " ms"
+         << ", p95 " << ms[std::min(ms.size() - 1, (ms.size() * 95) / 100)] << " ms"
+         << ", max " << ms.back() << " ms" << endl;
+}
 
-int main(int argc, char** argv)
+static double msSince(int64 tick)
 {
-    String left_img = "../l.jpg";
-    String right_img = "../r.jpg";
-    String dst_path = "../filter.jpg"; //保存生成的经过滤波的视差图
-    String dst_raw_path = "../origin.jpg"; //保存原始视差图
-    String dst_conf_path = "None"; //保存置信度图
+    return ((double)getTickCount() - tick) * 1000.0 / getTickFrequency();
+}
 
-    String algo = "bm"; //立体匹配方法 (bm or sgbm)
-    String filter = "wls_no_conf"; //使用后滤波 (wls_conf or wls_no_conf)
+// 匹配，cache_dir非空时先查缓存，未命中则匹配后写入缓存
+static void matchCached(StereoContext& ctx, StereoFrame& frame, const String& cache_dir,
+                        const String& left_img, const String& right_img, const StereoRectifier& rectifier)
+{
+    String key;
+    if(!cache_dir.empty())
+    {
+        key = matchCacheKey(ctx.params, left_img, right_img, rectifier.loaded() ? rectifier.fingerprint() : String());
+        if(loadMatchCache(ctx, cache_dir, key, frame))
+        {
+            cout << "Matching loaded from cache: " << key << endl;
+            return;
+        }
+    }
+    matchFrame(ctx, frame);
+    if(!cache_dir.empty())
+        saveMatchCache(ctx, cache_dir, key, frame);
+}
 
-    bool no_downscale = true; //强制使用全尺寸视图进行立体匹配以提高质量;
-    int max_disp = 48; //立体匹配参数, numDisparities
+// 读取序列的第一对（校正后），只用于估计视差范围；序列本身之后重新打开
+static bool readFirstPair(const String& left_src, const String& right_src, StereoRectifier& rectifier, Mat& left, Mat& right)
+{
+    VideoCapture left_cap(left_src), right_cap(right_src);
+    Mat l, r;
+    if(!left_cap.read(l) || !right_cap.read(r) || l.size() != r.size())
+        return false;
+    if(rectifier.loaded())
+        return rectifier.rectify(l, r, left, right);
+    left = l;
+    right = r;
+    return true;
+}
 
-    double lambda = 8000.0; //后滤波参数, wls_lambda
-    double sigma  = 1.0; //后滤波参数, wls_sigma
+// 由稀疏匹配估计视差范围，成功时覆盖min_disp/max_disp（原图尺度）
+static void autoRange(const Mat& left, const Mat& right, int& min_disp, int& max_disp)
+{
+    DisparityRangeResult range;
+    if(!estimateDisparityRange(left, right, DisparityRangeOptions(), range))
+    {
+        cout << "Disparity range: only " << range.inliers << " of " << range.matches
+             << " matches on epipolar lines, keeping [" << min_disp << ", " << min_disp + max_disp << ")" << endl;
+        return;
+    }
+    min_disp = range.min_disp;
+    max_disp = range.num_disp;
+    cout << "Disparity range: [" << min_disp << ", " << min_disp + max_disp << ") from matches spanning "
+         << range.lo << ".." << range.hi << " (" << range.inliers << " of " << range.matches << " matches, "
+         << range.ms << " ms)" << endl;
+}
 
-    int wsize;
-    if(algo=="sgbm")
-        wsize = 3; //默认窗口大小为3
-    else if(!no_downscale && algo=="bm" && filter=="wls_conf")
-        wsize = 7; //默认窗口大小为7
+// 条带模式的输入：.rdm直接映射，其余格式只能整幅解码
+static bool openStripView(const String& path, MappedDepth& mapped, Mat& view)
+{
+    if(isRawDepthPath(path))
+    {
+        if(!mapped.open(path))
+            return false;
+        view = mapped.mat();
+    }
     else
-        wsize = 15; //默认窗口大小为15
+    {
+        cout << "Decoding " << path << " whole (use .rdm views to bound memory)" << endl;
+        TraceScope scope("decode");
+        view = imread(path, IMREAD_COLOR);
+        if(view.empty())
+        {
+            cout << "Cannot read image file: " << path << endl;
+            return false;
+        }
+    }
+    if(view.type() != CV_8UC3 && view.type() != CV_8UC1)
+    {
+        cout << "Unsupported view type in " << path << ": expected 8-bit gray or BGR" << endl;
+        return false;
+    }
+    return true;
+}
 
-    //! [load_views]
-    Mat left  = imread(left_img, IMREAD_COLOR);
-    if ( left.empty() )
+// 条带模式的输出：.rdm按条带顺序追加写出；其余格式先拼成整幅再写
+struct StripOutput
+{
+    String path;
+    RawDepthWriter writer;
+    Mat whole;
+
+    bool open(const String& _path, Size size, int type)
+    {
+        path = _path;
+        if(path == "None")
+            return true;
+        if(isRawDepthPath(path))
+            return writer.open(path, size, type);
+        whole.create(size, type);
+        return true;
+    }
+    bool write(int y0, const Mat& rows)
     {
-        cout << "Cannot read image file: " << left_img;
+        if(path == "None")
+            return true;
+        if(isRawDepthPath(path))
+            return writer.write(rows);
+        rows.copyTo(whole.rowRange(y0, y0 + rows.rows));
+        return true;
+    }
+    bool close()
+    {
+        if(path == "None")
+            return true;
+        TraceScope scope("encode");
+        return isRawDepthPath(path) ? writer.close() : imwrite(path, whole);
+    }
+};
+
+// 条带模式：按条带读入、匹配、滤波并写出，峰值内存与条带高度有关，与图像高度无关
+static int runStrips(const StereoParams& params, const String& left_src, const String& right_src,
+                     const String& dst_path, const String& dst_raw_path, const StripOptions& opts)
+{
+    MappedDepth left_map, right_map;
+    Mat left_view, right_view;
+    if(!openStripView(left_src, left_map, left_view) || !openStripView(right_src, right_map, right_view))
+        return -1;
+    if(left_view.size() != right_view.size())
+    {
+        cout << "Left and right views differ in size" << endl;
         return -1;
     }
 
-    Mat right = imread(right_img, IMREAD_COLOR);
-    if ( right.empty() )
+    const Size size = left_view.size();
+    StripOutput filtered_out, raw_out;
+    if(!filtered_out.open(dst_path, size, CV_16S) || !raw_out.open(dst_raw_path, size, CV_16S))
+        return -1;
+
+    // 复制出条带后丢弃映射页，已处理过的行不再常驻内存
+    StripReader read = [&](int y0, int y1, Mat& left, Mat& right) -> bool
     {
-        cout << "Cannot read image file: " << right_img;
+        TraceScope scope("decode");
+        if(left_view.channels() == 1)
+        {
+            cvtColor(left_view.rowRange(y0, y1), left, COLOR_GRAY2BGR);
+            cvtColor(right_view.rowRange(y0, y1), right, COLOR_GRAY2BGR);
+        }
+        else
+        {
+            left_view.rowRange(y0, y1).copyTo(left);
+            right_view.rowRange(y0, y1).copyTo(right);
+        }
+        left_map.evictRows(y0, y1);
+        right_map.evictRows(y0, y1);
+        return true;
+    };
+    StripSink sink = [&](int y0, int y1, const StereoFrame& f, int offset) -> bool
+    {
+        TraceScope scope("encode");
+        return filtered_out.write(y0, f.filtered_disp.rowRange(offset, offset + y1 - y0)) &&
+               raw_out.write(y0, f.raw_disp.rowRange(offset, offset + y1 - y0));
+    };
+
+    StripStats stats;
+    const bool ok = processStrips(params, size, opts, read, sink, stats);
+    if(!filtered_out.close() || !raw_out.close() || !ok)
+    {
+        cout << "Strip processing failed" << endl;
         return -1;
     }
-    //! [load_views]
 
-    Mat left_for_matcher, right_for_matcher;
-    Mat left_disp,right_disp;
-    Mat filtered_disp;
-    Mat conf_map = Mat(left.rows, left.cols, CV_8U);
-    conf_map = Scalar(255);
-    Rect ROI;
-    Ptr<DisparityWLSFilter> wls_filter;
-    double matching_time, filtering_time;
-    if(max_disp<=0 || max_disp%16!=0)
+    cout.precision(3);
+    cout << "Strips:         " << stats.strips << " x " << stats.rows << " rows, overlap "
+         << stats.overlap << " rows" << endl;
+    cout << "Total time:     " << stats.seconds << "s" << endl;
+    cout << "Matching time:  " << stats.matching_time << "s (sum over strips)" << endl;
+    cout << "Filtering time: " << stats.filtering_time << "s (sum over strips)" << endl;
+    return 0;
+}
+
+// 参数扫描：匹配一次，每组lambda/sigma/半径只重跑WLS，组合之间并行
+static int runSweep(StereoContext& ctx, StereoFrame& frame, const CommandLineParser& parser,
+                    const String& cache_dir, const String& left_img, const String& right_img,
+                    const StereoRectifier& rectifier)
+{
+    vector<double> lambdas(1, ctx.params.lambda), sigmas(1, ctx.params.sigma);
+    vector<double> radii(1, ctx.wls_filter->getDepthDiscontinuityRadius());
+    if((parser.has("sweep_lambda") && !parseSweepList(parser.get<String>("sweep_lambda"), lambdas)) ||
+       (parser.has("sweep_sigma") && !parseSweepList(parser.get<String>("sweep_sigma"), sigmas)) ||
+       (parser.has("sweep_radius") && !parseSweepList(parser.get<String>("sweep_radius"), radii)))
+        return -1;
+
+    Mat gt;
+    if(parser.has("sweep_gt"))
     {
-        cout << "Incorrect max_disparity value: it should be positive and divisible by 16";
+        int gt_depth = -1;
+        if(!loadDepthAsFloat(parser.get<String>("sweep_gt"), gt, gt_depth))
+            return -1;
+        gt *= parser.get<double>("sweep_gt_scale");
+        if(gt.size() != frame.left.size())
+        {
+            cout << "sweep_gt size differs from the left view";
+            return -1;
+        }
+    }
+
+    matchCached(ctx, frame, cache_dir, left_img, right_img, rectifier);
+
+    vector<WLSSweepPoint> points = makeSweepGrid(lambdas, sigmas, radii);
+    vector<WLSSweepResult> results;
+    int64 t = getTickCount();
+    runWLSSweep(ctx, frame, points, gt, parser.get<double>("bad_thresh"), results);
+    double sweep_time = ((double)getTickCount() - t) / getTickFrequency();
+
+    cout.precision(4);
+    cout << "Matching time:  " << frame.matching_time << "s" << endl;
+    cout << "Sweep time:     " << sweep_time << "s for " << points.size() << " combinations" << endl;
+    cout << "lambda\tsigma\tradius\tfilter_ms\tfidelity\tsmooth\tbad\tmae" << endl;
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const WLSSweepResult& r = results[i];
+        cout << r.point.lambda << "\t" << r.point.sigma << "\t" << r.point.radius << "\t" << r.filter_ms
+             << "\t" << r.fidelity << "\t" << r.smoothness << "\t" << r.bad << "\t" << r.mae << endl;
+    }
+
+    const String out = parser.get<String>("sweep_out");
+    if(!writeSweepTable(out, results))
+        return -1;
+    cout << "Sweep table saved to: " << out << endl;
+    return 0;
+}
+
+// 序列模式：解码、匹配、滤波分别在各自线程上运行，帧缓冲区在各阶段之间循环复用
+static int runStream(StereoContext& ctx, const String& left_src, const String& right_src,
+                     const String& dst_path, int max_frames, int queue_depth, bool show,
+                     StereoRectifier& rectifier, const String& dst_cloud, const PointCloudOptions& cloud_opts)
+{
+    VideoCapture left_cap(left_src), right_cap(right_src);
+    if(!left_cap.isOpened())
+    {
+        cout << "Cannot open stream: " << left_src;
         return -1;
     }
-    if(wsize<=0 || wsize%2!=1)
+    if(!right_cap.isOpened())
     {
-        cout << "Incorrect window_size value: it should be positive and odd";
+        cout << "Cannot open stream: " << right_src;
         return -1;
     }
-    if(filter=="wls_conf") // 使用置信度进行滤波（比wls_no_conf质量更好）
+
+    vector<StereoFrame> slots(std::max(queue_depth, 1));
+    BlockingQueue<StereoFrame*> free_q, match_q, filter_q, out_q;
+    for(size_t i = 0; i < slots.size(); i++)
+        free_q.push(&slots[i]);
+
+    // ESC之后解码线程不再取空闲槽；回收的槽会让free_q一直非空，只关闭队列停不下来
+    atomic<bool> stopping(false);
+    thread decoder([&]()
     {
-        if(!no_downscale)
+        StereoFrame* f;
+        int index = 0;
+        while((max_frames <= 0 || index < max_frames) && !stopping && free_q.pop(f))
         {
-            // 缩小图像以加速匹配阶段，因为我们需要计算左右视图的置信度图
-            //! [downscale]
-            max_disp/=2;
-            if(max_disp%16!=0)
-                max_disp += 16-(max_disp%16);
-            resize(left ,left_for_matcher ,Size(),0.5,0.5);
-            resize(right,right_for_matcher,Size(),0.5,0.5);
-            //! [downscale]
+            f->start_tick = getTickCount();
+            const bool rectify = rectifier.loaded();
+            TraceScope decode_scope("decode");
+            if(!left_cap.read(rectify ? f->left_in : f->left) || !right_cap.read(rectify ? f->right_in : f->right))
+                break;
+            decode_scope.end();
+            if(rectify ? f->left_in.size() != f->right_in.size() : f->left.size() != f->right.size())
+            {
+                cout << "Left and right frames differ in size at frame " << index << endl;
+                break;
+            }
+            // 校正属于解码阶段，remap表只在第一帧准备
+            TraceScope rectify_scope("rectify");
+            if(rectify && !rectifier.rectify(f->left_in, f->right_in, f->left, f->right))
+                break;
+            rectify_scope.end();
+            f->index = index++;
+            f->decode_ms = msSince(f->start_tick);
+            match_q.push(f);
         }
-        else
+        match_q.close();
+    });
+
+    thread matcher([&]()
+    {
+        StereoFrame* f;
+        while(match_q.pop(f))
         {
-            left_for_matcher  = left.clone();
-            right_for_matcher = right.clone();
+            int64 t = getTickCount();
+            matchFrame(ctx, *f);
+            f->match_ms = msSince(t);
+            filter_q.push(f);
         }
+        filter_q.close();
+    });
 
-        if(algo=="bm")
+    thread filterer([&]()
+    {
+        StereoFrame* f;
+        while(filter_q.pop(f))
         {
-            //! [matching]
-            Ptr<StereoBM> left_matcher = StereoBM::create(max_disp,wsize);
-            wls_filter = createDisparityWLSFilter(left_matcher);
-            Ptr<StereoMatcher> right_matcher = createRightMatcher(left_matcher);
-
-            cvtColor(left_for_matcher, left_for_matcher,  COLOR_BGR2GRAY);
-            cvtColor(right_for_matcher, right_for_matcher, COLOR_BGR2GRAY);
-
-            matching_time = (double)getTickCount();
-            left_matcher-> compute(left_for_matcher, right_for_matcher, left_disp);
-            right_matcher->compute(right_for_matcher, left_for_matcher, right_disp);
-            matching_time = ((double)getTickCount() - matching_time) / getTickFrequency();
-            //! [matching]
+            int64 t = getTickCount();
+            filterFrame(ctx, *f);
+            f->filter_ms = msSince(t);
+            out_q.push(f);
         }
-        else if(algo=="sgbm")
+        out_q.close();
+    });
+
+    vector<double> decode_ms, match_ms, left_ms, right_ms, filter_ms, latency_ms, search, refined;
+    Mat filtered_disp_vis;
+    int64 first_tick = 0;
+    bool cloud_failed = false;
+    // 每个帧缓冲槽都走完一遍流水线之后的堆分配才算稳态，之前各槽的首次分配属于预热
+    MatAllocCounts warm = matAllocCounts();
+    StereoFrame* f;
+    while(out_q.pop(f))
+    {
+        if(decode_ms.empty())
+            first_tick = f->start_tick;
+        decode_ms.push_back(f->decode_ms);
+        match_ms.push_back(f->match_ms);
+        left_ms.push_back(f->left_matching_time * 1000.0);
+        if(ctx.use_conf && (!ctx.census || ctx.params.pyr_levels > 1 || ctx.temporal))
+            right_ms.push_back(f->right_matching_time * 1000.0);
+        filter_ms.push_back(f->filter_ms);
+        search.push_back(f->search_fraction * 100.0);
+        refined.push_back(f->refined_fraction * 100.0);
+
+        if(dst_path != "None" && dst_path.find('%') != String::npos)
         {
-            Ptr<StereoSGBM> left_matcher  = StereoSGBM::create(0,max_disp,wsize);
-            left_matcher->setP1(24*wsize*wsize);
-            left_matcher->setP2(96*wsize*wsize);
-            left_matcher->setPreFilterCap(63);
-            left_matcher->setMode(StereoSGBM::MODE_SGBM_3WAY);
-            wls_filter = createDisparityWLSFilter(left_matcher);
-            Ptr<StereoMatcher> right_matcher = createRightMatcher(left_matcher);
-
-            matching_time = (double)getTickCount();
-            left_matcher-> compute(left_for_matcher, right_for_matcher, left_disp);
-            right_matcher->compute(right_for_matcher, left_for_matcher, right_disp);
-            matching_time = ((double)getTickCount() - matching_time) / getTickFrequency();
+            TraceScope scope("encode");
+            imwrite(format(dst_path.c_str(), f->index), f->filtered_disp);
         }
-        else
+        bool stop = false;
+        // 每帧一个点云文件，记录按行块边转换边写出；写失败时停止整个序列
+        if(dst_cloud != "None" && !cloud_failed && !writePointCloud(format(dst_cloud.c_str(), f->index), f->filtered_disp,
+                                                                    rectifier.reprojection(), f->left, f->conf_map, f->ROI, cloud_opts))
         {
-            cout<<"Unsupported algorithm";
-            return -1;
+            cout << "Cannot save point cloud for frame " << f->index << ", stopping" << endl;
+            cloud_failed = stop = true;
         }
-
-        //! [filtering]
-        wls_filter->setLambda(lambda);
-        wls_filter->setSigmaColor(sigma);
-        filtering_time = (double)getTickCount();
-        wls_filter->filter(left_disp, left, filtered_disp, right_disp);
-        filtering_time = ((double)getTickCount() - filtering_time) / getTickFrequency();
-        //! [filtering]
-        conf_map = wls_filter->getConfidenceMap();
-
-        // Get the ROI that was used in the last filter call:
-        ROI = wls_filter->getROI();
-        if(!no_downscale)
+        if(show)
+        {
+            f->filtered_disp.convertTo(filtered_disp_vis, CV_8U, 1);
+            imshow("filtered disparity", filtered_disp_vis);
+            stop = (waitKey(1) == 27) || stop;
+        }
+        latency_ms.push_back(msSince(f->start_tick));
+        if(latency_ms.size() == slots.size())
+            warm = matAllocCounts();
+        if(stop)
         {
-            // upscale raw disparity and ROI back for a proper comparison:
-            resize(left_disp, left_disp, Size(), 2.0, 2.0);
-            left_disp = left_disp * 2.0;
-            ROI = Rect(ROI.x*2, ROI.y*2, ROI.width*2, ROI.height*2);
+            stopping = true;
+            free_q.close();
         }
+        else
+            free_q.push(f);
     }
-    else if(filter=="wls_no_conf")
+    double wall = msSince(first_tick) / 1000.0;
+
+    decoder.join();
+    matcher.join();
+    filterer.join();
+
+    if(latency_ms.empty())
     {
-        /* 没有方便的函数来处理没有置信度的情况，所以我们需要手动设置ROI和匹配器参数 */
+        cout << "No frames decoded from: " << left_src;
+        return -1;
+    }
 
-        left_for_matcher  = left.clone();
-        right_for_matcher = right.clone();
+    // 收集并打印所有统计数据:
+    cout.precision(3);
+    cout << "Frames:         " << latency_ms.size() << endl;
+    cout << "Sustained FPS:  " << latency_ms.size() / wall << endl;
+    cout << "Stage latency:" << endl;
+    printStageStats("decode  ", decode_ms);
+    printStageStats("match   ", match_ms);
+    printStageStats("  left  ", left_ms);
+    printStageStats("  right ", right_ms);
+    printStageStats("filter  ", filter_ms);
+    printStageStats("end2end ", latency_ms);
+    if(bufferPoolInstalled() && latency_ms.size() > slots.size())
+    {
+        const long long steady = matAllocCounts().allocs - warm.allocs;
+        cout << "Mat heap allocations after warm-up: " << steady << " ("
+             << (double)steady / (latency_ms.size() - slots.size()) << " per frame)" << endl;
+    }
+    if(ctx.params.selective)
+    {
+        double total = 0.0;
+        for(size_t i = 0; i < refined.size(); i++)
+            total += refined[i];
+        cout << "Selective refinement: " << total / refined.size() << "% of the image solved on average" << endl;
+    }
+    if(ctx.temporal)
+    {
+        double total = 0.0;
+        for(size_t i = 0; i < search.size(); i++)
+            total += search[i];
+        cout << "Temporal search: " << total / search.size() << "% of the full cost volume on average" << endl;
+    }
+    cout<<endl;
+    return cloud_failed ? -1 : 0;
+}
 
-        if(algo=="bm")
-        {
-            cv::Ptr<cv::StereoBM> bm = cv::StereoBM::create();
-            bm->setPreFilterType(cv::StereoBM::PREFILTER_NORMALIZED_RESPONSE);
-            bm->setPreFilterSize(9);
-            bm->setPreFilterCap(31);
-            bm->setBlockSize(15);
-            bm->setMinDisparity(0);
-            bm->setNumDisparities(48);
-            bm->setTextureThreshold(10);
-            bm->setUniquenessRatio(15);
-            bm->setSpeckleWindowSize(100);
-            bm->setSpeckleRange(32);
-
-            cvtColor(left_for_matcher, left_for_matcher, COLOR_BGR2GRAY);
-            cvtColor(right_for_matcher, right_for_matcher, COLOR_BGR2GRAY);
-
-            ROI = computeROI(left_for_matcher.size(), bm);
-            wls_filter = createDisparityWLSFilterGeneric(false);
-            wls_filter->setDepthDiscontinuityRadius((int)ceil(0.33 * wsize));
-
-            matching_time = (double)getTickCount();
-            bm->compute(left_for_matcher, right_for_matcher, left_disp);
-            matching_time = ((double)getTickCount() - matching_time) / getTickFrequency();
-        }
-        else if(algo=="sgbm")
-        {
-            cv::Ptr<cv::StereoSGBM> sgbm = cv::StereoSGBM::create(-16, 48, 15, 0, 0, 1, 31, 15, 100, 2, 0);
+// 多路模式：所有流的解码、匹配、滤波任务在一个共享的工作窃取线程池上调度
+static int runRigs(const StereoParams& params, const String& rig_list, const RigSchedulerOptions& opts)
+{
+    vector<RigSpec> rigs;
+    if(!loadRigList(rig_list, rigs))
+        return -1;
 
-            ROI = computeROI(left_for_matcher.size(), sgbm);
-            wls_filter = createDisparityWLSFilterGeneric(false);
-            wls_filter->setDepthDiscontinuityRadius((int)ceil(0.5 * wsize));
+    vector<RigStats> stats;
+    double wall = 0.0;
+    const bool ok = runRigScheduler(params, rigs, opts, stats, wall);
+    if(stats.empty())
+        return -1;
+
+    cout.precision(3);
+    int frames = 0;
+    for(size_t i = 0; i < rigs.size(); i++)
+    {
+        const RigStats& s = stats[i];
+        frames += s.frames;
+        cout << "Stream " << i << " (" << rigs[i].left << ", priority " << rigs[i].priority << "): "
+             << s.frames << " frames, " << s.fps << " FPS, latency mean " << s.mean_ms << " ms, p50 " << s.p50_ms
+             << " ms, p99 " << s.p99_ms << " ms, max " << s.max_ms << " ms";
+        if(rigs[i].deadline_ms > 0.0)
+            cout << ", " << s.missed << " over the " << rigs[i].deadline_ms << " ms deadline";
+        cout << endl;
+    }
+    cout << "Total:          " << frames << " frames in " << wall << "s (" << frames / std::max(wall, 1e-9) << " FPS)" << endl;
+    if(bufferPoolInstalled())
+    {
+        const BufferPoolStats pool = bufferPoolStats();
+        cout << "Buffer pool:    " << pool.hits << " reused, " << pool.misses << " heap allocations, "
+             << pool.pooled_mb << " MB idle" << endl;
+    }
+    return ok ? 0 : -1;
+}
 
-            matching_time = (double)getTickCount();
-            sgbm->compute(left_for_matcher, right_for_matcher, left_disp);
-            matching_time = ((double)getTickCount() - matching_time) / getTickFrequency();
+int main(int argc, char** argv)
+{
+    CommandLineParser parser(argc,argv,keys);
+    parser.about("Disparity Filtering Demo");
+    if (parser.has("help"))
+    {
+        parser.printMessage();
+        return 0;
+    }
+
+    String left_img = parser.get<String>(0);
+    String right_img = parser.get<String>(1);
+    String dst_path = parser.get<String>("dst_path"); //保存生成的经过滤波的视差图
+    String dst_raw_path = parser.get<String>("dst_raw_path"); //保存原始视差图
+    String dst_conf_path = parser.get<String>("dst_conf_path"); //保存置信度图
+    String dst_cloud = parser.get<String>("dst_cloud"); //保存由Q重投影得到的点云
+
+    String algo = parser.get<String>("algo"); //立体匹配方法 (bm, sgbm or census)
+    String filter = parser.get<String>("filter"); //使用后滤波 (wls_conf or wls_no_conf)
+
+    bool no_downscale = !parser.has("downscale"); //强制使用全尺寸视图进行立体匹配以提高质量;
+    int max_disp = parser.get<int>("max_disparity"); //立体匹配参数, numDisparities
+    int min_disp = parser.has("min_disparity") ? parser.get<int>("min_disparity") : defaultMinDisparity(algo, filter); //立体匹配参数, minDisparity
+    bool auto_range = parser.has("auto_range"); //由稀疏特征匹配估计视差范围
+
+    double lambda = parser.get<double>("wls_lambda"); //后滤波参数, wls_lambda
+    double sigma  = parser.get<double>("wls_sigma"); //后滤波参数, wls_sigma
+
+    bool video = parser.has("video"); //把左右输入当作同步的视频/图像序列处理
+    int strips = parser.get<int>("strips"); //条带模式的条带行数
+    bool rigs = parser.has("rigs"); //多路立体相机共享一个线程池
+    TraceSession trace(parser.get<String>("trace")); //分阶段计时与内存跟踪，main返回时写出
+    int max_frames = parser.get<int>("max_frames");
+    int queue_depth = parser.get<int>("queue_depth");
+    bool show = parser.has("show");
+    int pyr_levels = parser.get<int>("pyramid"); //由粗到细匹配的金字塔层数
+
+    int left_threads = 0, right_threads = 0; //左右匹配器的线程划分
+    String lr_threads = parser.get<String>("lr_threads");
+    if(sscanf(lr_threads.c_str(), "%d:%d", &left_threads, &right_threads) != 2 || left_threads < 0 || right_threads < 0)
+    {
+        cout << "Incorrect lr_threads value: expected <left>:<right>, e.g. 4:4";
+        return -1;
+    }
+
+    int wsize;
+    if(parser.get<int>("window_size")>=0) //用户提供了窗口大小
+        wsize = parser.get<int>("window_size");
+    else
+        wsize = defaultWindowSize(algo, filter, no_downscale);
+
+    if (!parser.check())
+    {
+        parser.printErrors();
+        return -1;
+    }
+
+    if(max_disp<=0 || max_disp%16!=0)
+    {
+        cout << "Incorrect max_disparity value: it should be positive and divisible by 16";
+        return -1;
+    }
+    if(wsize<=0 || wsize%2!=1)
+    {
+        cout << "Incorrect window_size value: it should be positive and odd";
+        return -1;
+    }
+    if(pyr_levels<0 || pyr_levels>6)
+    {
+        cout << "Incorrect pyramid value: it should be between 0 and 6";
+        return -1;
+    }
+    int temporal = parser.get<int>("temporal"); //时域复用的关键帧间隔
+    if(temporal<0 || (temporal>0 && pyr_levels>1))
+    {
+        cout << "Incorrect temporal value: it should be >= 0 and cannot be combined with pyramid";
+        return -1;
+    }
+    if(strips<0 || (strips>0 && (video || temporal>0 || auto_range || parser.has("calib") || parser.has("match_cache") ||
+                                 parser.has("sweep_lambda") || parser.has("sweep_sigma") || parser.has("sweep_radius"))))
+    {
+        cout << "Incorrect strips value: it should be >= 0 and cannot be combined with video, temporal, auto_range, calib, match_cache or sweeps";
+        return -1;
+    }
+    if(algo=="census" && (wsize<3 || wsize>9))
+    {
+        cout << "Incorrect window_size value: census supports 3, 5, 7 or 9";
+        return -1;
+    }
+
+    if(parser.has("selective") && (filter != "wls_conf" || parser.get<int>("selective_tile") <= 0 ||
+                                   parser.get<int>("selective_margin") < 0))
+    {
+        cout << "Incorrect selective usage: it needs filter=wls_conf, a positive selective_tile and selective_margin >= 0";
+        return -1;
+    }
+
+    const double fill_lambda = parser.has("fill_lambda") ? parser.get<double>("fill_lambda") : lambda;
+    const int fill_iters = parser.has("fill_iters") ? parser.get<int>("fill_iters") : HOLE_FILL_ITERS;
+    if(parser.has("hole_fill") && (filter != "wls_no_conf" || fill_iters < 1 || fill_lambda <= 0.0))
+    {
+        cout << "Incorrect hole_fill usage: it needs filter=wls_no_conf, fill_iters >= 1 and a positive fill_lambda";
+        return -1;
+    }
+
+    if(rigs && (video || strips>0 || auto_range || parser.has("calib") || parser.has("match_cache") || show ||
+                parser.has("sweep_lambda") || parser.has("sweep_sigma") || parser.has("sweep_radius")))
+    {
+        cout << "Incorrect rigs usage: it cannot be combined with video, strips, auto_range, calib, match_cache, show or sweeps";
+        return -1;
+    }
+
+    if(dst_cloud != "None" && (!parser.has("calib") || strips>0 || rigs || (video && dst_cloud.find('%') == String::npos)))
+    {
+        cout << "Incorrect dst_cloud usage: it needs calib (for the Q matrix), a frame number pattern with video, and cannot be combined with strips or rigs";
+        return -1;
+    }
+    PointCloudOptions cloud_opts;
+    cloud_opts.color = !parser.has("cloud_no_color");
+    cloud_opts.min_conf = parser.get<double>("cloud_min_conf");
+    cloud_opts.max_depth = parser.get<double>("cloud_max_depth");
+
+    StereoRectifier rectifier;
+    if(parser.has("calib") && !rectifier.load(parser.get<String>("calib"), parser.get<String>("rect_cache"),
+                                              parser.get<double>("rect_alpha")))
+        return -1;
+
+    StereoFrame frame;
+    frame.index = 0;
+
+    if(!video && strips<=0 && !rigs)
+    {
+        //! [load_views]
+        Mat& left_in = rectifier.loaded() ? frame.left_in : frame.left;
+        Mat& right_in = rectifier.loaded() ? frame.right_in : frame.right;
+        TraceScope decode_scope("decode");
+        left_in  = imread(left_img, IMREAD_COLOR);
+        if ( left_in.empty() )
+        {
+            cout << "Cannot read image file: " << left_img;
+            return -1;
         }
-        else
+
+        right_in = imread(right_img, IMREAD_COLOR);
+        if ( right_in.empty() )
         {
-            cout << "Unsupported algorithm";
+            cout << "Cannot read image file: " << right_img;
             return -1;
         }
+        decode_scope.end();
+        //! [load_views]
 
-        wls_filter->setLambda(lambda);
-        wls_filter->setSigmaColor(sigma);
-        filtering_time = (double)getTickCount();
-        wls_filter->filter(left_disp, left, filtered_disp, Mat(), ROI);
-        filtering_time = ((double)getTickCount() - filtering_time) / getTickFrequency();
+        if(rectifier.loaded())
+        {
+            TraceScope rectify_scope("rectify");
+            double rect_time = (double)getTickCount();
+            if(!rectifier.rectify(frame.left_in, frame.right_in, frame.left, frame.right))
+                return -1;
+            rect_time = ((double)getTickCount() - rect_time) / getTickFrequency();
+            rectify_scope.end();
+            cout << "Rectification:  " << rect_time << "s (maps: " << rectifier.mapSource() << ")" << endl;
+        }
     }
-    else
+
+    // 范围在原图尺度上估计，之后与手动给出的范围一样按缩小匹配换算
+    if(auto_range)
     {
-        cout << "Unsupported filter";
-        return -1;
+        Mat first_l, first_r;
+        if(!video)
+            autoRange(frame.left, frame.right, min_disp, max_disp);
+        else if(readFirstPair(left_img, right_img, rectifier, first_l, first_r))
+            autoRange(first_l, first_r, min_disp, max_disp);
+        else
+            cout << "Disparity range: cannot read the first frame pair, keeping the configured range" << endl;
+    }
+    // 滤波后的视差总是原图尺度，点云按换算前的范围判断无效值
+    cloud_opts.min_disp = min_disp;
+    min_disp = matcherMinDisparity(min_disp, filter, no_downscale);
+    max_disp = matcherMaxDisparity(max_disp, filter, no_downscale);
+
+    StereoParams params;
+    params.algo = algo;
+    params.filter = filter;
+    params.no_downscale = no_downscale;
+    params.min_disp = min_disp;
+    params.max_disp = max_disp;
+    params.lambda = lambda;
+    params.sigma = sigma;
+    params.wsize = wsize;
+    params.left_threads = std::max(left_threads, 1);
+    params.right_threads = std::max(right_threads, 1);
+    params.pyr_levels = pyr_levels;
+    params.temporal = temporal;
+    params.temporal_radius = parser.get<int>("temporal_radius");
+    params.temporal_static = parser.get<double>("temporal_static");
+    params.temporal_diff = parser.get<double>("temporal_diff");
+    params.temporal_smooth = parser.get<double>("temporal_smooth");
+    params.selective = parser.has("selective");
+    params.hole_fill = parser.has("hole_fill");
+    params.fill_max_gap = parser.get<int>("fill_max_gap");
+    params.fill_iters = fill_iters;
+    if(params.hole_fill)
+        params.lambda = fill_lambda;
+    params.selective_params.tile = parser.get<int>("selective_tile");
+    params.selective_params.margin = parser.get<int>("selective_margin");
+    params.selective_params.halo = parser.get<int>("selective_halo");
+    params.selective_params.max_fraction = parser.get<double>("selective_max");
+
+    // 持续处理同尺寸帧的模式：释放的Mat缓冲区留给下一帧（或下一个条带）复用
+    const double pool_mb = parser.get<double>("buffer_pool_mb");
+    if((video || rigs || strips>0) && pool_mb > 0.0)
+        installBufferPool(pool_mb);
+
+    if(strips>0)
+    {
+        if(dst_conf_path != "None")
+            cout << "dst_conf_path is not written in strip mode" << endl;
+        StripOptions strip_opts;
+        strip_opts.rows = strips;
+        strip_opts.overlap = parser.get<int>("strip_overlap");
+        strip_opts.workers = parser.get<int>("strip_workers");
+        return runStrips(params, left_img, right_img, dst_path, dst_raw_path, strip_opts);
     }
 
+    if(rigs)
+    {
+        RigSchedulerOptions rig_opts;
+        rig_opts.threads = parser.get<int>("pool_threads");
+        rig_opts.cv_threads = parser.get<int>("cv_threads");
+        rig_opts.queue_depth = queue_depth;
+        rig_opts.max_frames = max_frames;
+        return runRigs(params, parser.get<String>("rigs"), rig_opts);
+    }
+
+    StereoContext ctx;
+    if(!createStereoContext(params, ctx))
+        return -1;
+
+    if(video)
+        return runStream(ctx, left_img, right_img, dst_path, max_frames, queue_depth, show, rectifier, dst_cloud, cloud_opts);
+
+    const String cache_dir = parser.get<String>("match_cache");
+    if(parser.has("sweep_lambda") || parser.has("sweep_sigma") || parser.has("sweep_radius"))
+        return runSweep(ctx, frame, parser, cache_dir, left_img, right_img, rectifier);
+
+    matchCached(ctx, frame, cache_dir, left_img, right_img, rectifier);
+    filterFrame(ctx, frame);
+
     // 收集并打印所有统计数据:
     cout.precision(3);
-    cout << "Matching time:  " << matching_time<< "s" << endl;
-    cout << "Filtering time: " << filtering_time<< "s" << endl;
+    cout << "Matching time:  " << frame.matching_time<< "s" << endl;
+    if(ctx.use_conf && (!ctx.census || ctx.params.pyr_levels > 1 || ctx.temporal))
+    {
+        cout << "  left matcher:  " << frame.left_matching_time << "s" << endl;
+        cout << "  right matcher: " << frame.right_matching_time << "s" << endl;
+    }
+    if(params.pyr_levels > 1)
+        cout << "  pyramid search: " << ctx.left_pyr.getSearchFraction() * 100.0 << "% of the full cost volume" << endl;
+    cout << "Filtering time: " << frame.filtering_time<< "s" << endl;
+    if(params.selective)
+    {
+        if(frame.refined_regions >= 0)
+            cout << "  selective: " << frame.refined_regions << " regions, " << ctx.selective.refined_fraction * 100.0
+                 << "% of the image solved (" << ctx.selective.low_fraction * 100.0 << "% low confidence)" << endl;
+        else
+            cout << "  selective: " << ctx.selective.refined_fraction * 100.0 << "% of the image would be solved, filtered whole" << endl;
+    }
     cout<<endl;
 
+    TraceScope encode_scope("encode");
     if(dst_path != "None")
     {
-        imwrite(dst_path, filtered_disp);
+        imwrite(dst_path, frame.filtered_disp);
     }
     if(dst_raw_path != "None")
     {
-        imwrite(dst_raw_path, left_disp);
+        imwrite(dst_raw_path, frame.raw_disp);
     }
     if(dst_conf_path != "None")
     {
-        imwrite(dst_conf_path, conf_map);
+        imwrite(dst_conf_path, frame.conf_map);
     }
+    encode_scope.end();
+    if(dst_cloud != "None")
+    {
+        double cloud_time = (double)getTickCount();
+        long long points = 0;
+        if(!writePointCloud(dst_cloud, frame.filtered_disp, rectifier.reprojection(), frame.left, frame.conf_map, frame.ROI,
+                            cloud_opts, &points))
+            return -1;
+        cloud_time = ((double)getTickCount() - cloud_time) / getTickFrequency();
+        cout << "Point cloud:    " << points << " points in " << cloud_time << "s, saved to: " << dst_cloud << endl;
+    }
+    trace.finish();
 
    // imshow("left", left);
    // imshow("right", right);
 
     Mat raw_disp_vis;
     //getDisparityVis(left_disp, raw_disp_vis);
-    left_disp.convertTo(raw_disp_vis, CV_8U, 0.3);
+    frame.raw_disp.convertTo(raw_disp_vis, CV_8U, 0.3);
     imshow("raw disparity", raw_disp_vis);
 
     Mat filtered_disp_vis;
     //getDisparityVis(filtered_disp, filtered_disp_vis);
-    filtered_disp.convertTo(filtered_disp_vis, CV_8U, 1);
+    frame.filtered_disp.convertTo(filtered_disp_vis, CV_8U, 1);
     imshow("filtered disparity", filtered_disp_vis);
     waitKey(0);
 
     return 0;
 }
-
-Rect computeROI(Size2i src_sz, Ptr<StereoMatcher> matcher_instance)
-{
-    int min_disparity = matcher_instance->getMinDisparity();
-    int num_disparities = matcher_instance->getNumDisparities();
-    int block_size = matcher_instance->getBlockSize();
-
-    int bs2 = block_size / 2;
-    int minD = min_disparity;
-    int maxD = min_disparity + num_disparities - 1;
-
-    int xmin = maxD + bs2;
-    int xmax = src_sz.width + minD - bs2;
-    int ymin = bs2;
-    int ymax = src_sz.height - bs2;
-
-    Rect r(xmin, ymin, xmax - xmin, ymax - ymin);
-    return r;
-}
-
@@ -1,110 +1,123 @@
-#include "opencv2/calib3d.hpp"
-#include "opencv2/imgproc.hpp"
-#include "opencv2/imgcodecs.hpp"
 #include "opencv2/core/utility.hpp"
-#include "opencv2/ximgproc/disparity_filter.hpp"
+#include "depth_io.hpp"
+#include "depth_batch.hpp"
+#include "buffer_pool.hpp"
+#include "depth_filters.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <string>
+#include <vector>
 
 using namespace cv;
-using namespace cv::ximgproc;
 using namespace std;
 
-// Helper to convert any depth image to single-channel CV_32F
-static bool loadDepthAsFloat(const String &path, Mat &depth32f) {
-    Mat src = imread(path, IMREAD_UNCHANGED);
-    if (src.empty()) {
-        cerr << "Cannot read depth file: " << path << endl;
-        return false;
-    }
-    Mat single;
-    if (src.channels() == 1) {
-        single = src;
-    } else if (src.channels() == 3) {
-        cvtColor(src, single, COLOR_BGR2GRAY);
-    } else if (src.channels() == 4) {
-        cvtColor(src, single, COLOR_BGRA2GRAY);
-    } else {
-        Mat ch0; extractChannel(src, ch0, 0); single = ch0;
-    }
-
-    switch (single.depth()) {
-        case CV_8U:  single.convertTo(depth32f, CV_32F, 1.0);                 break;
-        case CV_16U: single.convertTo(depth32f, CV_32F, 1.0);                 break;
-        case CV_16S: single.convertTo(depth32f, CV_32F, 1.0);                 break;
-        case CV_32S: single.convertTo(depth32f, CV_32F, 1.0);                 break;
-        case CV_32F: depth32f = single;                                       break;
-        case CV_64F: single.convertTo(depth32f, CV_32F, 1.0);                 break;
-        default:
-            cerr << "Unsupported depth type: depth=" << single.depth() << endl;
-            return false;
-    }
-    return true;
-}
-
-// Save float depth back to original-like type
-static bool saveDepthLike(const Mat &depth32f, const String &outPath, int likeDepth) {
-    Mat out;
-    switch (likeDepth) {
-        case CV_8U:  depth32f.convertTo(out, CV_8U);  break;
-        case CV_16U: depth32f.convertTo(out, CV_16U); break;
-        case CV_16S: depth32f.convertTo(out, CV_16S); break;
-        case CV_32S: depth32f.convertTo(out, CV_32S); break;
-        case CV_32F: out = depth32f.clone();          break;
-        case CV_64F: depth32f.convertTo(out, CV_64F); break;
-        default:     cerr << "Unsupported output type" << endl; return false;
-    }
-    return imwrite(outPath, out);
-}
+// 位置参数之外的可选项；位置参数保持原有用法：only_wls [depth_path|dir|list.txt] [out_path|out_dir]
+const String keys =
+    "{help h usage ? |     | print this message                                               }"
+    "{workers        |0    | batch mode: filtering threads (0 = number of CPUs)               }"
+    "{io_threads     |2    | batch mode: decode threads and encode threads                    }"
+    "{in_flight      |0    | batch mode: max files held in memory (0 = auto)                  }"
+    "{out_ext        |     | batch mode: output extension, e.g. .rdm for raw mapped depth (default: same as input) }"
+    "{buffer_pool_mb |512  | batch mode: cap on idle Mat buffers kept for reuse by later files (0 = off) }"
+    "{tile           |0    | filter in parallel tiles of this size (0 = whole image at once)  }"
+    "{halo           |-1   | extra pixels filtered around each tile (-1 = 2*sqrt(lambda)+radius) }"
+    "{scale          |1    | solve WLS at 1/scale resolution, then upsample guided by the full-res guide (1 = full res) }"
+    "{upsample       |guided | upsampling after a low-res solve: guided or joint_bilateral       }"
+    "{compare        |     | single file: also run the full-res solve and print speedup and difference }"
+    "{fixed_point    |     | filter through CV_16S fixed point as before (depth above 2047 saturates) }"
+    "{trace          |     | write per-stage Chrome trace-event JSON to this file and print a time/allocation/RSS summary }"
+    ;
 
 int main(int argc, char** argv) {
     // Inputs
-    String depth_path = "../depth.png";     
+    String depth_path = "../depth.png";
     String out_path   = "../depth_filtered.png"; // 输出滤波后深度图（类型同输入）
 
     // Parameters
-    double lambda = 20000.0; // 平滑强度（越大越平滑）
-    double sigma  = 0.5;    // 颜色/引导相似性（这里我们用深度自身归一化为引导）
-    int wsize     = 15;     // 影响不连续半径
+    DepthWLS wls;
+    wls.lambda = 20000.0; // 平滑强度（越大越平滑）
+    wls.sigma  = 0.5;     // 颜色/引导相似性（这里我们用深度自身归一化为引导）
+    wls.wsize  = 15;      // 影响不连续半径
 
-    if (argc >= 2) depth_path = argv[1];
-    if (argc >= 3) out_path   = argv[2];
-
-    // 将深度作为浮点数加载
-    Mat depth32f;
-    if (!loadDepthAsFloat(depth_path, depth32f)) return -1;
-    int inputDepthType = imread(depth_path, IMREAD_UNCHANGED).depth();
+    CommandLineParser parser(argc, argv, keys);
+    parser.about("Usage: only_wls [depth_path|dir|list.txt] [out_path|out_dir] [--workers=N]");
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    TraceSession trace(parser.get<String>("trace"));
 
-    // 可选的预滤波，减少斑点
-    medianBlur(depth32f, depth32f, 3);
+    // 位置参数：跳过--开头的可选项
+    vector<String> args;
+    for (int i = 1; i < argc; i++)
+        if (String(argv[i]).compare(0, 2, "--") != 0) args.push_back(argv[i]);
+    if (args.size() >= 1) depth_path = args[0];
+    if (args.size() >= 2) out_path   = args[1];
 
-    // 从深度自身构建引导图（归一化为8U）
-    Mat guide8u;
-    double minV=0.0, maxV=0.0; minMaxLoc(depth32f, &minV, &maxV);
-    if (maxV - minV < 1e-6) {
-        guide8u = Mat(depth32f.size(), CV_8U, Scalar(128));
-    } else {
-        Mat guideFloat;
-        normalize(depth32f, guideFloat, 0, 255, NORM_MINMAX);
-        guideFloat.convertTo(guide8u, CV_8U);
+    wls.tiled.tile = parser.get<int>("tile");
+    wls.tiled.halo = parser.get<int>("halo");
+    wls.fixed_point = parser.has("fixed_point");
+    wls.lowres.factor = parser.get<int>("scale");
+    if (wls.lowres.factor < 1 || !parseUpsample(parser.get<String>("upsample"), wls.lowres.upsample)) {
+        cerr << "Incorrect scale/upsample: scale >= 1, upsample is guided or joint_bilateral" << endl;
+        return -1;
     }
 
-    // 将深度映射到WLS期望的CV_16S域（使用固定比例保持行为稳定）
-    const double s = 16.0; // mimic disparity fixed-point scale
-    Mat depth16s; depth32f.convertTo(depth16s, CV_16S, s);
+    if (isDepthBatchInput(depth_path)) {
+        // 批处理：输入为目录或文件列表，输出为目录
+        vector<String> files;
+        if (!listDepthInputs(depth_path, files)) return -1;
 
-    // 应用WLS
-    Ptr<DisparityWLSFilter> wls = createDisparityWLSFilterGeneric(false);
-    wls->setLambda(lambda);
-    wls->setSigmaColor(sigma);
-    wls->setDepthDiscontinuityRadius((int)ceil(0.33 * wsize));
+        DepthBatchOptions opts;
+        opts.workers    = parser.get<int>("workers");
+        opts.io_threads = parser.get<int>("io_threads");
+        opts.in_flight  = parser.get<int>("in_flight");
+        opts.out_ext    = parser.get<String>("out_ext");
+        if (parser.get<double>("buffer_pool_mb") > 0.0)
+            installBufferPool(parser.get<double>("buffer_pool_mb")); // 同尺寸的文件复用前一个文件释放的缓冲区
 
-    Mat filtered16s;
-    Rect ROI(0, 0, depth16s.cols, depth16s.rows);
-    wls->filter(depth16s, guide8u, filtered16s, Mat(), ROI);
+        DepthBatchStats stats;
+        bool ok = runDepthBatch(files, out_path, [&]() -> DepthFilterFn {
+            // 每个工作线程一个滤波器实例
+            Ptr<DepthWLS> f = makePtr<DepthWLS>(wls);
+            f->init();
+            return [f](const Mat& src, Mat& dst) { return f->apply(src, dst); };
+        }, opts, stats);
+        printDepthBatchStats(stats);
+        return ok ? 0 : -1;
+    }
 
-    // 转换回原始数值比例/类型
-    Mat filtered32f; filtered16s.convertTo(filtered32f, CV_32F, 1.0/s);
+    // 按原始位深加载（只解码一次，.rdm直接映射），类型转换并入滤波前的融合预处理
+    Mat depth;
+    MappedDepth mapped;
+    int inputDepthType = -1;
+    if (!loadDepthUnconverted(depth_path, depth, mapped, inputDepthType)) return -1;
+
+    wls.init();
+    Mat filtered32f;
+    int64 t0 = getTickCount();
+    wls.apply(depth, filtered32f);
+    const double ms = (getTickCount() - t0) * 1000.0 / getTickFrequency();
+
+    if (parser.has("compare") && wls.lowres.factor > 1) {
+        // 同一输入上的原尺寸求解作为参照
+        DepthWLS full = wls;
+        full.lowres.factor = 1;
+        full.init();
+        Mat reference32f;
+        t0 = getTickCount();
+        TraceScope reference_scope("filter_reference"); // 内部阶段仍按各自的名字记录
+        full.apply(depth, reference32f);
+        reference_scope.end();
+        const double full_ms = (getTickCount() - t0) * 1000.0 / getTickFrequency();
+        const DepthDiff d = compareDepth(filtered32f, reference32f);
+        cout << "Full-res WLS: " << full_ms << " ms, 1/" << wls.lowres.factor << " WLS + upsampling: " << ms
+             << " ms (" << full_ms / std::max(ms, 1e-3) << "x)" << endl;
+        cout << "Difference to full-res: mean " << d.mae << ", p99 " << d.p99 << ", max " << d.max_abs
+             << " (depth units)" << endl;
+    } else {
+        cout << "Filtering time: " << ms << " ms" << endl;
+    }
 
     if (!saveDepthLike(filtered32f, out_path, inputDepthType)) {
         cerr << "Failed to save: " << out_path << endl;
@@ -0,0 +1,261 @@
+#include "point_cloud.hpp"
+#include "trace.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <emmintrin.h>
+#define CLOUD_X86 1
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <emmintrin.h>
+#define CLOUD_X86 1
+#else
+#define CLOUD_X86 0
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace
+{
+
+bool isPlyPath(const String& path)
+{
+    size_t dot = path.find_last_of('.');
+    if(dot == String::npos)
+        return false;
+    String ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".ply";
+}
+
+bool littleEndian()
+{
+    const unsigned short one = 1;
+    return *(const uchar*)&one == 1;
+}
+
+// 一行的输入和换算常数。X、Y、Z、W的第k个分量 = qx[k] * x + qd[k] * d + qb[k]（qb已含该行的y）
+struct RowInput
+{
+    const short* disp;
+    const uchar* color;
+    int cn;
+    const uchar* conf8;
+    const float* conf32;
+    short min_d;
+    float min_conf, zmax;
+    float qx[4], qd[4], qb[4];
+};
+
+// 通过检查的点写成一条记录：float x y z，有颜色时再加r g b
+static inline int emitPoint(const RowInput& in, int x, float X, float Y, float Z, uchar* out)
+{
+    if(in.disp[x] < in.min_d)
+        return 0;
+    if(!(Z > 0.f && Z <= in.zmax)) // 同时排除W为0得到的inf/NaN
+        return 0;
+    if((in.conf8 && in.conf8[x] < in.min_conf) || (in.conf32 && in.conf32[x] < in.min_conf))
+        return 0;
+    const float xyz[3] = { X, Y, Z };
+    memcpy(out, xyz, sizeof(xyz));
+    if(in.color)
+    {
+        const uchar* c = in.color + x * in.cn;
+        out[12] = c[in.cn == 3 ? 2 : 0];
+        out[13] = c[in.cn == 3 ? 1 : 0];
+        out[14] = c[0];
+        return 15;
+    }
+    return 12;
+}
+
+// 转换[x0, x1)，记录连续写到out，返回点数
+static int convertRow(const RowInput& in, int x0, int x1, uchar* out)
+{
+    uchar* p = out;
+    int x = x0;
+#if CLOUD_X86
+    const __m128 scale = _mm_set1_ps(1.f / 16.f), four = _mm_set1_ps(4.f), one = _mm_set1_ps(1.f);
+    const __m128 qx0 = _mm_set1_ps(in.qx[0]), qx1 = _mm_set1_ps(in.qx[1]), qx2 = _mm_set1_ps(in.qx[2]), qx3 = _mm_set1_ps(in.qx[3]);
+    const __m128 qd0 = _mm_set1_ps(in.qd[0]), qd1 = _mm_set1_ps(in.qd[1]), qd2 = _mm_set1_ps(in.qd[2]), qd3 = _mm_set1_ps(in.qd[3]);
+    const __m128 qb0 = _mm_set1_ps(in.qb[0]), qb1 = _mm_set1_ps(in.qb[1]), qb2 = _mm_set1_ps(in.qb[2]), qb3 = _mm_set1_ps(in.qb[3]);
+    __m128 xs = _mm_setr_ps((float)x, (float)(x + 1), (float)(x + 2), (float)(x + 3));
+    float px[4], py[4], pz[4];
+    for(; x <= x1 - 4; x += 4)
+    {
+        // 16位视差符号扩展到32位后转为浮点像素
+        const __m128i d16 = _mm_loadl_epi64((const __m128i*)(in.disp + x));
+        const __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(d16, d16), 16)), scale);
+        const __m128 X = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx0, xs), _mm_mul_ps(qd0, d)), qb0);
+        const __m128 Y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx1, xs), _mm_mul_ps(qd1, d)), qb1);
+        const __m128 Z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx2, xs), _mm_mul_ps(qd2, d)), qb2);
+        const __m128 W = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx3, xs), _mm_mul_ps(qd3, d)), qb3);
+        const __m128 inv = _mm_div_ps(one, W);
+        _mm_storeu_ps(px, _mm_mul_ps(X, inv));
+        _mm_storeu_ps(py, _mm_mul_ps(Y, inv));
+        _mm_storeu_ps(pz, _mm_mul_ps(Z, inv));
+        for(int i = 0; i < 4; i++)
+            p += emitPoint(in, x + i, px[i], py[i], pz[i], p);
+        xs = _mm_add_ps(xs, four);
+    }
+#endif
+    for(; x < x1; x++)
+    {
+        const float fx = (float)x, d = in.disp[x] * (1.f / 16.f);
+        const float inv = 1.f / (in.qx[3] * fx + in.qd[3] * d + in.qb[3]);
+        p += emitPoint(in, x, (in.qx[0] * fx + in.qd[0] * d + in.qb[0]) * inv, (in.qx[1] * fx + in.qd[1] * d + in.qb[1]) * inv,
+                       (in.qx[2] * fx + in.qd[2] * d + in.qb[2]) * inv, p);
+    }
+    return (int)(p - out);
+}
+
+} // namespace
+
+PointCloudWriter::PointCloudWriter() : file(0), ply(false), count_offset(0), count(0), failed(false)
+{
+}
+
+PointCloudWriter::~PointCloudWriter()
+{
+    if(file)
+        close();
+}
+
+bool PointCloudWriter::open(const String& path, const Mat& Q, const PointCloudOptions& _opts)
+{
+    if(file)
+        close();
+    if(Q.rows != 4 || Q.cols != 4 || Q.channels() != 1)
+    {
+        cerr << "Point cloud needs the 4x4 reprojection matrix Q" << endl;
+        return false;
+    }
+    Mat qf;
+    Q.convertTo(qf, CV_32F);
+    q = Matx44f(qf.ptr<float>());
+
+    file = fopen(path.c_str(), "wb");
+    if(!file)
+    {
+        cerr << "Cannot write point cloud: " << path << endl;
+        return false;
+    }
+    io_buf.resize(1 << 20);
+    setvbuf(file, &io_buf[0], _IOFBF, io_buf.size());
+
+    opts = _opts;
+    ply = isPlyPath(path);
+    count = 0;
+    failed = false;
+    if(ply)
+    {
+        fprintf(file, "ply\nformat %s 1.0\nelement vertex ", littleEndian() ? "binary_little_endian" : "binary_big_endian");
+        count_offset = ftell(file);
+        // 固定宽度的占位，close时原地覆盖
+        fprintf(file, "%010lld\nproperty float x\nproperty float y\nproperty float z\n", 0LL);
+        if(opts.color)
+            fprintf(file, "property uchar red\nproperty uchar green\nproperty uchar blue\n");
+        fprintf(file, "end_header\n");
+        failed = ferror(file) != 0;
+    }
+    return !failed;
+}
+
+bool PointCloudWriter::write(int y0, const Mat& disp, const Mat& color, const Mat& conf, Rect roi)
+{
+    if(!file || failed)
+        return false;
+    CV_Assert(disp.type() == CV_16S);
+    if(opts.color && (color.size() != disp.size() || (color.type() != CV_8UC3 && color.type() != CV_8UC1)))
+    {
+        cerr << "PointCloudWriter: color must be 8-bit gray or BGR of the disparity size" << endl;
+        failed = true;
+        return false;
+    }
+    if(!conf.empty() && (conf.size() != disp.size() || (conf.type() != CV_8U && conf.type() != CV_32F)))
+    {
+        cerr << "PointCloudWriter: confidence must be CV_8U or CV_32F of the disparity size" << endl;
+        failed = true;
+        return false;
+    }
+
+    // 空的roi表示整幅有效
+    const Rect rows_rect(0, y0, disp.cols, disp.rows);
+    const Rect r = roi.area() > 0 ? (roi & rows_rect) : rows_rect;
+    if(r.area() <= 0)
+        return true;
+
+    const int chunk = std::max(opts.chunk_rows, 1);
+    const size_t record = opts.color ? 15 : 12;
+    const size_t row_bytes = (size_t)disp.cols * record;
+    records.resize(chunk * row_bytes);
+    row_counts.resize(chunk);
+    const float zmax = opts.max_depth > 0.0 ? (float)opts.max_depth : FLT_MAX;
+
+    TraceScope scope("cloud");
+    for(int c0 = r.y; c0 < r.y + r.height && !failed; c0 += chunk)
+    {
+        const int c1 = std::min(c0 + chunk, r.y + r.height);
+        parallel_for_(Range(c0, c1), [&](const Range& range)
+        {
+            for(int y = range.start; y < range.end; y++)
+            {
+                const int ly = y - y0;
+                RowInput in;
+                in.disp = disp.ptr<short>(ly);
+                in.color = opts.color ? color.ptr<uchar>(ly) : 0;
+                in.cn = color.channels();
+                in.conf8 = conf.type() == CV_8U && !conf.empty() ? conf.ptr<uchar>(ly) : 0;
+                in.conf32 = conf.type() == CV_32F && !conf.empty() ? conf.ptr<float>(ly) : 0;
+                in.min_d = saturate_cast<short>(opts.min_disp * 16);
+                in.min_conf = (float)opts.min_conf;
+                in.zmax = zmax;
+                for(int k = 0; k < 4; k++)
+                {
+                    in.qx[k] = q(k, 0);
+                    in.qd[k] = q(k, 2);
+                    in.qb[k] = q(k, 1) * (float)y + q(k, 3);
+                }
+                row_counts[y - c0] = convertRow(in, r.x, r.x + r.width, &records[(y - c0) * row_bytes]) / (int)record;
+            }
+        });
+        for(int y = c0; y < c1 && !failed; y++)
+        {
+            const size_t n = row_counts[y - c0];
+            if(n > 0)
+                failed = fwrite(&records[(y - c0) * row_bytes], record, n, file) != n;
+            count += n;
+        }
+    }
+    if(failed)
+        cerr << "Cannot write point cloud records" << endl;
+    return !failed;
+}
+
+bool PointCloudWriter::close()
+{
+    if(!file)
+        return false;
+    bool ok = !failed;
+    if(ok && ply)
+        ok = fseek(file, count_offset, SEEK_SET) == 0 && fprintf(file, "%010lld", count) == 10;
+    ok = (fclose(file) == 0) && ok;
+    file = 0;
+    if(!ok)
+        cerr << "Cannot finish point cloud file" << endl;
+    return ok;
+}
+
+bool writePointCloud(const String& path, const Mat& disp, const Mat& Q, const Mat& color, const Mat& conf, Rect roi,
+                     const PointCloudOptions& opts, long long* points)
+{
+    PointCloudWriter writer;
+    const bool ok = writer.open(path, Q, opts) && writer.write(0, disp, color, conf, roi) && writer.close();
+    if(points)
+        *points = writer.points();
+    return ok;
+}
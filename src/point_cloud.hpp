@@ -0,0 +1,66 @@
+#ifndef DISPARITY_POINT_CLOUD_HPP
+#define DISPARITY_POINT_CLOUD_HPP
+
+#include "opencv2/core.hpp"
+#include <cstdio>
+#include <vector>
+
+// 由滤波后的视差直接重投影得到点云并写出，不经过8位可视化图像。
+// 输入为CV_16S的x16定点视差，按[X Y Z W] = Q * [x y d 1]换算（与reprojectImageTo3D相同），
+// 每次转换chunk_rows行：行内SSE2一次算4个像素，行之间parallel_for_并行，转换完的记录立即写盘，
+// 内存中只有一个行块的记录，点云本身不会整个留在内存里。
+//
+// 跳过的像素：ROI之外、视差低于min_disp*16（匹配器的无效值(min_disp-1)*16，min_disp>0时它也是正数）、
+// 置信度低于min_conf、W为0或Z不在(0, max_depth]内（点在相机后方）。
+//
+// 格式由扩展名决定：
+//   .ply  binary PLY（主机字节序），顶点属性float x y z，有颜色时再加uchar red green blue；
+//         顶点数在文件头中先占位，close时回写
+//   其余  没有文件头的原始记录流，每点的布局与PLY顶点相同（12字节，有颜色时15字节）
+struct PointCloudOptions
+{
+    bool color;        // 每点附带左视图的颜色
+    double min_conf;   // 置信度图的阈值（0..255）
+    double max_depth;  // Z的上限，单位与标定的T相同，<=0表示不限
+    int chunk_rows;    // 每次转换并写出的行数
+    int min_disp;      // 输出视差尺度上的minDisparity
+
+    PointCloudOptions() : color(true), min_conf(1.0), max_depth(0.0), chunk_rows(64), min_disp(0) {}
+};
+
+class PointCloudWriter
+{
+public:
+    PointCloudWriter();
+    ~PointCloudWriter();
+
+    // Q为4x4重投影矩阵（StereoRectifier::reprojection）
+    bool open(const cv::String& path, const cv::Mat& Q, const PointCloudOptions& opts);
+    // disp为整幅视差中从第y0行开始的若干行（y0决定Q中的y坐标）；color为对应的CV_8UC3/CV_8UC1行，
+    // 不写颜色时可为空；conf为对应的CV_8U/CV_32F置信度行，可为空；roi为整幅坐标中的有效区域
+    bool write(int y0, const cv::Mat& disp, const cv::Mat& color, const cv::Mat& conf, cv::Rect roi);
+    bool close();
+
+    long long points() const { return count; }
+
+private:
+    PointCloudWriter(const PointCloudWriter&);
+    PointCloudWriter& operator=(const PointCloudWriter&);
+
+    FILE* file;
+    std::vector<char> io_buf;
+    std::vector<uchar> records; // 一个行块的记录，每行在width * record_size的位置开始
+    std::vector<int> row_counts;
+    cv::Matx44f q;
+    PointCloudOptions opts;
+    bool ply;
+    long count_offset;          // PLY文件头中顶点数占位的位置
+    long long count;
+    bool failed;
+};
+
+// 整幅视差写出，points非空时返回写出的点数
+bool writePointCloud(const cv::String& path, const cv::Mat& disp, const cv::Mat& Q, const cv::Mat& color,
+                     const cv::Mat& conf, cv::Rect roi, const PointCloudOptions& opts, long long* points = 0);
+
+#endif
@@ -0,0 +1,211 @@
+#include "raw_depth.hpp"
+#include "depth_io.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RAW_DEPTH_MMAP 1
+#else
+#define RAW_DEPTH_MMAP 0
+#endif
+
+using namespace cv;
+using namespace std;
+
+static const char RAW_DEPTH_MAGIC[8] = { 'R', 'A', 'W', 'D', 'E', 'P', 'T', 'H' };
+
+bool isRawDepthPath(const String& path)
+{
+    size_t dot = path.find_last_of('.');
+    if (dot == String::npos) return false;
+    String ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".rdm";
+}
+
+// 文件头自洽且文件足够长
+static bool checkHeader(const RawDepthHeader& h, size_t file_size, const String& path)
+{
+    if (file_size < sizeof(RawDepthHeader) || memcmp(h.magic, RAW_DEPTH_MAGIC, sizeof(h.magic)) != 0 || h.version != 1) {
+        cerr << "Not a raw depth file: " << path << endl;
+        return false;
+    }
+    if (h.width <= 0 || h.height <= 0 || h.type < 0 || h.type != CV_MAT_TYPE(h.type) || CV_MAT_DEPTH(h.type) > CV_64F ||
+        h.data_offset < sizeof(RawDepthHeader) ||
+        h.data_size != (unsigned long long)h.width * h.height * CV_ELEM_SIZE(h.type) ||
+        h.data_offset + h.data_size > file_size) {
+        cerr << "Corrupt or truncated raw depth file: " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+MappedDepth::MappedDepth() : base(0), length(0)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+MappedDepth::~MappedDepth()
+{
+    close();
+}
+
+void MappedDepth::close()
+{
+    view.release();
+#if RAW_DEPTH_MMAP
+    if (base) munmap(base, length);
+#endif
+    base = 0;
+    length = 0;
+    vector<uchar>().swap(fallback);
+}
+
+bool MappedDepth::open(const String& path)
+{
+    close();
+    const uchar* data = 0;
+#if RAW_DEPTH_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Cannot read depth file: " << path << endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        cerr << "Cannot read depth file: " << path << endl;
+        return false;
+    }
+    length = (size_t)st.st_size;
+    void* p = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // 映射建立后文件描述符不再需要
+    if (p == MAP_FAILED) {
+        length = 0;
+        cerr << "Cannot map depth file: " << path << endl;
+        return false;
+    }
+    base = p;
+    // 通常会顺序读完整幅图，提示内核预读
+    madvise(base, length, MADV_SEQUENTIAL);
+    madvise(base, length, MADV_WILLNEED);
+    data = (const uchar*)base;
+#else
+    if (!readFileBytes(path, fallback) || fallback.empty()) {
+        cerr << "Cannot read depth file: " << path << endl;
+        return false;
+    }
+    length = fallback.size();
+    data = &fallback[0];
+#endif
+    memcpy(&header, data, std::min(length, sizeof(header)));
+    if (!checkHeader(header, length, path)) {
+        close();
+        return false;
+    }
+    view = Mat(header.height, header.width, header.type, (void*)(data + header.data_offset));
+    return true;
+}
+
+void MappedDepth::evictRows(int y0, int y1)
+{
+#if RAW_DEPTH_MMAP
+    if (!base || view.empty()) return;
+    y0 = std::max(y0, 0);
+    y1 = std::min(y1, view.rows);
+    if (y0 >= y1) return;
+    // 只能按整页丢弃：起点向上、终点向下对齐到页边界，部分覆盖的页保留
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t begin = (size_t)(view.ptr(y0) - (const uchar*)base);
+    const size_t end = (size_t)(view.ptr(y1 - 1) - (const uchar*)base) + view.step[0];
+    const size_t a = (begin + page - 1) / page * page, b = end / page * page;
+    if (a < b)
+        madvise((char*)base + a, b - a, MADV_DONTNEED);
+#else
+    (void)y0;
+    (void)y1;
+#endif
+}
+
+RawDepthWriter::RawDepthWriter() : file(0), type(0), rows_written(0), failed(false)
+{
+}
+
+RawDepthWriter::~RawDepthWriter()
+{
+    if (file) close();
+}
+
+bool RawDepthWriter::open(const String& path, Size _size, int _type, double scale)
+{
+    if (file) close();
+    CV_Assert(_size.width > 0 && _size.height > 0);
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        cerr << "Cannot write depth file: " << path << endl;
+        return false;
+    }
+    // 较大的stdio缓冲区，小条带也按大块写盘
+    io_buf.resize(1 << 20);
+    setvbuf(file, &io_buf[0], _IOFBF, io_buf.size());
+
+    size = _size;
+    type = _type;
+    rows_written = 0;
+    failed = false;
+
+    RawDepthHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, RAW_DEPTH_MAGIC, sizeof(h.magic));
+    h.version = 1;
+    h.data_offset = sizeof(RawDepthHeader);
+    h.width = size.width;
+    h.height = size.height;
+    h.type = type;
+    h.scale = scale;
+    h.data_size = (unsigned long long)size.width * size.height * CV_ELEM_SIZE(type);
+    failed = fwrite(&h, sizeof(h), 1, file) != 1;
+    return !failed;
+}
+
+bool RawDepthWriter::write(const Mat& rows)
+{
+    if (!file || failed) return false;
+    CV_Assert(rows.cols == size.width && rows.type() == type);
+    if (rows_written + rows.rows > size.height) {
+        cerr << "RawDepthWriter: more rows than declared in the header" << endl;
+        failed = true;
+        return false;
+    }
+    const size_t row_bytes = (size_t)size.width * CV_ELEM_SIZE(type);
+    if (rows.isContinuous()) {
+        failed = fwrite(rows.data, row_bytes, rows.rows, file) != (size_t)rows.rows;
+    } else {
+        for (int y = 0; y < rows.rows && !failed; y++)
+            failed = fwrite(rows.ptr(y), row_bytes, 1, file) != 1;
+    }
+    if (!failed) rows_written += rows.rows;
+    return !failed;
+}
+
+bool RawDepthWriter::close()
+{
+    if (!file) return false;
+    bool ok = !failed && rows_written == size.height;
+    if (!failed && rows_written != size.height)
+        cerr << "RawDepthWriter: " << rows_written << " of " << size.height << " rows written" << endl;
+    ok = (fclose(file) == 0) && ok;
+    file = 0;
+    return ok;
+}
+
+bool writeRawDepth(const String& path, const Mat& depth, double scale)
+{
+    RawDepthWriter writer;
+    return writer.open(path, depth.size(), depth.type(), scale) && writer.write(depth) && writer.close();
+}
@@ -0,0 +1,87 @@
+#ifndef DISPARITY_RAW_DEPTH_HPP
+#define DISPARITY_RAW_DEPTH_HPP
+
+#include "opencv2/core.hpp"
+#include <cstdio>
+#include <vector>
+
+// .rdm原始深度容器：64字节文件头之后紧跟按行紧密排列的像素数据（小端），没有压缩和编解码。
+// 数据区从文件偏移64开始，读取时直接mmap，按cv::Mat头访问；写入时逐行追加。
+// 类型为任意OpenCV类型（CV_16UC1、CV_32FC1等），读写保持原样。
+// scale为每个存储单位对应的物理量（例如毫米深度存为CV_16U时取0.001表示米），仅作为元数据保存，读写都不改变像素值。
+struct RawDepthHeader
+{
+    char magic[8];          // "RAWDEPTH"
+    unsigned int version;   // 1
+    unsigned int data_offset; // 数据区偏移，当前为sizeof(RawDepthHeader)
+    int width, height;
+    int type;               // OpenCV类型
+    unsigned int reserved0;
+    double scale;
+    unsigned long long data_size; // width*height*elemSize
+    unsigned char reserved[16];
+};
+
+// 路径扩展名为.rdm时使用原始格式
+bool isRawDepthPath(const cv::String& path);
+
+// 只读映射一个.rdm文件。mat()与映射共享内存，在close()或对象析构前有效
+class MappedDepth
+{
+public:
+    MappedDepth();
+    ~MappedDepth();
+
+    bool open(const cv::String& path);
+    void close();
+
+    const cv::Mat& mat() const { return view; }
+    double scale() const { return header.scale; }
+    // 整个文件的字节数（文件头+数据）
+    size_t fileSize() const { return length; }
+    // 丢弃[y0, y1)行已读入内存的页，之后再访问时从文件重新读入。按条带读取超大文件时用来限制常驻内存；
+    // 不支持mmap时什么也不做
+    void evictRows(int y0, int y1);
+
+private:
+    MappedDepth(const MappedDepth&);
+    MappedDepth& operator=(const MappedDepth&);
+
+    RawDepthHeader header;
+    void* base;
+    size_t length;
+    std::vector<uchar> fallback; // 不支持mmap的平台上整文件读入
+    cv::Mat view;
+};
+
+// 顺序写出.rdm文件：open写文件头，write按行追加（可以分多次），close检查行数是否写满。
+// 用于按条带产生结果的场景，整幅图不必同时驻留内存
+class RawDepthWriter
+{
+public:
+    RawDepthWriter();
+    ~RawDepthWriter();
+
+    bool open(const cv::String& path, cv::Size size, int type, double scale = 1.0);
+    // rows的宽度和类型必须与open时一致
+    bool write(const cv::Mat& rows);
+    bool close();
+
+    int rowsWritten() const { return rows_written; }
+
+private:
+    RawDepthWriter(const RawDepthWriter&);
+    RawDepthWriter& operator=(const RawDepthWriter&);
+
+    FILE* file;
+    std::vector<char> io_buf;
+    cv::Size size;
+    int type;
+    int rows_written;
+    bool failed;
+};
+
+// 整幅写出
+bool writeRawDepth(const cv::String& path, const cv::Mat& depth, double scale = 1.0);
+
+#endif
@@ -0,0 +1,441 @@
+#include "rig_scheduler.hpp"
+#include "trace.hpp"
+#include "opencv2/imgcodecs.hpp"
+#include "opencv2/videoio.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+using namespace cv;
+using namespace std;
+
+bool loadRigList(const String& path, vector<RigSpec>& rigs)
+{
+    ifstream in(path.c_str());
+    if(!in)
+    {
+        cerr << "Cannot open rig list: " << path << endl;
+        return false;
+    }
+    rigs.clear();
+    string line;
+    for(int n = 1; getline(in, line); n++)
+    {
+        istringstream fields(line);
+        string left, right, dst;
+        if(!(fields >> left) || left[0] == '#')
+            continue;
+        RigSpec rig;
+        rig.left = left;
+        if(!(fields >> right))
+        {
+            cerr << path << ":" << n << ": expected <left> <right> [dst] [priority] [deadline_ms]" << endl;
+            return false;
+        }
+        rig.right = right;
+        if(fields >> dst)
+            rig.dst = dst;
+        fields >> rig.priority >> rig.deadline_ms;
+        rigs.push_back(rig);
+    }
+    if(rigs.empty())
+    {
+        cerr << "No streams in rig list: " << path << endl;
+        return false;
+    }
+    return true;
+}
+
+namespace
+{
+
+struct Task
+{
+    int priority;
+    int64 deadline;         // getTickCount刻度
+    unsigned long long seq; // 优先级和截止时间都相同时先提交的先运行
+    function<void()> run;
+};
+
+// 堆比较：a比b不紧急时为true，堆顶是最紧急的任务
+bool lessUrgent(const Task& a, const Task& b)
+{
+    if(a.priority != b.priority)
+        return a.priority < b.priority;
+    if(a.deadline != b.deadline)
+        return a.deadline > b.deadline;
+    return a.seq > b.seq;
+}
+
+class StealingPool;
+thread_local StealingPool* t_pool = 0;
+thread_local int t_index = -1;
+
+class StealingPool
+{
+public:
+    explicit StealingPool(int n) : pending(0), stopping(false), next_queue(0), seq(0)
+    {
+        for(int i = 0; i < n; i++)
+            queues.push_back(unique_ptr<Queue>(new Queue()));
+        for(int i = 0; i < n; i++)
+            threads.push_back(thread(&StealingPool::work, this, i));
+    }
+
+    ~StealingPool()
+    {
+        stop();
+    }
+
+    void submit(int priority, int64 deadline, const function<void()>& run)
+    {
+        Task t;
+        t.priority = priority;
+        t.deadline = deadline;
+        t.run = run;
+        // 工作线程产生的后续任务放进自己的堆（数据还在本核的缓存里），外部提交的轮流分配
+        size_t q;
+        {
+            lock_guard<mutex> g(idle_lock);
+            t.seq = seq++;
+            q = (t_pool == this) ? (size_t)t_index : next_queue++ % queues.size();
+        }
+        {
+            Queue& queue = *queues[q];
+            lock_guard<mutex> g(queue.lock);
+            queue.heap.push_back(t);
+            push_heap(queue.heap.begin(), queue.heap.end(), lessUrgent);
+        }
+        {
+            lock_guard<mutex> g(idle_lock);
+            pending++;
+        }
+        idle.notify_one();
+    }
+
+    // 运行完所有已提交的任务后结束工作线程
+    void stop()
+    {
+        {
+            lock_guard<mutex> g(idle_lock);
+            stopping = true;
+        }
+        idle.notify_all();
+        for(size_t i = 0; i < threads.size(); i++)
+            threads[i].join();
+        threads.clear();
+    }
+
+private:
+    struct Queue
+    {
+        mutex lock;
+        vector<Task> heap;
+    };
+
+    // 比较所有堆顶，从最紧急的那个堆取任务；不是自己的堆时就是窃取
+    bool take(int self, Task& out)
+    {
+        const int n = (int)queues.size();
+        for(;;)
+        {
+            int best = -1;
+            Task top;
+            for(int k = 0; k < n; k++)
+            {
+                const int i = (self + k) % n;
+                lock_guard<mutex> g(queues[i]->lock);
+                const vector<Task>& heap = queues[i]->heap;
+                if(!heap.empty() && (best < 0 || lessUrgent(top, heap.front())))
+                {
+                    best = i;
+                    top.priority = heap.front().priority;
+                    top.deadline = heap.front().deadline;
+                    top.seq = heap.front().seq;
+                }
+            }
+            if(best < 0)
+                return false;
+
+            // 比较和取出之间堆顶可能被别的线程取走，取不到就重新比较
+            Queue& queue = *queues[best];
+            {
+                lock_guard<mutex> g(queue.lock);
+                if(queue.heap.empty())
+                    continue;
+                pop_heap(queue.heap.begin(), queue.heap.end(), lessUrgent);
+                out = queue.heap.back();
+                queue.heap.pop_back();
+            }
+            lock_guard<mutex> g(idle_lock);
+            pending--;
+            return true;
+        }
+    }
+
+    void work(int index)
+    {
+        t_pool = this;
+        t_index = index;
+        for(;;)
+        {
+            Task t;
+            if(take(index, t))
+            {
+                t.run();
+                continue;
+            }
+            unique_lock<mutex> g(idle_lock);
+            idle.wait(g, [&]() { return pending > 0 || stopping; });
+            if(pending == 0 && stopping)
+                break;
+        }
+    }
+
+    vector<unique_ptr<Queue> > queues;
+    vector<thread> threads;
+    mutex idle_lock;
+    condition_variable idle;
+    int pending; // 已提交、尚未被取走的任务数
+    bool stopping;
+    size_t next_queue;
+    unsigned long long seq;
+};
+
+// 一路立体相机。同一阶段一次只有一个任务，阶段之间用队列传递帧
+struct Rig
+{
+    RigSpec spec;
+    VideoCapture left_cap, right_cap;
+    StereoContext ctx;
+    vector<StereoFrame> slots;
+    int64 deadline_ticks;
+
+    // 以下由lock保护
+    mutex lock;
+    vector<StereoFrame*> free_slots;
+    deque<StereoFrame*> match_q, filter_q;
+    bool decoding, matching, filtering;
+    bool eof, failed, done;
+    int next_index;
+    vector<double> latency_ms;
+    int missed;
+    int64 first_tick, last_tick;
+
+    Rig() : deadline_ticks(0), decoding(false), matching(false), filtering(false), eof(false), failed(false),
+            done(false), next_index(0), missed(0), first_tick(0), last_tick(0) {}
+};
+
+class RigRunner
+{
+public:
+    RigRunner(vector<unique_ptr<Rig> >& _rigs, const RigSchedulerOptions& _opts)
+        : rigs(_rigs), opts(_opts), pool(opts.threads), active((int)_rigs.size())
+    {
+        for(size_t i = 0; i < rigs.size(); i++)
+        {
+            lock_guard<mutex> g(rigs[i]->lock);
+            pump(*rigs[i]);
+        }
+    }
+
+    void wait()
+    {
+        unique_lock<mutex> g(done_lock);
+        done_cv.wait(g, [&]() { return active == 0; });
+        g.unlock();
+        pool.stop();
+    }
+
+private:
+    // 在r.lock下调用：提交该路当前可以开始的任务，全部结束时通知wait
+    void pump(Rig& r)
+    {
+        const bool more = !r.eof && !r.failed && (opts.max_frames <= 0 || r.next_index < opts.max_frames);
+        if(!r.decoding && more && !r.free_slots.empty())
+        {
+            StereoFrame* f = r.free_slots.back();
+            r.free_slots.pop_back();
+            r.decoding = true;
+            pool.submit(r.spec.priority, getTickCount() + r.deadline_ticks, [this, &r, f]() { decode(r, f); });
+        }
+        if(!r.matching && !r.match_q.empty())
+        {
+            StereoFrame* f = r.match_q.front();
+            r.match_q.pop_front();
+            r.matching = true;
+            pool.submit(r.spec.priority, f->start_tick + r.deadline_ticks, [this, &r, f]() { match(r, f); });
+        }
+        if(!r.filtering && !r.filter_q.empty())
+        {
+            StereoFrame* f = r.filter_q.front();
+            r.filter_q.pop_front();
+            r.filtering = true;
+            pool.submit(r.spec.priority, f->start_tick + r.deadline_ticks, [this, &r, f]() { filter(r, f); });
+        }
+        // 还有帧可解码时上面已经提交了解码，所以没有解码在途且所有缓冲槽都已归还就说明这一路结束了
+        if(!r.done && !r.decoding && r.free_slots.size() == r.slots.size())
+        {
+            r.done = true;
+            lock_guard<mutex> g(done_lock);
+            active--;
+            done_cv.notify_all();
+        }
+    }
+
+    void decode(Rig& r, StereoFrame* f)
+    {
+        f->start_tick = getTickCount();
+        TraceScope scope("decode");
+        bool ok = r.left_cap.read(f->left) && r.right_cap.read(f->right);
+        scope.end();
+        bool failed = false;
+        if(ok && f->left.size() != f->right.size())
+        {
+            cout << "Left and right frames differ in size at frame " << r.next_index << " of " << r.spec.left << endl;
+            ok = false;
+            failed = true;
+        }
+
+        lock_guard<mutex> g(r.lock);
+        r.decoding = false;
+        if(ok)
+        {
+            if(r.next_index == 0)
+                r.first_tick = f->start_tick;
+            f->index = r.next_index++;
+            f->decode_ms = (getTickCount() - f->start_tick) * 1000.0 / getTickFrequency();
+            r.match_q.push_back(f);
+        }
+        else
+        {
+            r.eof = true;
+            r.failed = failed;
+            r.free_slots.push_back(f);
+        }
+        pump(r);
+    }
+
+    void match(Rig& r, StereoFrame* f)
+    {
+        const int64 t = getTickCount();
+        matchFrame(r.ctx, *f);
+        f->match_ms = (getTickCount() - t) * 1000.0 / getTickFrequency();
+
+        lock_guard<mutex> g(r.lock);
+        r.matching = false;
+        r.filter_q.push_back(f);
+        pump(r);
+    }
+
+    void filter(Rig& r, StereoFrame* f)
+    {
+        const int64 t = getTickCount();
+        filterFrame(r.ctx, *f);
+        f->filter_ms = (getTickCount() - t) * 1000.0 / getTickFrequency();
+        if(r.spec.dst != "None")
+        {
+            TraceScope scope("encode");
+            imwrite(format(r.spec.dst.c_str(), f->index), f->filtered_disp);
+        }
+        const int64 end = getTickCount();
+        const double latency = (end - f->start_tick) * 1000.0 / getTickFrequency();
+
+        lock_guard<mutex> g(r.lock);
+        r.filtering = false;
+        r.latency_ms.push_back(latency);
+        if(r.spec.deadline_ms > 0.0 && latency > r.spec.deadline_ms)
+            r.missed++;
+        r.last_tick = end;
+        r.free_slots.push_back(f);
+        pump(r);
+    }
+
+    vector<unique_ptr<Rig> >& rigs;
+    RigSchedulerOptions opts;
+    StealingPool pool;
+    mutex done_lock;
+    condition_variable done_cv;
+    int active;
+};
+
+} // namespace
+
+bool runRigScheduler(const StereoParams& params, const vector<RigSpec>& specs, const RigSchedulerOptions& opts,
+                     vector<RigStats>& stats, double& wall_seconds)
+{
+    RigSchedulerOptions o = opts;
+    o.threads = o.threads > 0 ? o.threads : std::max(getNumberOfCPUs(), 1);
+    o.cv_threads = std::max(o.cv_threads, 1);
+    o.queue_depth = std::max(o.queue_depth, 1);
+
+    // 并行度由线程池提供：任务内的左右匹配器依次运行，不再按行带拆分
+    StereoParams p = params;
+    p.lr_parallel = false;
+    p.left_threads = p.right_threads = 1;
+
+    vector<unique_ptr<Rig> > rigs;
+    for(size_t i = 0; i < specs.size(); i++)
+    {
+        unique_ptr<Rig> r(new Rig());
+        r->spec = specs[i];
+        const double deadline_ms = r->spec.deadline_ms > 0.0 ? r->spec.deadline_ms : 1000.0;
+        r->deadline_ticks = (int64)(deadline_ms * getTickFrequency() / 1000.0);
+        if(!r->left_cap.open(r->spec.left) || !r->right_cap.open(r->spec.right))
+        {
+            cout << "Cannot open stream: " << (r->left_cap.isOpened() ? r->spec.right : r->spec.left) << endl;
+            return false;
+        }
+        if(!createStereoContext(p, r->ctx))
+            return false;
+        r->slots.resize(o.queue_depth);
+        for(size_t k = 0; k < r->slots.size(); k++)
+            r->free_slots.push_back(&r->slots[k]);
+        rigs.push_back(std::move(r));
+    }
+
+    const int saved_threads = getNumThreads();
+    setNumThreads(o.cv_threads);
+    const int64 start = getTickCount();
+    {
+        RigRunner runner(rigs, o);
+        runner.wait();
+    }
+    wall_seconds = (getTickCount() - start) / getTickFrequency();
+    setNumThreads(saved_threads);
+
+    bool ok = true;
+    stats.assign(rigs.size(), RigStats());
+    for(size_t i = 0; i < rigs.size(); i++)
+    {
+        const Rig& r = *rigs[i];
+        RigStats& s = stats[i];
+        vector<double> ms = r.latency_ms;
+        sort(ms.begin(), ms.end());
+        s.frames = (int)ms.size();
+        s.missed = r.missed;
+        s.seconds = s.frames > 0 ? (r.last_tick - r.first_tick) / getTickFrequency() : 0.0;
+        s.fps = s.frames / std::max(s.seconds, 1e-9);
+        s.mean_ms = s.p50_ms = s.p99_ms = s.max_ms = 0.0;
+        if(!ms.empty())
+        {
+            double total = 0.0;
+            for(size_t k = 0; k < ms.size(); k++)
+                total += ms[k];
+            s.mean_ms = total / ms.size();
+            s.p50_ms = ms[ms.size() / 2];
+            s.p99_ms = ms[std::min(ms.size() - 1, (ms.size() * 99) / 100)];
+            s.max_ms = ms.back();
+        }
+        ok = ok && !r.failed;
+    }
+    return ok;
+}
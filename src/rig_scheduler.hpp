@@ -0,0 +1,54 @@
+#ifndef DISPARITY_RIG_SCHEDULER_HPP
+#define DISPARITY_RIG_SCHEDULER_HPP
+
+#include "opencv2/core.hpp"
+#include "stereo_pipeline.hpp"
+#include <vector>
+
+// 多路立体相机共用一个线程预算。每路的解码、匹配、滤波（含写出）都是独立的任务，
+// 全部交给同一个工作窃取线程池：
+//   - 每个工作线程有自己的任务堆，按（优先级降序，截止时间升序）排序，自己产生的后续任务放进自己的堆，
+//     同一帧的匹配和滤波通常在同一个线程上接着运行；
+//   - 取任务时先看自己的堆顶，再看其它线程的堆顶，哪个更紧急就取哪个（空闲线程因此会窃取忙碌线程积压的任务），
+//     高优先级、临近截止的帧不会因为被排在某个忙碌线程的堆里而等待；
+//   - 同一路的同一阶段一次只运行一个任务（匹配器和滤波器实例不能并发使用），帧按顺序通过各阶段，
+//     匹配第n+1帧可以与滤波第n帧同时进行，与--video的流水线相同。
+// 并行度来自多路和流水线，任务内部OpenCV parallel_for_的线程数固定为cv_threads（默认1），
+// wls_conf的左右匹配器在任务内依次运行，总线程数不超过threads * cv_threads。
+struct RigSpec
+{
+    cv::String left, right; // 视频文件或图像序列（与--video相同）
+    cv::String dst;         // 输出路径（printf格式，含帧号），"None"表示不写
+    int priority;           // 越大越优先
+    double deadline_ms;     // 解码开始到写出的期望延迟，<=0表示不限（按1秒的期限参与排序，不统计超时）
+
+    RigSpec() : dst("None"), priority(0), deadline_ms(0.0) {}
+};
+
+// 每行一路：left right [dst] [priority] [deadline_ms]，#开头的行和空行忽略
+bool loadRigList(const cv::String& path, std::vector<RigSpec>& rigs);
+
+struct RigSchedulerOptions
+{
+    int threads;     // 共用的工作线程数（0表示CPU核数）
+    int cv_threads;  // 任务内部OpenCV的线程数
+    int queue_depth; // 每路同时在途的帧数
+    int max_frames;  // 每路最多处理的帧数（0表示直到结束）
+
+    RigSchedulerOptions() : threads(0), cv_threads(1), queue_depth(3), max_frames(0) {}
+};
+
+struct RigStats
+{
+    int frames;
+    int missed;         // 超过deadline_ms的帧数
+    double seconds;     // 该路第一帧开始解码到最后一帧写出
+    double fps;
+    double mean_ms, p50_ms, p99_ms, max_ms; // 每帧从开始解码到写出的延迟
+};
+
+// 所有流都处理完（或出错）后返回；stats与rigs一一对应。任一路无法打开时不开始处理，返回false
+bool runRigScheduler(const StereoParams& params, const std::vector<RigSpec>& rigs, const RigSchedulerOptions& opts,
+                     std::vector<RigStats>& stats, double& wall_seconds);
+
+#endif
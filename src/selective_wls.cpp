@@ -0,0 +1,139 @@
+#include "selective_wls.hpp"
+#include "tiled_wls.hpp"
+#include "opencv2/calib3d.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/ximgproc/edge_filter.hpp"
+#include <algorithm>
+#include <cstdlib>
+
+using namespace cv;
+using namespace cv::ximgproc;
+using namespace std;
+
+bool SelectiveWLS::apply(const Mat& left_disp, const Mat& right_disp, int min_disp, const Mat& raw, const Mat& guide,
+                         Rect roi, double lambda, double sigma, int radius, int lrc_thresh,
+                         const SelectiveWLSParams& params, Mat& filtered, Mat& conf)
+{
+    CV_Assert(left_disp.type() == CV_16SC1 && right_disp.type() == CV_16SC1 && left_disp.size() == right_disp.size());
+    CV_Assert(raw.type() == CV_16SC1 && guide.size() == raw.size());
+    const Size msize = left_disp.size(), size = raw.size();
+
+    // 左右一致性：右视差在右图坐标x - dl/16处，两者之和接近0时一致；无效值为(min_disp-1)*16
+    const int invalid = min_disp * StereoMatcher::DISP_SCALE;
+    conf_small.create(msize, CV_8U);
+    parallel_for_(Range(0, msize.height), [&](const Range& r)
+    {
+        for(int y = r.start; y < r.end; y++)
+        {
+            const short* L = left_disp.ptr<short>(y);
+            const short* R = right_disp.ptr<short>(y);
+            uchar* c = conf_small.ptr<uchar>(y);
+            for(int x = 0; x < msize.width; x++)
+            {
+                const int dl = L[x], xr = x - dl / StereoMatcher::DISP_SCALE;
+                c[x] = (dl >= invalid && xr >= 0 && xr < msize.width && std::abs(dl + R[xr]) <= lrc_thresh) ? 255 : 0;
+            }
+        }
+    });
+    if(msize != size)
+        resize(conf_small, conf, size, 0, 0, INTER_NEAREST);
+    else
+        conf_small.copyTo(conf);
+
+    // ROI之外没有有效的匹配结果
+    const Rect r = roi.area() > 0 ? (roi & Rect(Point(), size)) : Rect(Point(), size);
+    conf.rowRange(0, r.y).setTo(Scalar(0));
+    conf.rowRange(r.y + r.height, size.height).setTo(Scalar(0));
+    conf(Rect(0, r.y, r.x, r.height)).setTo(Scalar(0));
+    conf(Rect(r.x + r.width, r.y, size.width - r.x - r.width, r.height)).setTo(Scalar(0));
+    low_fraction = 1.0 - (double)countNonZero(conf) / size.area();
+
+    compare(conf, Scalar(0), mask, CMP_EQ);
+    if(params.margin > 0)
+        dilate(mask, mask, getStructuringElement(MORPH_RECT, Size(2 * params.margin + 1, 2 * params.margin + 1)));
+
+    // 含掩码的块：1，已归入某个区域：2
+    const int tile = std::max(params.tile, 1);
+    const int tiles_x = (size.width + tile - 1) / tile, tiles_y = (size.height + tile - 1) / tile;
+    bad_tiles.assign((size_t)tiles_x * tiles_y, 0);
+    for(int ty = 0; ty < tiles_y; ty++)
+        for(int tx = 0; tx < tiles_x; tx++)
+            bad_tiles[ty * tiles_x + tx] = countNonZero(mask(Rect(tx * tile, ty * tile, tile, tile) & Rect(Point(), size))) > 0;
+
+    boxes.clear();
+    vector<int> stack;
+    for(int i = 0; i < tiles_x * tiles_y; i++)
+    {
+        if(bad_tiles[i] != 1)
+            continue;
+        Rect box;
+        bad_tiles[i] = 2;
+        stack.push_back(i);
+        while(!stack.empty())
+        {
+            const int j = stack.back(), tx = j % tiles_x, ty = j / tiles_x;
+            stack.pop_back();
+            const Rect t = Rect(tx * tile, ty * tile, tile, tile) & Rect(Point(), size);
+            box = box.area() > 0 ? (box | t) : t;
+            for(int ny = std::max(ty - 1, 0); ny <= std::min(ty + 1, tiles_y - 1); ny++)
+                for(int nx = std::max(tx - 1, 0); nx <= std::min(tx + 1, tiles_x - 1); nx++)
+                    if(bad_tiles[ny * tiles_x + nx] == 1)
+                    {
+                        bad_tiles[ny * tiles_x + nx] = 2;
+                        stack.push_back(ny * tiles_x + nx);
+                    }
+        }
+        boxes.push_back(box);
+    }
+    // 外接矩形可能相交（例如L形区域），合并到互不相交为止，这样各区域可以并行写回
+    for(bool merged = true; merged; )
+    {
+        merged = false;
+        for(size_t i = 0; i < boxes.size() && !merged; i++)
+            for(size_t j = i + 1; j < boxes.size() && !merged; j++)
+                if((boxes[i] & boxes[j]).area() > 0)
+                {
+                    boxes[i] |= boxes[j];
+                    boxes.erase(boxes.begin() + j);
+                    merged = true;
+                }
+    }
+
+    const int halo = params.halo >= 0 ? params.halo : autoWLSHalo(lambda, radius);
+    double solved = 0.0;
+    for(size_t i = 0; i < boxes.size(); i++)
+        solved += (Rect(boxes[i].x - halo, boxes[i].y - halo, boxes[i].width + 2 * halo, boxes[i].height + 2 * halo) &
+                   Rect(Point(), size)).area();
+    regions = (int)boxes.size();
+    refined_fraction = solved / size.area();
+    if(refined_fraction > params.max_fraction)
+        return false;
+
+    raw.copyTo(filtered);
+    parallel_for_(Range(0, (int)boxes.size()), [&](const Range& range)
+    {
+        Mat disp32, conf32, num, den;
+        for(int i = range.start; i < range.end; i++)
+        {
+            const Rect& box = boxes[i];
+            const Rect ext = Rect(box.x - halo, box.y - halo, box.width + 2 * halo, box.height + 2 * halo) & Rect(Point(), size);
+            conf(ext).convertTo(conf32, CV_32F, 1.0 / 255.0);
+            raw(ext).convertTo(disp32, CV_32F);
+            multiply(disp32, conf32, disp32);
+            fastGlobalSmootherFilter(guide(ext), disp32, num, lambda, sigma);
+            fastGlobalSmootherFilter(guide(ext), conf32, den, lambda, sigma);
+            for(int y = box.y; y < box.y + box.height; y++)
+            {
+                const uchar* m = mask.ptr<uchar>(y) + box.x;
+                const float* n = num.ptr<float>(y - ext.y) + (box.x - ext.x);
+                const float* d = den.ptr<float>(y - ext.y) + (box.x - ext.x);
+                short* out = filtered.ptr<short>(y) + box.x;
+                for(int x = 0; x < box.width; x++)
+                    if(m[x] && d[x] > 1e-3f) // 整个区域都没有可信像素时保留原值
+                        out[x] = saturate_cast<short>(n[x] / d[x]);
+            }
+        }
+    });
+    return true;
+}
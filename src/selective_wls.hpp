@@ -0,0 +1,49 @@
+#ifndef DISPARITY_SELECTIVE_WLS_HPP
+#define DISPARITY_SELECTIVE_WLS_HPP
+
+#include "opencv2/core.hpp"
+#include <vector>
+
+// wls_conf的选择性细化：只在低置信度区域上求解WLS，其余像素保留匹配器的原始视差。
+//   1. 置信度（匹配视图尺寸，二值）：原始视差无效、ROI之外、或左右一致性检查失败
+//      （|dl + dr(x - dl/16)| > lrc_thresh，右视差为createRightMatcher的负值约定）的像素为0，其余为255；
+//   2. 低置信度掩码膨胀margin像素后按tile x tile分块，含掩码的块按8连通合并成矩形区域，
+//      相互重叠的区域再合并，保证各区域不相交；
+//   3. 每个区域四周加halo像素，在此范围内做与DisparityWLSFilter相同的带置信度求解
+//      FGS(视差 * 置信度) / FGS(置信度)，结果只写回区域内被掩码覆盖的像素。
+// 耗时与低置信度区域（含halo）的面积成正比，与图像面积无关。区域总面积超过max_fraction时整图一次求解更快，
+// 由调用方改用整图滤波。置信度没有getConfidenceMap()在深度不连续处的渐变，结果不与整图WLS逐像素相同。
+struct SelectiveWLSParams
+{
+    int tile;            // 掩码分块的边长（原图像素）
+    int margin;          // 低置信度掩码的膨胀半径
+    int halo;            // 区域四周额外参与求解的像素，<0表示自动（autoWLSHalo）
+    double max_fraction; // 求解面积（含halo）占整图的比例上限
+
+    SelectiveWLSParams() : tile(32), margin(8), halo(-1), max_fraction(0.5) {}
+};
+
+// 缓冲区在帧之间复用；一个实例不能同时被多个线程使用
+class SelectiveWLS
+{
+public:
+    SelectiveWLS() : regions(0), low_fraction(0.0), refined_fraction(0.0) {}
+
+    // left_disp/right_disp为匹配视图尺寸的CV_16S，min_disp为左匹配器的minDisparity；
+    // raw为放大回原尺寸的左视差，guide为原尺寸左视图，roi为原尺寸的有效区域。
+    // conf总是写出（原尺寸CV_8U）；返回false表示区域太大，filtered未写
+    bool apply(const cv::Mat& left_disp, const cv::Mat& right_disp, int min_disp, const cv::Mat& raw, const cv::Mat& guide,
+               cv::Rect roi, double lambda, double sigma, int radius, int lrc_thresh, const SelectiveWLSParams& params,
+               cv::Mat& filtered, cv::Mat& conf);
+
+    int regions;             // 最近一次的区域数
+    double low_fraction;     // 置信度为0的像素比例
+    double refined_fraction; // 求解面积（含halo）占整图的比例
+
+private:
+    cv::Mat conf_small, mask;
+    std::vector<uchar> bad_tiles;
+    std::vector<cv::Rect> boxes;
+};
+
+#endif
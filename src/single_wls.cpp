@@ -4,6 +4,10 @@
 #include "opencv2/highgui.hpp"
 #include "opencv2/core/utility.hpp"
 #include "opencv2/ximgproc/disparity_filter.hpp"
+#include "opencv2/ximgproc/edge_filter.hpp"
+#include "tiled_wls.hpp"
+#include "lowres_wls.hpp"
+#include "trace.hpp"
 #include <iostream>
 #include <string>
 
@@ -11,8 +15,27 @@ using namespace cv;
 using namespace cv::ximgproc;
 using namespace std;
 
+const String keys =
+    "{help h usage ? |     | print this message                                               }"
+    "{tile           |0    | filter in parallel tiles of this size (0 = whole image at once)  }"
+    "{halo           |-1   | extra pixels filtered around each tile (-1 = 2*sqrt(lambda)+radius) }"
+    "{scale          |1    | solve WLS at 1/scale resolution, then upsample guided by the full-res image (1 = full res) }"
+    "{upsample       |guided | upsampling after a low-res solve: guided or joint_bilateral       }"
+    "{compare        |     | also run the full-res solve and print speedup and difference      }"
+    "{fixed_point    |     | filter through CV_16S fixed point as before (values above 2047 px saturate) }"
+    "{trace          |     | write per-stage Chrome trace-event JSON to this file and print a time/allocation/RSS summary }"
+    ;
+
 int main(int argc, char** argv)
 {
+    CommandLineParser parser(argc, argv, keys);
+    if (parser.has("help"))
+    {
+        parser.printMessage();
+        return 0;
+    }
+    TraceSession trace(parser.get<String>("trace"));
+
     String left_img = "../l.jpg";    
     String disp_img = "../depth.png";   
     
@@ -25,6 +48,7 @@ int main(int argc, char** argv)
     double sigma = 1.0;                  // 相似性阈值
     int wsize = 15;                      // 窗口大小 
 
+    TraceScope decode_scope("decode");
     Mat left = imread(left_img, 0);
     if (left.empty())
     {
@@ -38,6 +62,7 @@ int main(int argc, char** argv)
         cout << "disp NOT FOUND " << disp_img << endl;
         return -1;
     }
+    decode_scope.end();
  
     Mat disp_single;
     // switch (loaded_disp.channels()) 
@@ -56,20 +81,40 @@ int main(int argc, char** argv)
     //         break;
     // }
     
-    // 转换为CV_16S格式
+    // 默认转换为以像素为单位的CV_32F（CV_32F输入直接使用），整数类型仍按x16定点解释；
+    // fixed_point时按旧做法转换为CV_16S
+    const bool fixed_point = parser.has("fixed_point");
+    const double units = fixed_point ? 16.0 : 1.0; // 每像素视差对应的数值
+    TraceScope convert_scope("convert");
     Mat left_disp;
-    switch (disp_single.depth())
+    if (fixed_point)
     {
-        case CV_8U: disp_single.convertTo(left_disp, CV_16S, 16.0);  break;
-        case CV_16U: disp_single.convertTo(left_disp, CV_16S, 1.0);  break;
-        case CV_16S: left_disp = disp_single;  break;
-        case CV_32S: disp_single.convertTo(left_disp, CV_16S, 1.0);  break;
-        case CV_32F: disp_single.convertTo(left_disp, CV_16S, 16.0);  break;
-        case CV_64F: disp_single.convertTo(left_disp, CV_16S, 16.0);  break;
-        default:
-        cerr << "Unsupported depth type: depth=" << disp_single.depth() << endl;
-            return -1;
+        switch (disp_single.depth())
+        {
+            case CV_8U: disp_single.convertTo(left_disp, CV_16S, 16.0);  break;
+            case CV_16U: disp_single.convertTo(left_disp, CV_16S, 1.0);  break;
+            case CV_16S: left_disp = disp_single;  break;
+            case CV_32S: disp_single.convertTo(left_disp, CV_16S, 1.0);  break;
+            case CV_32F: disp_single.convertTo(left_disp, CV_16S, 16.0);  break;
+            case CV_64F: disp_single.convertTo(left_disp, CV_16S, 16.0);  break;
+            default:
+            cerr << "Unsupported depth type: depth=" << disp_single.depth() << endl;
+                return -1;
+        }
     }
+    else
+    {
+        switch (disp_single.depth())
+        {
+            case CV_32F: left_disp = disp_single;  break;
+            case CV_8U: case CV_64F: disp_single.convertTo(left_disp, CV_32F);  break;
+            case CV_16U: case CV_16S: case CV_32S: disp_single.convertTo(left_disp, CV_32F, 1.0 / 16);  break;
+            default:
+            cerr << "Unsupported depth type: depth=" << disp_single.depth() << endl;
+                return -1;
+        }
+    }
+    convert_scope.end();
      
     // 创建WLS滤波器
     Ptr<DisparityWLSFilter> wls_filter = createDisparityWLSFilterGeneric(false);
@@ -83,25 +128,79 @@ int main(int argc, char** argv)
 
     Mat filtered_disp;
     
+    TiledWLSParams tiled;
+    tiled.lambda = lambda;
+    tiled.sigma = sigma;
+    tiled.radius = wls_filter->getDepthDiscontinuityRadius();
+    tiled.tile = parser.get<int>("tile");
+    tiled.halo = parser.get<int>("halo");
+
+    LowResWLS lowres;
+    lowres.factor = parser.get<int>("scale");
+    lowres.tiled = tiled;
+    if (lowres.factor < 1 || !parseUpsample(parser.get<String>("upsample"), lowres.upsample))
+    {
+        cerr << "Incorrect scale/upsample: scale >= 1, upsample is guided or joint_bilateral" << endl;
+        return -1;
+    }
+
+    if (lowres.factor > 1)
+        lowres.init(lambda, sigma, tiled.radius); // 缩小求解，再由原尺寸左图引导上采样
 
-    wls_filter->filter(left_disp, left, filtered_disp, Mat(), ROI);
+    // 只计求解（含上采样）的时间，与--compare的原尺寸求解对比；filtering_time还包括读入和类型转换
+    TraceScope filter_scope("filter");
+    const int64 solve_tick = getTickCount();
+    if (lowres.factor > 1)
+        lowres.filter(left_disp, left, filtered_disp);
+    else if (tiled.tile > 0)
+        filterWLSTiled(left_disp, left, filtered_disp, tiled); // 分块并行，峰值内存由块大小决定
+    else if (fixed_point)
+        wls_filter->filter(left_disp, left, filtered_disp, Mat(), ROI);
+    else
+        fastGlobalSmootherFilter(left, left_disp, filtered_disp, lambda, sigma); // 与不带置信度的WLS同一求解，不经过定点
     
+    filter_scope.end();
+    const double solve_time = ((double)getTickCount() - solve_tick) / getTickFrequency();
     filtering_time = ((double)getTickCount() - filtering_time) / getTickFrequency();
-    cout << filtering_time << endl;
+    cout << "Load + filtering time: " << filtering_time << "s" << endl;
+
+    if (parser.has("compare") && lowres.factor > 1)
+    {
+        // 同一输入上的原尺寸求解作为参照（视差单位为像素）
+        TraceScope reference_scope("filter_reference");
+        Mat reference;
+        double full_time = (double)getTickCount();
+        if (tiled.tile > 0)
+            filterWLSTiled(left_disp, left, reference, tiled);
+        else if (fixed_point)
+            wls_filter->filter(left_disp, left, reference, Mat(), ROI);
+        else
+            fastGlobalSmootherFilter(left, left_disp, reference, lambda, sigma);
+        full_time = ((double)getTickCount() - full_time) / getTickFrequency();
+        reference_scope.end();
+        const DepthDiff d = compareDepth(filtered_disp, reference);
+        cout << "Full-res WLS: " << full_time << "s, 1/" << lowres.factor << " WLS + upsampling: " << solve_time << "s ("
+             << full_time / std::max(solve_time, 1e-6) << "x)" << endl;
+        cout << "Difference to full-res: mean " << d.mae / units << ", p99 " << d.p99 / units << ", max " << d.max_abs / units
+             << " px" << endl;
+    }
     
     //imwrite(dst_raw_path, left_disp);
 
     //imwrite(dst_path, filtered_disp);
+    trace.finish();
 
 
     Mat raw_disp_vis;
-    getDisparityVis(left_disp, raw_disp_vis);
-    left_disp.convertTo(raw_disp_vis, CV_8U, 0.3);
+    if (fixed_point)
+        getDisparityVis(left_disp, raw_disp_vis);
+    left_disp.convertTo(raw_disp_vis, CV_8U, 0.3 * 16.0 / units);
     imshow("原始深度图", raw_disp_vis);
     
     Mat filtered_disp_vis;
-    getDisparityVis(filtered_disp, filtered_disp_vis);
-    filtered_disp.convertTo(filtered_disp_vis, CV_8U, 1);
+    if (fixed_point)
+        getDisparityVis(filtered_disp, filtered_disp_vis);
+    filtered_disp.convertTo(filtered_disp_vis, CV_8U, 16.0 / units);
     imshow("WLS滤波后深度图", filtered_disp_vis);
     
     waitKey(0);
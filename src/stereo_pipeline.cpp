@@ -0,0 +1,556 @@
+#include "stereo_pipeline.hpp"
+#include "trace.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/core/utility.hpp"
+#include <iostream>
+#include <thread>
+#include <algorithm>
+
+using namespace cv;
+using namespace cv::ximgproc;
+using namespace std;
+
+// 时域复用中可信预测像素的最低置信度（getConfidenceMap的取值范围为0~255）
+static const float TEMPORAL_MIN_CONF = 64.0f;
+
+static void initBandedMatcher(BandedMatcher& banded, const Ptr<StereoMatcher>& matcher, int threads)
+{
+    banded.matchers.assign(1, matcher);
+    for(int i = 1; i < threads; i++)
+        banded.matchers.push_back(cloneMatcher(matcher));
+    banded.band_disp.resize(banded.matchers.size());
+}
+
+// 按行带拆分计算视差：每个行带连同上下重叠区独立匹配，只把中间部分拷回结果。
+// 重叠区是经验值，行带接缝附近的视差与整图匹配不完全相同（见BandedMatcher）。
+// 行带在OpenCV的线程池上运行（parallel_for_），匹配器内部的parallel_for_此时嵌套执行、不再并行，线程数不会超出线程池
+static void computeBanded(BandedMatcher& banded, const Mat& a, const Mat& b, Mat& disp)
+{
+    const int bands = (int)banded.matchers.size();
+    if(bands <= 1)
+    {
+        banded.matchers[0]->compute(a, b, disp);
+        return;
+    }
+
+    const int band_h = (a.rows + bands - 1) / bands;
+    // 重叠区覆盖匹配窗口和预滤波窗口，并为SGBM的纵向聚合留出余量
+    const int halo = banded.matchers[0]->getBlockSize() / 2 + 8 + band_h / 10;
+    disp.create(a.size(), CV_16S);
+
+    parallel_for_(Range(0, bands), [&](const Range& r)
+    {
+        for(int i = r.start; i < r.end; i++)
+        {
+            int y0 = i * band_h, y1 = std::min(a.rows, y0 + band_h);
+            if(y0 >= y1)
+                continue;
+            int ey0 = std::max(0, y0 - halo), ey1 = std::min(a.rows, y1 + halo);
+            Mat& out = banded.band_disp[i];
+            banded.matchers[i]->compute(a.rowRange(ey0, ey1), b.rowRange(ey0, ey1), out);
+            out.rowRange(y0 - ey0, y1 - ey0).copyTo(disp.rowRange(y0, y1));
+        }
+    }, bands);
+}
+
+// 左右匹配：parallel时右匹配在单独的线程上与左匹配同时运行，否则在当前线程上依次运行
+template<typename LeftFn, typename RightFn>
+static void runLeftRight(bool parallel, LeftFn left, RightFn right)
+{
+    if(!parallel)
+    {
+        left();
+        right();
+        return;
+    }
+    thread right_worker(right);
+    left();
+    right_worker.join();
+}
+
+int defaultWindowSize(const String& algo, const String& filter, bool no_downscale)
+{
+    if(algo=="sgbm")
+        return 3; //默认窗口大小为3
+    if(algo=="census")
+        return 9; //Census窗口默认为9x7
+    if(!no_downscale && algo=="bm" && filter=="wls_conf")
+        return 7; //默认窗口大小为7
+    return 15; //默认窗口大小为15
+}
+
+int defaultMinDisparity(const String& algo, const String& filter)
+{
+    return (algo=="sgbm" && filter=="wls_no_conf") ? -16 : 0;
+}
+
+int matcherMinDisparity(int min_disp, const String& filter, bool no_downscale)
+{
+    if(filter=="wls_conf" && !no_downscale)
+        return min_disp >= 0 ? min_disp/2 : -((-min_disp+1)/2); // 向下取整，保证范围仍覆盖原范围
+    return min_disp;
+}
+
+int matcherMaxDisparity(int max_disp, const String& filter, bool no_downscale)
+{
+    if(filter=="wls_conf" && !no_downscale)
+    {
+        // 匹配在缩小一半的视图上进行，视差范围同样减半
+        max_disp/=2;
+        if(max_disp%16!=0)
+            max_disp += 16-(max_disp%16);
+    }
+    return max_disp;
+}
+
+bool createStereoContext(const StereoParams& params, StereoContext& ctx)
+{
+    ctx.params = params;
+    ctx.use_conf = false;
+    ctx.to_gray = false;
+    const int wsize = params.wsize;
+
+    if(params.filter=="wls_conf") // 使用置信度进行滤波（比wls_no_conf质量更好）
+    {
+        ctx.use_conf = true;
+        if(params.algo=="bm")
+        {
+            Ptr<StereoBM> left_matcher = StereoBM::create(params.max_disp,wsize);
+            left_matcher->setMinDisparity(params.min_disp);
+            ctx.wls_filter = createDisparityWLSFilter(left_matcher);
+            ctx.right_matcher = createRightMatcher(left_matcher);
+            ctx.left_matcher = left_matcher;
+            ctx.to_gray = true;
+        }
+        else if(params.algo=="sgbm")
+        {
+            Ptr<StereoSGBM> left_matcher  = StereoSGBM::create(params.min_disp,params.max_disp,wsize);
+            left_matcher->setP1(24*wsize*wsize);
+            left_matcher->setP2(96*wsize*wsize);
+            left_matcher->setPreFilterCap(63);
+            left_matcher->setMode(StereoSGBM::MODE_SGBM_3WAY);
+            ctx.wls_filter = createDisparityWLSFilter(left_matcher);
+            ctx.right_matcher = createRightMatcher(left_matcher);
+            ctx.left_matcher = left_matcher;
+        }
+        else if(params.algo=="census")
+        {
+            // 与createDisparityWLSFilter对SGBM的处理一致：关闭唯一性检查、左右一致性检查和斑点滤波，交给置信度处理
+            Ptr<StereoCensusSGM> left_matcher = StereoCensusSGM::create(params.min_disp,params.max_disp,wsize);
+            left_matcher->setUniquenessRatio(0);
+            left_matcher->setDisp12MaxDiff(-1);
+            left_matcher->setSpeckleWindowSize(0);
+            ctx.wls_filter = createDisparityWLSFilterGeneric(true);
+            ctx.wls_filter->setDepthDiscontinuityRadius((int)ceil(0.5 * wsize));
+            ctx.left_matcher = left_matcher;
+            ctx.census = left_matcher;
+            ctx.to_gray = true;
+        }
+        else
+        {
+            cout<<"Unsupported algorithm";
+            return false;
+        }
+    }
+    else if(params.filter=="wls_no_conf")
+    {
+        /* 没有方便的函数来处理没有置信度的情况，所以我们需要手动设置ROI和匹配器参数 */
+        if(params.algo=="bm")
+        {
+            cv::Ptr<cv::StereoBM> bm = cv::StereoBM::create();
+            bm->setPreFilterType(cv::StereoBM::PREFILTER_NORMALIZED_RESPONSE);
+            bm->setPreFilterSize(9);
+            bm->setPreFilterCap(31);
+            bm->setBlockSize(15);
+            bm->setMinDisparity(params.min_disp);
+            bm->setNumDisparities(params.max_disp);
+            bm->setTextureThreshold(10);
+            bm->setUniquenessRatio(15);
+            bm->setSpeckleWindowSize(100);
+            bm->setSpeckleRange(32);
+
+            ctx.left_matcher = bm;
+            ctx.wls_filter = createDisparityWLSFilterGeneric(false);
+            ctx.wls_filter->setDepthDiscontinuityRadius((int)ceil(0.33 * wsize));
+            ctx.to_gray = true;
+        }
+        else if(params.algo=="sgbm")
+        {
+            cv::Ptr<cv::StereoSGBM> sgbm = cv::StereoSGBM::create(params.min_disp, params.max_disp, 15, 0, 0, 1, 31, 15, 100, 2, 0);
+
+            ctx.left_matcher = sgbm;
+            ctx.wls_filter = createDisparityWLSFilterGeneric(false);
+            ctx.wls_filter->setDepthDiscontinuityRadius((int)ceil(0.5 * wsize));
+        }
+        else if(params.algo=="census")
+        {
+            Ptr<StereoCensusSGM> census = StereoCensusSGM::create(params.min_disp, params.max_disp, wsize);
+            census->setSpeckleWindowSize(100);
+            census->setSpeckleRange(2);
+
+            ctx.left_matcher = census;
+            ctx.census = census;
+            ctx.wls_filter = createDisparityWLSFilterGeneric(false);
+            ctx.wls_filter->setDepthDiscontinuityRadius((int)ceil(0.5 * wsize));
+            ctx.to_gray = true;
+        }
+        else
+        {
+            cout << "Unsupported algorithm";
+            return false;
+        }
+    }
+    else
+    {
+        cout << "Unsupported filter";
+        return false;
+    }
+
+    ctx.wls_filter->setLambda(params.lambda);
+    ctx.wls_filter->setSigmaColor(params.sigma);
+
+    // 克隆必须在createDisparityWLSFilter调整完左匹配器参数之后进行
+    if(params.pyr_levels > 1)
+    {
+        // 右视差通过翻转图像用左匹配器的参数计算，所有匹配方法都适用
+        ctx.left_pyr.init(ctx.left_matcher, params.pyr_levels);
+        if(ctx.use_conf)
+            ctx.right_pyr.init(ctx.left_matcher, params.pyr_levels);
+    }
+    else if(params.temporal > 0)
+    {
+        // 右视差同样通过翻转图像计算，census不需要computeBoth
+        ctx.temporal = makePtr<TemporalState>();
+        ctx.left_tmp.init(ctx.left_matcher, 0, 64, params.temporal_radius, params.temporal_static,
+                           params.temporal_diff, params.temporal);
+        if(ctx.use_conf)
+            ctx.right_tmp.init(ctx.left_matcher, 0, 64, params.temporal_radius, params.temporal_static,
+                           params.temporal_diff, params.temporal);
+    }
+    else if(ctx.use_conf && !ctx.census)
+    {
+        initBandedMatcher(ctx.left_bands, ctx.left_matcher, params.left_threads);
+        initBandedMatcher(ctx.right_bands, ctx.right_matcher, params.right_threads);
+    }
+    return true;
+}
+
+void matchFrame(StereoContext& ctx, StereoFrame& f)
+{
+    TraceScope convert_scope("color_convert");
+    if(ctx.use_conf && !ctx.params.no_downscale)
+    {
+        // 缩小图像以加速匹配阶段，因为我们需要计算左右视图的置信度图
+        // 转灰度不原地进行：原地转换会改变通道数，每帧都要重新分配缩小图和灰度图
+        //! [downscale]
+        Mat& left_small  = ctx.to_gray ? f.left_scaled  : f.left_for_matcher;
+        Mat& right_small = ctx.to_gray ? f.right_scaled : f.right_for_matcher;
+        resize(f.left ,left_small ,Size(),0.5,0.5);
+        resize(f.right,right_small,Size(),0.5,0.5);
+        //! [downscale]
+        if(ctx.to_gray)
+        {
+            cvtColor(f.left_scaled,  f.left_for_matcher,  COLOR_BGR2GRAY);
+            cvtColor(f.right_scaled, f.right_for_matcher, COLOR_BGR2GRAY);
+        }
+    }
+    else if(ctx.to_gray)
+    {
+        cvtColor(f.left,  f.left_for_matcher,  COLOR_BGR2GRAY);
+        cvtColor(f.right, f.right_for_matcher, COLOR_BGR2GRAY);
+    }
+    else
+    {
+        // 匹配器只读输入，直接引用原视图，不再每帧拷贝一份
+        f.left_for_matcher = f.left;
+        f.right_for_matcher = f.right;
+    }
+    convert_scope.end();
+
+    f.ROI = matcherROI(ctx, f.left_for_matcher.size());
+
+    //! [matching]
+    f.search_fraction = 1.0;
+    TraceScope match_scope("match");
+    f.matching_time = (double)getTickCount();
+    if(ctx.temporal)
+    {
+        TemporalState& st = *ctx.temporal;
+        {
+            lock_guard<mutex> guard(st.lock);
+            st.prior.copyTo(st.match_prior);
+            st.mask.copyTo(st.match_mask);
+            st.prior_right.copyTo(st.match_prior_right);
+        }
+        if(ctx.use_conf)
+        {
+            runLeftRight(ctx.params.lr_parallel, [&]()
+            {
+                TraceScope scope("match_left");
+                f.left_matching_time = (double)getTickCount();
+                ctx.left_tmp.compute(f.left_for_matcher, f.right_for_matcher, st.match_prior, st.match_mask, f.left_disp);
+                f.left_matching_time = ((double)getTickCount() - f.left_matching_time) / getTickFrequency();
+            }, [&]()
+            {
+                TraceScope scope("match_right");
+                f.right_matching_time = (double)getTickCount();
+                ctx.right_tmp.computeRight(f.left_for_matcher, f.right_for_matcher, st.match_prior_right, f.right_disp);
+                f.right_matching_time = ((double)getTickCount() - f.right_matching_time) / getTickFrequency();
+            });
+        }
+        else
+        {
+            ctx.left_tmp.compute(f.left_for_matcher, f.right_for_matcher, st.match_prior, st.match_mask, f.left_disp);
+        }
+        f.search_fraction = ctx.left_tmp.getSearchFraction();
+    }
+    else if(ctx.params.pyr_levels > 1 && ctx.use_conf)
+    {
+        runLeftRight(ctx.params.lr_parallel, [&]()
+        {
+            TraceScope scope("match_left");
+            f.left_matching_time = (double)getTickCount();
+            ctx.left_pyr.compute(f.left_for_matcher, f.right_for_matcher, f.left_disp);
+            f.left_matching_time = ((double)getTickCount() - f.left_matching_time) / getTickFrequency();
+        }, [&]()
+        {
+            TraceScope scope("match_right");
+            f.right_matching_time = (double)getTickCount();
+            ctx.right_pyr.computeRight(f.left_for_matcher, f.right_for_matcher, f.right_disp);
+            f.right_matching_time = ((double)getTickCount() - f.right_matching_time) / getTickFrequency();
+        });
+    }
+    else if(ctx.params.pyr_levels > 1)
+    {
+        ctx.left_pyr.compute(f.left_for_matcher, f.right_for_matcher, f.left_disp);
+    }
+    else if(ctx.use_conf && ctx.census)
+    {
+        // 右视差直接取自左匹配的聚合代价体，不需要单独的右匹配器
+        ctx.census->computeBoth(f.left_for_matcher, f.right_for_matcher, f.left_disp, f.right_disp);
+    }
+    else if(ctx.use_conf)
+    {
+        // 左右匹配互相独立：默认右匹配器在单独的线程上与左匹配器同时运行
+        runLeftRight(ctx.params.lr_parallel, [&]()
+        {
+            TraceScope scope("match_left");
+            f.left_matching_time = (double)getTickCount();
+            computeBanded(ctx.left_bands, f.left_for_matcher, f.right_for_matcher, f.left_disp);
+            f.left_matching_time = ((double)getTickCount() - f.left_matching_time) / getTickFrequency();
+        }, [&]()
+        {
+            TraceScope scope("match_right");
+            f.right_matching_time = (double)getTickCount();
+            computeBanded(ctx.right_bands, f.right_for_matcher, f.left_for_matcher, f.right_disp);
+            f.right_matching_time = ((double)getTickCount() - f.right_matching_time) / getTickFrequency();
+        });
+    }
+    else
+    {
+        ctx.left_matcher->compute(f.left_for_matcher, f.right_for_matcher, f.left_disp);
+    }
+    f.matching_time = ((double)getTickCount() - f.matching_time) / getTickFrequency();
+    match_scope.end();
+    if(ctx.params.pyr_levels > 1)
+        f.search_fraction = ctx.left_pyr.getSearchFraction();
+    if(!ctx.use_conf || (ctx.census && ctx.params.pyr_levels <= 1 && !ctx.temporal))
+    {
+        f.left_matching_time = f.matching_time;
+        f.right_matching_time = 0.0;
+    }
+    //! [matching]
+}
+
+// 时域平滑本帧输出，并把它作为下一帧匹配的预测
+static void updateTemporal(StereoContext& ctx, StereoFrame& f)
+{
+    TemporalState& st = *ctx.temporal;
+
+    // 与上一帧相差不到1个像素的视差向上一帧的输出靠拢；变化大的像素（运动、遮挡）保持本帧结果
+    const double a = ctx.params.temporal_smooth;
+    if(a > 0.0 && st.smoothed.size() == f.filtered_disp.size() && st.smoothed.type() == f.filtered_disp.type())
+    {
+        for(int y = 0; y < f.filtered_disp.rows; y++)
+        {
+            short* d = f.filtered_disp.ptr<short>(y);
+            const short* p = st.smoothed.ptr<short>(y);
+            for(int x = 0; x < f.filtered_disp.cols; x++)
+                if(std::abs(d[x] - p[x]) <= StereoMatcher::DISP_SCALE)
+                    d[x] = (short)cvRound(d[x] + a * (p[x] - d[x]));
+        }
+    }
+    f.filtered_disp.copyTo(st.smoothed);
+
+    // 预测在匹配视图尺寸上：缩小匹配时滤波结果同样缩小一半，视差值减半
+    const Size msize = f.left_disp.size();
+    const int invalid = (ctx.left_matcher->getMinDisparity() - 1) * StereoMatcher::DISP_SCALE;
+    const Mat* conf = &f.conf_map;
+    if(f.conf_map.size() != msize)
+    {
+        resize(f.conf_map, st.conf_small, msize, 0, 0, INTER_NEAREST);
+        conf = &st.conf_small;
+    }
+
+    lock_guard<mutex> guard(st.lock);
+    if(f.filtered_disp.size() != msize)
+    {
+        resize(f.filtered_disp, st.prior, msize, 0, 0, INTER_NEAREST);
+        st.prior.convertTo(st.prior, CV_16S, 0.5);
+    }
+    else
+    {
+        f.filtered_disp.copyTo(st.prior);
+    }
+
+    // 只信任原始匹配有效且置信度足够的像素，WLS填补出来的区域不用于预测
+    st.mask.create(msize, CV_8U);
+    for(int y = 0; y < msize.height; y++)
+    {
+        const short* raw = f.left_disp.ptr<short>(y);
+        const bool conf32f = conf->depth() == CV_32F;
+        const float* c32 = conf32f ? conf->ptr<float>(y) : 0;
+        const uchar* c8 = conf32f ? 0 : conf->ptr<uchar>(y);
+        uchar* m = st.mask.ptr<uchar>(y);
+        for(int x = 0; x < msize.width; x++)
+            m[x] = (raw[x] > invalid && (conf32f ? c32[x] : (float)c8[x]) >= TEMPORAL_MIN_CONF) ? 255 : 0;
+    }
+    if(ctx.use_conf)
+        f.right_disp.copyTo(st.prior_right);
+}
+
+// 选择性细化。原始视差先放大回原尺寸（与整图滤波之后的处理相同），区域太大时返回false，改为整图滤波
+static bool filterSelective(StereoContext& ctx, StereoFrame& f)
+{
+    // 缩小时匹配视图是原图的一半（奇数宽高时四舍五入），比例不能由两者的宽度相除得到
+    const int scale = ctx.params.no_downscale ? 1 : 2;
+    Rect roi = computeROI(f.left_disp.size(), ctx.left_matcher);
+    roi = Rect(roi.x * scale, roi.y * scale, roi.width * scale, roi.height * scale) & Rect(Point(), f.left.size());
+    if(scale != 1)
+    {
+        resize(f.left_disp, f.raw_disp, f.left.size());
+        f.raw_disp.convertTo(f.raw_disp, -1, (double)scale);
+    }
+    else
+    {
+        f.raw_disp = f.left_disp;
+    }
+    SelectiveWLS& sel = ctx.selective;
+    if(!sel.apply(f.left_disp, f.right_disp, ctx.left_matcher->getMinDisparity(), f.raw_disp, f.left, roi,
+                  ctx.wls_filter->getLambda(), ctx.wls_filter->getSigmaColor(), ctx.wls_filter->getDepthDiscontinuityRadius(),
+                  ctx.wls_filter->getLRCthresh(), ctx.params.selective_params, f.filtered_disp, f.conf_map))
+        return false;
+    f.ROI = roi;
+    f.refined_regions = sel.regions;
+    f.refined_fraction = sel.refined_fraction;
+    return true;
+}
+
+void filterFrame(StereoContext& ctx, StereoFrame& f, DisparityWLSFilter* wls)
+{
+    if(!wls)
+        wls = ctx.wls_filter.get();
+
+    //! [filtering]
+    TraceScope filter_scope("filter");
+    f.filtering_time = (double)getTickCount();
+    f.refined_regions = -1;
+    f.refined_fraction = 1.0;
+    // 参数扫描的额外滤波器实例按整图滤波比较参数
+    const bool selective = ctx.use_conf && ctx.params.selective && wls == ctx.wls_filter.get() && filterSelective(ctx, f);
+    if(ctx.use_conf && !selective)
+        wls->filter(f.left_disp, f.left, f.filtered_disp, f.right_disp, f.ROI);
+    else if(!ctx.use_conf && ctx.params.hole_fill)
+    {
+        // 不带置信度的WLS就是在ROI内对视差做快速全局平滑；lambda/sigma取自滤波器实例，参数扫描同样适用
+        TraceScope fill_scope("hole_fill");
+        const int min_disp = ctx.left_matcher->getMinDisparity();
+        fillDisparityHoles(f.left_disp, f.filled_disp, min_disp, ctx.params.fill_max_gap);
+        fill_scope.end();
+        smoothFilledDisparity(f.filled_disp, f.left, f.ROI, min_disp, wls->getLambda(), wls->getSigmaColor(),
+                              ctx.params.fill_iters, f.filtered_disp);
+    }
+    else if(!ctx.use_conf)
+        wls->filter(f.left_disp, f.left, f.filtered_disp, Mat(), f.ROI);
+    f.filtering_time = ((double)getTickCount() - f.filtering_time) / getTickFrequency();
+    filter_scope.end();
+    //! [filtering]
+
+    // 选择性细化时置信度图、ROI和原尺寸的原始视差已由filterSelective给出
+    if(ctx.use_conf && !selective)
+    {
+        TraceScope conf_scope("confidence");
+        wls->getConfidenceMap().copyTo(f.conf_map);
+        conf_scope.end();
+
+        // Get the ROI that was used in the last filter call:
+        f.ROI = wls->getROI();
+        if(!ctx.params.no_downscale)
+        {
+            // upscale raw disparity and ROI back for a proper comparison:
+            TraceScope scope("convert");
+            resize(f.left_disp, f.raw_disp, Size(), 2.0, 2.0);
+            f.raw_disp.convertTo(f.raw_disp, -1, 2.0);
+            f.ROI = Rect(f.ROI.x*2, f.ROI.y*2, f.ROI.width*2, f.ROI.height*2);
+        }
+        else
+        {
+            f.raw_disp = f.left_disp;
+        }
+    }
+    else if(!ctx.use_conf)
+    {
+        f.conf_map.create(f.left.size(), CV_8U);
+        f.conf_map = Scalar(255);
+        f.raw_disp = f.left_disp;
+    }
+
+    // 参数扫描等使用额外滤波器实例时不影响帧间状态
+    if(ctx.temporal && wls == ctx.wls_filter.get())
+    {
+        TraceScope scope("temporal");
+        updateTemporal(ctx, f);
+    }
+}
+
+Ptr<DisparityWLSFilter> createWLSFilter(const StereoContext& ctx)
+{
+    Ptr<DisparityWLSFilter> wls;
+    if(ctx.use_conf && !ctx.census)
+        // 克隆的匹配器参数已经被createStereoContext调整过，这里再调整一次结果不变，原匹配器不受影响
+        wls = createDisparityWLSFilter(cloneMatcher(ctx.left_matcher));
+    else
+        wls = createDisparityWLSFilterGeneric(ctx.use_conf);
+    wls->setDepthDiscontinuityRadius(ctx.wls_filter->getDepthDiscontinuityRadius());
+    wls->setLRCthresh(ctx.wls_filter->getLRCthresh());
+    wls->setLambda(ctx.wls_filter->getLambda());
+    wls->setSigmaColor(ctx.wls_filter->getSigmaColor());
+    return wls;
+}
+
+Rect matcherROI(const StereoContext& ctx, Size matcher_size)
+{
+    // 通用WLS滤波器（wls_no_conf以及census的wls_conf）需要手动给出ROI
+    if(!ctx.use_conf || ctx.census)
+        return computeROI(matcher_size, ctx.left_matcher);
+    return Rect();
+}
+
+Rect computeROI(Size2i src_sz, Ptr<StereoMatcher> matcher_instance)
+{
+    int min_disparity = matcher_instance->getMinDisparity();
+    int num_disparities = matcher_instance->getNumDisparities();
+    int block_size = matcher_instance->getBlockSize();
+
+    int bs2 = block_size / 2;
+    int minD = min_disparity;
+    int maxD = min_disparity + num_disparities - 1;
+
+    int xmin = maxD + bs2;
+    int xmax = src_sz.width + minD - bs2;
+    int ymin = bs2;
+    int ymax = src_sz.height - bs2;
+
+    Rect r(xmin, ymin, xmax - xmin, ymax - ymin);
+    return r;
+}
@@ -0,0 +1,139 @@
+#ifndef DISPARITY_STEREO_PIPELINE_HPP
+#define DISPARITY_STEREO_PIPELINE_HPP
+
+#include "opencv2/calib3d.hpp"
+#include "opencv2/ximgproc/disparity_filter.hpp"
+#include "census_sgm.hpp"
+#include "disparity_pyramid.hpp"
+#include "disparity_temporal.hpp"
+#include "selective_wls.hpp"
+#include "hole_fill.hpp"
+#include <mutex>
+#include <vector>
+
+// 立体匹配与后滤波参数
+struct StereoParams
+{
+    cv::String algo;
+    cv::String filter;
+    bool no_downscale;
+    int min_disp;      // minDisparity
+    int max_disp;      // numDisparities（16的倍数）
+    double lambda;
+    double sigma;
+    int wsize;
+    int left_threads;  // 左匹配器的行带线程数（仅wls_conf）
+    int right_threads; // 右匹配器的行带线程数（仅wls_conf）
+    bool lr_parallel;  // wls_conf下右匹配器在单独的线程上与左匹配器同时运行；false时在调用线程上依次运行
+    int pyr_levels;    // 由粗到细匹配的金字塔层数，<=1表示不使用
+    int temporal;      // 时域复用：>0时为关键帧间隔（帧数），0表示不使用；与金字塔互斥
+    int temporal_radius;     // 预测范围两侧多搜索的视差
+    double temporal_static;  // 块与上一帧的平均绝对差低于此值（灰度级）时沿用上一帧的视差
+    double temporal_diff;    // 块与上一帧的平均绝对差超过此值时完整搜索
+    double temporal_smooth;  // 输出的时域平滑系数，0表示不平滑
+    bool selective;          // wls_conf只在低置信度区域上求解WLS，其余像素保留原始视差
+    bool hole_fill;          // wls_no_conf在滤波前沿扫描线填洞，之后在ROI内做fill_iters次迭代的快速全局平滑
+    int fill_max_gap;        // 长于此值的无效段不填，0表示不限
+    int fill_iters;          // 填洞后平滑的迭代次数（默认与WLS滤波器内部相同，为3），lambda取自滤波器
+    SelectiveWLSParams selective_params;
+
+    StereoParams()
+        : algo("bm"), filter("wls_no_conf"), no_downscale(true), min_disp(0), max_disp(48), lambda(8000.0), sigma(1.0), wsize(15),
+          left_threads(1), right_threads(1), lr_parallel(true), pyr_levels(0), temporal(0), temporal_radius(2), temporal_static(3.0),
+          temporal_diff(8.0), temporal_smooth(0.3), selective(false), hole_fill(false),
+          fill_max_gap(0), fill_iters(HOLE_FILL_ITERS) {}
+};
+
+// 时域复用在帧之间传递的状态。滤波阶段写入、匹配阶段读取，序列模式下两者在不同线程上，
+// 所以由lock保护；匹配阶段拿到的是当时最近一帧已滤波的结果（流水线中通常是上上帧）
+struct TemporalState
+{
+    std::mutex lock;
+    cv::Mat prior, mask;  // 匹配视图尺寸：上一帧滤波后的视差、可信像素
+    cv::Mat prior_right;  // 上一帧的右视差（仅wls_conf）
+    cv::Mat match_prior, match_mask, match_prior_right; // 匹配阶段持有的副本
+    cv::Mat smoothed;     // 上一帧平滑后的输出（原尺寸），只由滤波阶段使用
+    cv::Mat conf_small;   // 置信度图缩小到匹配视图尺寸（缩小匹配时），只由滤波阶段使用
+};
+
+// 按行带并行的匹配器：每个行带使用独立的匹配器实例，因为StereoBM/StereoSGBM的内部缓冲区不是线程安全的。
+// 行带是近似：重叠区（blockSize/2 + 8 + 行带高度/10）不覆盖SGBM纵向/对角聚合的全部范围，
+// 结果随行带数变化，默认不分带（lr_threads=0:0）。1280x720、D=128的合成图上与整图匹配相比：
+// StereoBM（含斑点滤波）2~8个行带时不超过0.012%的像素不同，没有超过1px的差异；
+// SGBM 3WAY有5%~23%的像素存在亚像素差异，超过1px的为0.02%~0.08%
+struct BandedMatcher
+{
+    std::vector<cv::Ptr<cv::StereoMatcher> > matchers;
+    std::vector<cv::Mat> band_disp;
+};
+
+// 匹配器和WLS滤波器只创建一次，在整个序列中复用
+struct StereoContext
+{
+    StereoParams params;
+    cv::Ptr<cv::StereoMatcher> left_matcher;
+    cv::Ptr<cv::StereoMatcher> right_matcher; // 仅wls_conf使用
+    cv::Ptr<StereoCensusSGM> census;          // algo=census时与left_matcher相同，wls_conf下一次聚合同时得到左右视差
+    cv::Ptr<cv::ximgproc::DisparityWLSFilter> wls_filter;
+    BandedMatcher left_bands, right_bands;
+    PyramidMatcher left_pyr, right_pyr; // 仅pyr_levels>1时使用
+    TemporalMatcher left_tmp, right_tmp; // 仅temporal>0时使用
+    cv::Ptr<TemporalState> temporal;
+    SelectiveWLS selective; // 仅params.selective时使用
+    bool use_conf;
+    bool to_gray;
+};
+
+// 单帧的全部缓冲区；序列模式下这些缓冲区在流水线中循环复用，不会每帧重新分配
+struct StereoFrame
+{
+    int index;
+    cv::Mat left, right;
+    cv::Mat left_in, right_in; // 校正前的原始输入（仅启用校正时使用）
+    cv::Mat left_scaled, right_scaled; // 缩小匹配时缩小后、转灰度前的视图
+    cv::Mat left_for_matcher, right_for_matcher; // 不需要转换时直接引用left/right
+    cv::Mat left_disp, right_disp;
+    cv::Mat raw_disp; // 原始视差（缩小匹配时已放大回原尺寸）
+    cv::Mat filled_disp; // 填洞后的左视差（仅hole_fill）
+    cv::Mat filtered_disp;
+    cv::Mat conf_map;
+    cv::Rect ROI;
+    double matching_time, filtering_time;
+    double left_matching_time, right_matching_time; // 左右匹配器各自耗时（并行时两者重叠）
+    double decode_ms, match_ms, filter_ms; // 序列模式下各阶段耗时
+    double search_fraction; // 时域复用时左视差实际搜索的代价体比例，否则为1
+    int refined_regions;     // 选择性细化求解的区域数（整图滤波时为-1）
+    double refined_fraction; // 选择性细化求解的面积比例（整图滤波时为1）
+    int64 start_tick;
+};
+
+// 与disparity命令行相同的默认窗口大小
+int defaultWindowSize(const cv::String& algo, const cv::String& filter, bool no_downscale);
+
+// 与disparity命令行相同的默认minDisparity：sgbm+wls_no_conf为-16，其余为0
+int defaultMinDisparity(const cv::String& algo, const cv::String& filter);
+
+// 匹配器实际使用的视差范围：wls_conf在缩小一半的视图上匹配时范围减半（仍为16的倍数）
+int matcherMaxDisparity(int max_disp, const cv::String& filter, bool no_downscale);
+int matcherMinDisparity(int min_disp, const cv::String& filter, bool no_downscale);
+
+// 按params创建匹配器和WLS滤波器；算法或滤波方式不支持时返回false
+bool createStereoContext(const StereoParams& params, StereoContext& ctx);
+
+// 匹配阶段：准备匹配用的视图并计算左（以及右）视差
+void matchFrame(StereoContext& ctx, StereoFrame& f);
+
+// 滤波阶段：WLS后滤波，并取出置信度图和原始视差。wls非空时用它代替ctx.wls_filter，
+// 这样多个线程可以各用一个滤波器实例，对同一份匹配结果并行滤波（各自使用自己的StereoFrame）
+void filterFrame(StereoContext& ctx, StereoFrame& f, cv::ximgproc::DisparityWLSFilter* wls = 0);
+
+// 与ctx.wls_filter配置相同的新滤波器实例（lambda、sigma、不连续半径等都一样）
+cv::Ptr<cv::ximgproc::DisparityWLSFilter> createWLSFilter(const StereoContext& ctx);
+
+// 通用WLS滤波器需要的ROI；matcher_size为匹配所用视图（即视差图）的尺寸。ctx自己计算ROI时返回空矩形
+cv::Rect matcherROI(const StereoContext& ctx, cv::Size matcher_size);
+
+// 通用WLS滤波器（不使用置信度时）需要的有效视差区域
+cv::Rect computeROI(cv::Size2i src_sz, cv::Ptr<cv::StereoMatcher> matcher_instance);
+
+#endif
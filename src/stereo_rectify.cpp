@@ -0,0 +1,177 @@
+#include "stereo_rectify.hpp"
+#include "depth_io.hpp"
+#include "opencv2/calib3d.hpp"
+#include "opencv2/imgproc.hpp"
+#include "opencv2/core/utils/filesystem.hpp"
+#include <iostream>
+#include <thread>
+
+using namespace cv;
+using namespace std;
+
+// 定点表的类型；缓存文件中的类型必须与之一致
+static const int MAP_TYPES[4] = { CV_16SC2, CV_16UC1, CV_16SC2, CV_16UC1 };
+static const char* MAP_NAMES[4] = { "left_xy", "left_coef", "right_xy", "right_coef" };
+
+static Mat readMat(const FileStorage& fs, const char* name, const char* alt = 0)
+{
+    Mat m;
+    FileNode node = fs[name];
+    if(node.empty() && alt)
+        node = fs[alt];
+    if(!node.empty())
+        node >> m;
+    return m;
+}
+
+StereoRectifier::StereoRectifier() : has_rectification(false), alpha(-1.0)
+{
+}
+
+bool StereoRectifier::load(const String& calib_path, const String& _cache_dir, double _alpha)
+{
+    FileStorage fs(calib_path, FileStorage::READ);
+    if(!fs.isOpened())
+    {
+        cerr << "Cannot read calibration: " << calib_path << endl;
+        return false;
+    }
+    K1 = readMat(fs, "K1", "M1");
+    D1 = readMat(fs, "D1");
+    K2 = readMat(fs, "K2", "M2");
+    D2 = readMat(fs, "D2");
+    R = readMat(fs, "R");
+    T = readMat(fs, "T");
+    R1 = readMat(fs, "R1");
+    R2 = readMat(fs, "R2");
+    P1 = readMat(fs, "P1");
+    P2 = readMat(fs, "P2");
+    Q = readMat(fs, "Q");
+    if(K1.empty() || K2.empty())
+    {
+        cerr << "Calibration needs K1/M1 and K2/M2: " << calib_path << endl;
+        K1.release();
+        return false;
+    }
+    has_rectification = !R1.empty() && !R2.empty() && !P1.empty() && !P2.empty();
+    if(!has_rectification && (R.empty() || T.empty()))
+    {
+        cerr << "Calibration needs either R1/R2/P1/P2 or R/T: " << calib_path << endl;
+        K1.release();
+        return false;
+    }
+    // 文件只给出P1/P2时按stereoRectify（CALIB_ZERO_DISPARITY、水平基线）的公式补出Q
+    Mat p1, p2;
+    if(has_rectification && Q.empty())
+    {
+        P1.convertTo(p1, CV_64F);
+        P2.convertTo(p2, CV_64F);
+    }
+    if(p2.rows == 3 && p2.cols == 4 && p2.at<double>(0, 3) != 0.0)
+    {
+        const double f = p1.at<double>(0, 0), cx = p1.at<double>(0, 2), cy = p1.at<double>(1, 2);
+        const double tx = p2.at<double>(0, 3) / p2.at<double>(0, 0), cx2 = p2.at<double>(0, 2);
+        Q = (Mat_<double>(4, 4) << 1, 0, 0, -cx,
+                                   0, 1, 0, -cy,
+                                   0, 0, 0, f,
+                                   0, 0, -1.0 / tx, (cx - cx2) / tx);
+    }
+
+    // 缓存键取标定文件的内容而不是路径，标定文件被覆盖后旧表自动失效
+    vector<uchar> bytes;
+    if(!readFileBytes(calib_path, bytes))
+        return false;
+    unsigned long long h = 14695981039346656037ULL; // FNV-1a 64位
+    for(size_t i = 0; i < bytes.size(); i++)
+    {
+        h ^= bytes[i];
+        h *= 1099511628211ULL;
+    }
+    calib_hash = format("%016llx", h);
+    cache_dir = _cache_dir;
+    alpha = _alpha;
+    map_size = Size();
+    return true;
+}
+
+bool StereoRectifier::loadMaps(const String& prefix, Size size)
+{
+    for(int i = 0; i < 4; i++)
+    {
+        const String path = prefix + MAP_NAMES[i] + ".rdm";
+        if(!utils::fs::exists(path) || !mapped[i].open(path))
+            return false;
+        if(mapped[i].mat().size() != size || mapped[i].mat().type() != MAP_TYPES[i])
+            return false;
+        // remap只读取表，直接使用映射的内存
+        maps[i] = mapped[i].mat();
+    }
+    return true;
+}
+
+bool StereoRectifier::prepare(Size size)
+{
+    if(size == map_size)
+        return true;
+
+    if(!has_rectification)
+        stereoRectify(K1, D1, K2, D2, size, R, T, R1, R2, P1, P2, Q, CALIB_ZERO_DISPARITY, alpha);
+
+    String prefix;
+    if(!cache_dir.empty())
+    {
+        prefix = utils::fs::join(cache_dir, format("%s_%dx%d_%g_", calib_hash.c_str(), size.width, size.height, alpha));
+        if(loadMaps(prefix, size))
+        {
+            map_size = size;
+            map_source = "cache";
+            return true;
+        }
+    }
+
+    for(int i = 0; i < 4; i++)
+    {
+        mapped[i].close();
+        maps[i] = Mat();
+    }
+    initUndistortRectifyMap(K1, D1, R1, P1, size, CV_16SC2, maps[0], maps[1]);
+    initUndistortRectifyMap(K2, D2, R2, P2, size, CV_16SC2, maps[2], maps[3]);
+    map_size = size;
+    map_source = "generated";
+
+    if(!prefix.empty())
+    {
+        if(!utils::fs::isDirectory(cache_dir) && !utils::fs::createDirectories(cache_dir))
+        {
+            cerr << "Cannot create rectification cache: " << cache_dir << endl;
+            return true;
+        }
+        bool ok = true;
+        for(int i = 0; i < 4 && ok; i++)
+            ok = writeRawDepth(prefix + MAP_NAMES[i] + ".rdm", maps[i]);
+        if(ok)
+            map_source = "generated+cached";
+    }
+    return true;
+}
+
+bool StereoRectifier::rectify(const Mat& left, const Mat& right, Mat& left_rect, Mat& right_rect)
+{
+    CV_Assert(loaded());
+    if(left.size() != right.size())
+    {
+        cerr << "Left and right views differ in size" << endl;
+        return false;
+    }
+    if(!prepare(left.size()))
+        return false;
+
+    // 左右视图互相独立：右视图在单独的线程上与左视图同时remap
+    thread right_worker([&]()
+    {
+        remap(right, right_rect, maps[2], maps[3], INTER_LINEAR);
+    });
+    remap(left, left_rect, maps[0], maps[1], INTER_LINEAR);
+    right_worker.join();
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef DISPARITY_STEREO_RECTIFY_HPP
+#define DISPARITY_STEREO_RECTIFY_HPP
+
+#include "opencv2/core.hpp"
+#include "raw_depth.hpp"
+
+// 匹配前的极线校正。标定从YAML/XML读取：K1（或M1）、D1、K2（或M2）、D2、R、T，
+// 文件中有R1、R2、P1、P2（stereoRectify的结果）时直接使用，否则按alpha调用stereoRectify。
+//
+// remap表为定点格式（CV_16SC2坐标+CV_16UC1插值系数，每像素6字节，比两张CV_32F表少一半），
+// 每个分辨率只生成一次。cache_dir非空时表以.rdm保存，键为标定文件内容+分辨率+alpha，
+// 之后启动时直接映射缓存文件，不再调用initUndistortRectifyMap。
+class StereoRectifier
+{
+public:
+    StereoRectifier();
+
+    bool load(const cv::String& calib_path, const cv::String& cache_dir, double alpha = -1.0);
+    bool loaded() const { return !K1.empty(); }
+
+    // left/right为同尺寸的原始视图；尺寸变化时重新准备remap表。输出不能与输入共用内存
+    bool rectify(const cv::Mat& left, const cv::Mat& right, cv::Mat& left_rect, cv::Mat& right_rect);
+
+    // 校正后的重投影矩阵（reprojectImageTo3D）。标定文件有Q或R1/R2/P1/P2时load之后即有效，否则在第一次rectify之后有效
+    const cv::Mat& reprojection() const { return Q; }
+    // 标定内容和alpha的摘要，用于下游缓存（例如匹配缓存）的键
+    cv::String fingerprint() const { return cv::format("%s_%g", calib_hash.c_str(), alpha); }
+    // 最近一次准备remap表的方式："cache"、"generated"或"generated+cached"
+    const cv::String& mapSource() const { return map_source; }
+
+private:
+    StereoRectifier(const StereoRectifier&);
+    StereoRectifier& operator=(const StereoRectifier&);
+
+    bool prepare(cv::Size size);
+    bool loadMaps(const cv::String& prefix, cv::Size size);
+
+    cv::Mat K1, D1, K2, D2, R, T;
+    cv::Mat R1, R2, P1, P2, Q;
+    bool has_rectification;
+    double alpha;
+    cv::String cache_dir, calib_hash, map_source;
+
+    cv::Size map_size;
+    cv::Mat maps[4]; // 左xy、左插值系数、右xy、右插值系数
+    MappedDepth mapped[4];
+};
+
+#endif
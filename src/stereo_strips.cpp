@@ -0,0 +1,108 @@
+#include "stereo_strips.hpp"
+#include "tiled_wls.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace cv;
+using namespace std;
+
+int autoStripOverlap(const StereoParams& params)
+{
+    const int overlap = std::max(params.wsize / 2, autoWLSHalo(params.lambda, params.wsize));
+    return (overlap + 1) & ~1;
+}
+
+bool processStrips(const StereoParams& params, Size size, const StripOptions& opts,
+                   const StripReader& read, const StripSink& sink, StripStats& stats)
+{
+    CV_Assert(params.temporal == 0 && size.width > 0 && size.height > 0);
+    const int overlap = opts.overlap >= 0 ? (opts.overlap + 1) & ~1 : autoStripOverlap(params);
+    const int rows = std::max(16, (opts.rows + 1) & ~1);
+    const int nstrips = (size.height + rows - 1) / rows;
+    const int workers = std::min(opts.workers > 0 ? opts.workers : std::max(getNumberOfCPUs(), 1), nstrips);
+    stats.strips = nstrips;
+    stats.rows = rows;
+    stats.overlap = overlap;
+    stats.seconds = stats.matching_time = stats.filtering_time = 0.0;
+
+    // StereoBM/StereoSGBM/WLS的内部缓冲区不能共享，每个工作线程一套
+    vector<StereoContext> contexts(workers);
+    for(int w = 0; w < workers; w++)
+        if(!createStereoContext(params, contexts[w]))
+            return false;
+
+    // 并行度来自条带，关闭OpenCV内部的线程池以免互相争抢
+    const int saved_threads = getNumThreads();
+    if(workers > 1)
+        setNumThreads(1);
+
+    mutex lock;
+    condition_variable turn;
+    int next = 0, written = 0;
+    bool failed = false;
+    int64 start = getTickCount();
+    vector<thread> threads;
+
+    for(int w = 0; w < workers; w++)
+        threads.push_back(thread([&, w]()
+        {
+            StereoContext& ctx = contexts[w];
+            StereoFrame f; // 缓冲区在该线程处理的条带之间复用
+            for(;;)
+            {
+                int i;
+                {
+                    lock_guard<mutex> g(lock);
+                    if(failed || next >= nstrips)
+                        break;
+                    i = next++;
+                }
+                const int y0 = i * rows, y1 = std::min(size.height, y0 + rows);
+                const int s0 = std::max(0, y0 - overlap), s1 = std::min(size.height, y1 + overlap);
+
+                bool ok = read(s0, s1, f.left, f.right);
+                if(ok && (f.left.size() != Size(size.width, s1 - s0) || f.right.size() != f.left.size()))
+                {
+                    cerr << "Strip " << i << ": reader returned " << f.left.size() << " / " << f.right.size() << endl;
+                    ok = false;
+                }
+                if(ok)
+                {
+                    f.index = i;
+                    matchFrame(ctx, f);
+                    filterFrame(ctx, f);
+                }
+
+                // 按条带顺序输出：等前面的条带都写完。等待期间本条带的结果仍驻留，所以在途条带数不超过workers
+                unique_lock<mutex> g(lock);
+                turn.wait(g, [&]() { return failed || written == i; });
+                if(failed)
+                    break;
+                g.unlock();
+                ok = ok && sink(y0, y1, f, y0 - s0);
+                g.lock();
+                if(ok)
+                {
+                    stats.matching_time += f.matching_time;
+                    stats.filtering_time += f.filtering_time;
+                    written++;
+                }
+                else
+                {
+                    failed = true;
+                }
+                turn.notify_all();
+            }
+        }));
+
+    for(size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+    setNumThreads(saved_threads);
+    stats.seconds = (getTickCount() - start) / getTickFrequency();
+    return !failed && written == nstrips;
+}
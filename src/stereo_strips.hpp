@@ -0,0 +1,43 @@
+#ifndef DISPARITY_STEREO_STRIPS_HPP
+#define DISPARITY_STEREO_STRIPS_HPP
+
+#include "opencv2/core.hpp"
+#include "stereo_pipeline.hpp"
+#include <functional>
+
+// 条带流式处理超大立体对：图像按水平条带处理，每个条带上下各多读overlap行，独立匹配和滤波，
+// 只保留条带自身的行按顺序交给输出。条带之间并行，每个工作线程持有自己的StereoContext和StereoFrame，
+// 同时驻留内存的最多是workers个条带，峰值内存只与条带高度、图像宽度和线程数有关，与图像高度无关。
+//
+// overlap至少要覆盖匹配窗口（blockSize/2）；WLS和SGM的路径聚合影响更远，自动取值与filterWLSTiled的halo相同。
+struct StripOptions
+{
+    int rows;     // 每个条带输出的行数
+    int overlap;  // 条带上下各多读的行数，<0表示自动
+    int workers;  // 同时处理的条带数（0表示CPU核数）
+
+    StripOptions() : rows(1024), overlap(-1), workers(0) {}
+};
+
+struct StripStats
+{
+    int strips;
+    int rows, overlap; // 实际使用的条带行数和重叠行数
+    double seconds;
+    double matching_time, filtering_time; // 所有条带之和
+};
+
+// 读入原图[y0, y1)行的左右视图（8位，同宽）。多个工作线程会同时调用，实现必须可重入
+typedef std::function<bool(int y0, int y1, cv::Mat& left, cv::Mat& right)> StripReader;
+
+// 输出原图[y0, y1)行：f中的结果是整个条带的，其中第offset行对应原图第y0行。按y0递增的顺序串行调用
+typedef std::function<bool(int y0, int y1, const StereoFrame& f, int offset)> StripSink;
+
+// 自动overlap：max(blockSize/2, autoWLSHalo(lambda, blockSize))，取偶数（缩小匹配时条带边界对齐）
+int autoStripOverlap(const StereoParams& params);
+
+// size为整幅图像的尺寸。params.temporal必须为0（条带之间没有时间顺序）
+bool processStrips(const StereoParams& params, cv::Size size, const StripOptions& opts,
+                   const StripReader& read, const StripSink& sink, StripStats& stats);
+
+#endif
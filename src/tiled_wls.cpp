@@ -0,0 +1,121 @@
+#include "tiled_wls.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/ximgproc/disparity_filter.hpp"
+#include "opencv2/ximgproc/edge_filter.hpp"
+#include <algorithm>
+#include <vector>
+#include <cmath>
+
+using namespace cv;
+using namespace cv::ximgproc;
+using namespace std;
+
+int autoWLSHalo(double lambda, int radius)
+{
+    return (int)std::ceil(2.0 * std::sqrt(std::max(lambda, 0.0))) + std::max(radius, 0);
+}
+
+static Ptr<DisparityWLSFilter> createTileFilter(const TiledWLSParams& p)
+{
+    Ptr<DisparityWLSFilter> wls = createDisparityWLSFilterGeneric(false);
+    wls->setLambda(p.lambda);
+    wls->setSigmaColor(p.sigma);
+    wls->setDepthDiscontinuityRadius(p.radius);
+    return wls;
+}
+
+// 单块滤波：CV_16S走WLS滤波器；CV_32F直接用快速全局平滑（即不带置信度的WLS内部的求解），不做定点换算
+static void filterTile(const Mat& disp, const Mat& guide, Mat& result, const TiledWLSParams& p)
+{
+    if(disp.depth() == CV_32F)
+        fastGlobalSmootherFilter(guide, disp, result, p.lambda, p.sigma);
+    else
+        createTileFilter(p)->filter(disp, guide, result, Mat(), Rect(0, 0, disp.cols, disp.rows));
+}
+
+template<typename T>
+static void accumulateTile(const Mat& result, const Rect& ext, int bx0, int bx1, int by0, int by1,
+                           const vector<float>& wx, const vector<float>& wy, Mat& acc)
+{
+    for(int y = by0; y < by1; y++)
+    {
+        const T* src = result.ptr<T>(y - ext.y) + (bx0 - ext.x);
+        float* dst = acc.ptr<float>(y) + bx0;
+        const float fy = wy[y - by0];
+        for(int x = 0; x < bx1 - bx0; x++)
+            dst[x] += fy * wx[x] * src[x];
+    }
+}
+
+// 一维过渡权重：块的核心区间为[c0, c1)，在不与图像边界重合的一侧用宽2*blend的线性斜坡，
+// 相邻两块的斜坡互补，和为1
+static void blendRamp(int e0, int e1, int c0, int c1, int n, int blend, vector<float>& w)
+{
+    w.resize(e1 - e0);
+    for(int i = e0; i < e1; i++)
+    {
+        float x = i + 0.5f, v = 1.f;
+        if(c0 > 0)
+            v = std::min(v, std::max(0.f, (x - (c0 - blend)) / (2.f * blend)));
+        if(c1 < n)
+            v = std::min(v, std::max(0.f, ((c1 + blend) - x) / (2.f * blend)));
+        w[i - e0] = v;
+    }
+}
+
+void filterWLSTiled(const Mat& disp, const Mat& guide, Mat& filtered, const TiledWLSParams& params)
+{
+    CV_Assert((disp.type() == CV_16SC1 || disp.type() == CV_32FC1) && guide.size() == disp.size() && params.tile > 0);
+    const int width = disp.cols, height = disp.rows;
+    const int tile = params.tile;
+    const int halo = params.halo >= 0 ? params.halo : autoWLSHalo(params.lambda, params.radius);
+    const int blend = std::max(1, std::min(params.blend, tile / 2));
+
+    if(width <= tile && height <= tile)
+    {
+        filterTile(disp, guide, filtered, params);
+        return;
+    }
+
+    const int tiles_x = (width + tile - 1) / tile, tiles_y = (height + tile - 1) / tile;
+    Mat acc(disp.size(), CV_32F, Scalar(0));
+
+    // 按块坐标的奇偶分四轮：同一轮内的块（blend <= tile/2）扩展区互不重叠，可以无锁地累加到acc
+    for(int phase = 0; phase < 4; phase++)
+    {
+        vector<Point> tiles;
+        for(int ty = phase / 2; ty < tiles_y; ty += 2)
+            for(int tx = phase % 2; tx < tiles_x; tx += 2)
+                tiles.push_back(Point(tx, ty));
+
+        parallel_for_(Range(0, (int)tiles.size()), [&](const Range& r)
+        {
+            vector<float> wx, wy;
+            Mat result;
+            for(int i = r.start; i < r.end; i++)
+            {
+                const int x0 = tiles[i].x * tile, x1 = std::min(width, x0 + tile);
+                const int y0 = tiles[i].y * tile, y1 = std::min(height, y0 + tile);
+                // 加权区域：核心区外扩blend
+                const int bx0 = std::max(0, x0 - blend), bx1 = std::min(width, x1 + blend);
+                const int by0 = std::max(0, y0 - blend), by1 = std::min(height, y1 + blend);
+                // 参与滤波的区域：再外扩halo
+                const Rect ext(Point(std::max(0, bx0 - halo), std::max(0, by0 - halo)),
+                               Point(std::min(width, bx1 + halo), std::min(height, by1 + halo)));
+
+                filterTile(disp(ext), guide(ext), result, params);
+
+                blendRamp(bx0, bx1, x0, x1, width, blend, wx);
+                blendRamp(by0, by1, y0, y1, height, blend, wy);
+                if(result.depth() == CV_32F)
+                    accumulateTile<float>(result, ext, bx0, bx1, by0, by1, wx, wy, acc);
+                else
+                    accumulateTile<short>(result, ext, bx0, bx1, by0, by1, wx, wy, acc);
+            }
+        });
+    }
+    if(disp.depth() == CV_32F)
+        filtered = acc;
+    else
+        acc.convertTo(filtered, CV_16S);
+}
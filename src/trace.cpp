@@ -0,0 +1,337 @@
+#include "trace.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#define TRACE_RUSAGE 1
+#else
+#define TRACE_RUSAGE 0
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace
+{
+
+atomic<long long> g_allocs(0), g_frees(0), g_bytes(0);
+
+// 包装标准分配器，只计数；释放时通过currAllocator回到这里
+class CountingAllocator : public MatAllocator
+{
+public:
+    CountingAllocator() : std_alloc(Mat::getStdAllocator()) {}
+
+    UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                       AccessFlag flags, UMatUsageFlags usage) const override
+    {
+        UMatData* u = std_alloc->allocate(dims, sizes, type, data, step, flags, usage);
+        if(!u)
+            return u;
+        g_allocs++;
+        if(!data) // 外部数据只包装，不分配
+            g_bytes += (long long)u->size;
+        u->currAllocator = this;
+        return u;
+    }
+
+    bool allocate(UMatData* u, AccessFlag flags, UMatUsageFlags usage) const override
+    {
+        return std_alloc->allocate(u, flags, usage);
+    }
+
+    void deallocate(UMatData* u) const override
+    {
+        if(!u)
+            return;
+        g_frees++;
+        std_alloc->deallocate(u);
+    }
+
+private:
+    MatAllocator* std_alloc;
+};
+
+// 记录时只保存原始数据，写出时再换算
+struct TraceEvent
+{
+    const char* name;
+    int tid;
+    int64 start, end;
+    long long allocs, bytes;
+    double rss_mb;
+};
+
+struct StageSummary
+{
+    string name;
+    int calls;
+    double total_ms, max_ms;
+    long long allocs, bytes;
+    double peak_mb;        // 阶段结束时的进程峰值RSS（最大值）
+    double peak_growth_mb; // 单次调用使进程峰值RSS增长的最大值
+};
+
+// 长时间的序列模式下事件无限增长没有意义，超过上限只继续汇总
+const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+atomic<bool> g_enabled(false);
+atomic<int> g_next_tid(0);
+thread_local int t_tid = -1;
+
+mutex g_lock;
+int64 g_origin = 0;
+vector<TraceEvent> g_events;
+vector<StageSummary> g_stages;
+map<string, size_t> g_stage_index;
+long long g_dropped = 0;
+
+int threadId()
+{
+    if(t_tid < 0)
+        t_tid = g_next_tid++;
+    return t_tid;
+}
+
+void record(const TraceEvent& e, double peak0, double peak1)
+{
+    const double ms = (e.end - e.start) * 1000.0 / getTickFrequency();
+    lock_guard<mutex> g(g_lock);
+    if(g_events.size() < MAX_TRACE_EVENTS)
+        g_events.push_back(e);
+    else
+        g_dropped++;
+
+    map<string, size_t>::iterator it = g_stage_index.find(e.name);
+    if(it == g_stage_index.end())
+    {
+        StageSummary s;
+        s.name = e.name;
+        s.calls = 0;
+        s.total_ms = s.max_ms = 0.0;
+        s.allocs = s.bytes = 0;
+        s.peak_mb = s.peak_growth_mb = 0.0;
+        it = g_stage_index.insert(make_pair(s.name, g_stages.size())).first;
+        g_stages.push_back(s);
+    }
+    StageSummary& s = g_stages[it->second];
+    s.calls++;
+    s.total_ms += ms;
+    s.max_ms = std::max(s.max_ms, ms);
+    s.allocs += e.allocs;
+    s.bytes += e.bytes;
+    s.peak_mb = std::max(s.peak_mb, peak1);
+    s.peak_growth_mb = std::max(s.peak_growth_mb, peak1 - peak0);
+}
+
+// 阶段名都是代码中的字面量，这里只防御引号和反斜杠
+string jsonEscape(const char* s)
+{
+    string out;
+    for(; *s; s++)
+    {
+        if(*s == '"' || *s == '\\')
+            out += '\\';
+        out += *s;
+    }
+    return out;
+}
+
+} // namespace
+
+MatAllocator* matAllocCounter()
+{
+    // 不释放：进程结束前可能还有Mat引用着它分配的内存
+    static CountingAllocator* counter = new CountingAllocator();
+    return counter;
+}
+
+void installMatAllocCounter()
+{
+    static once_flag once;
+    call_once(once, []()
+    {
+        if(Mat::getDefaultAllocator() == Mat::getStdAllocator())
+            Mat::setDefaultAllocator(matAllocCounter());
+    });
+}
+
+MatAllocCounts matAllocCounts()
+{
+    MatAllocCounts c;
+    c.allocs = g_allocs.load(memory_order_relaxed);
+    c.frees = g_frees.load(memory_order_relaxed);
+    c.bytes = g_bytes.load(memory_order_relaxed);
+    return c;
+}
+
+double currentRSSMB()
+{
+#if defined(__linux__)
+    FILE* f = fopen("/proc/self/statm", "r");
+    if(!f)
+        return 0.0;
+    long pages = 0, resident = 0;
+    const int n = fscanf(f, "%ld %ld", &pages, &resident);
+    fclose(f);
+    return n == 2 ? resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0) : 0.0;
+#else
+    return 0.0;
+#endif
+}
+
+double peakRSSMB()
+{
+#if TRACE_RUSAGE
+    struct rusage ru;
+    if(getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0.0;
+#if defined(__APPLE__)
+    return ru.ru_maxrss / (1024.0 * 1024.0); // 字节
+#else
+    return ru.ru_maxrss / 1024.0;            // KB
+#endif
+#else
+    return 0.0;
+#endif
+}
+
+void traceEnable()
+{
+    installMatAllocCounter();
+    lock_guard<mutex> g(g_lock);
+    g_events.clear();
+    g_stages.clear();
+    g_stage_index.clear();
+    g_dropped = 0;
+    g_origin = getTickCount();
+    g_enabled = true;
+}
+
+bool traceEnabled()
+{
+    return g_enabled.load(memory_order_relaxed);
+}
+
+TraceScope::TraceScope(const char* _name)
+    : name(_name), active(traceEnabled()), start_tick(0), allocs0(0), bytes0(0), peak0(0.0)
+{
+    if(!active)
+        return;
+    const MatAllocCounts c = matAllocCounts();
+    allocs0 = c.allocs;
+    bytes0 = c.bytes;
+    peak0 = peakRSSMB();
+    start_tick = getTickCount();
+}
+
+void TraceScope::end()
+{
+    if(!active)
+        return;
+    active = false;
+    TraceEvent e;
+    e.end = getTickCount();
+    e.start = start_tick;
+    e.name = name;
+    e.tid = threadId();
+    const MatAllocCounts c = matAllocCounts();
+    e.allocs = c.allocs - allocs0;
+    e.bytes = c.bytes - bytes0;
+    e.rss_mb = currentRSSMB();
+    record(e, peak0, peakRSSMB());
+}
+
+bool writeTraceJson(const String& path)
+{
+    ofstream out(path.c_str());
+    if(!out)
+    {
+        cerr << "Cannot write trace: " << path << endl;
+        return false;
+    }
+    lock_guard<mutex> g(g_lock);
+    // 时间单位为微秒，相对traceEnable的时刻
+    const double us = 1e6 / getTickFrequency();
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    out << fixed << setprecision(3);
+    for(size_t i = 0; i < g_events.size(); i++)
+    {
+        const TraceEvent& e = g_events[i];
+        out << (i ? ",\n" : "\n")
+            << "{\"name\":\"" << jsonEscape(e.name) << "\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+            << ",\"ts\":" << (e.start - g_origin) * us << ",\"dur\":" << (e.end - e.start) * us
+            << ",\"args\":{\"allocs\":" << e.allocs << ",\"alloc_mb\":" << e.bytes / (1024.0 * 1024.0)
+            << ",\"rss_mb\":" << e.rss_mb << "}}";
+    }
+    out << "\n]}\n";
+    return (bool)out;
+}
+
+void printTraceSummary(ostream& os)
+{
+    lock_guard<mutex> g(g_lock);
+    const ios::fmtflags flags = os.flags();
+    const streamsize precision = os.precision();
+    os << fixed << setprecision(2);
+    os << "Trace summary (allocations are Mat buffers; overlapping stages share counts):" << endl;
+    os << "  " << left << setw(16) << "stage" << right << setw(7) << "calls" << setw(11) << "total ms"
+       << setw(10) << "max ms" << setw(9) << "allocs" << setw(11) << "alloc MB" << setw(13) << "peak RSS MB"
+       << setw(11) << "+peak MB" << endl;
+    for(size_t i = 0; i < g_stages.size(); i++)
+    {
+        const StageSummary& s = g_stages[i];
+        os << "  " << left << setw(16) << s.name << right << setw(7) << s.calls << setw(11) << s.total_ms
+           << setw(10) << s.max_ms << setw(9) << s.allocs << setw(11) << s.bytes / (1024.0 * 1024.0)
+           << setw(13) << s.peak_mb << setw(11) << s.peak_growth_mb << endl;
+    }
+    if(g_dropped > 0)
+        os << "  (" << g_dropped << " events beyond " << MAX_TRACE_EVENTS << " were summarized but not written)" << endl;
+    os << "  process peak RSS: " << peakRSSMB() << " MB" << endl;
+    os.flags(flags);
+    os.precision(precision);
+}
+
+TraceSession::TraceSession(const String& _path) : path(_path), done(_path.empty())
+{
+    if(!done)
+        traceEnable();
+}
+
+bool TraceSession::finish()
+{
+    if(done)
+        return true;
+    done = true;
+    printTraceSummary();
+    const bool ok = writeTraceJson(path);
+    if(ok)
+        cout << "Trace saved to: " << path << endl;
+    return ok;
+}
+
+String takeTraceArg(int& argc, char** argv)
+{
+    String path;
+    int n = 0;
+    for(int i = 0; i < argc; i++)
+    {
+        if(i > 0 && strncmp(argv[i], "--trace=", 8) == 0)
+            path = argv[i] + 8;
+        else
+            argv[n++] = argv[i];
+    }
+    argc = n;
+    return path;
+}
@@ -0,0 +1,88 @@
+#ifndef DISPARITY_TRACE_HPP
+#define DISPARITY_TRACE_HPP
+
+#include "opencv2/core.hpp"
+#include <iostream>
+
+// 轻量的分阶段计时与内存跟踪。各工具用--trace=<file.json>开启：
+//   - 每个TraceScope在析构时记录一个Chrome trace-event（"X"完整事件：阶段名、线程、开始时间、时长），
+//     写出的JSON可以直接在chrome://tracing或Perfetto中打开；
+//   - 同时按阶段名汇总：调用次数、总/最大耗时、期间的Mat分配次数和字节数、阶段结束时的进程峰值RSS
+//     以及该阶段使进程峰值RSS增长了多少。
+// 未开启时TraceScope只读一次全局开关，不计时、不加锁、不读RSS。
+//
+// 分配统计来自包装了默认MatAllocator的计数分配器，按全局计数器在阶段首尾的差值计：
+// 与其它线程上同时运行的阶段（例如并行的左右匹配器）重叠时，两个阶段都会计入对方的分配；
+// 嵌套的阶段（例如filter中的upsample）的时间和分配同样计入外层阶段。
+// 只统计经过Mat默认分配器的内存（cv::Mat/cv::UMat的主机内存），不含OpenCV内部的std::vector和cv::AutoBuffer。
+
+// 开启跟踪：清空已记录的事件并安装计数分配器
+void traceEnable();
+bool traceEnabled();
+
+// 把计数分配器设为Mat的默认分配器，重复调用无影响。之后的Mat分配都会计数，与是否开启跟踪无关。
+// 已安装缓冲区池时不替换它：池本身经过计数分配器向堆申请
+void installMatAllocCounter();
+
+// 计数分配器本身（包装标准分配器，不改变默认分配器），供其它分配器作为底层使用
+cv::MatAllocator* matAllocCounter();
+
+// 经过计数分配器的累计分配（没有任何分配经过它时全为0）
+struct MatAllocCounts
+{
+    long long allocs;
+    long long frees;
+    long long bytes;
+};
+
+MatAllocCounts matAllocCounts();
+
+// 当前RSS和进程峰值RSS（MB），不支持的平台返回0
+double currentRSSMB();
+double peakRSSMB();
+
+// 作用域计时：构造时开始，析构或end()时记录。name必须是静态存储的字符串（通常是字面量）
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name);
+    ~TraceScope() { end(); }
+
+    void end();
+
+private:
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    const char* name;
+    bool active;
+    int64 start_tick;
+    long long allocs0, bytes0;
+    double peak0;
+};
+
+// 写出Chrome trace-event JSON
+bool writeTraceJson(const cv::String& path);
+
+// 按阶段打印汇总表（阶段按第一次出现的顺序排列）
+void printTraceSummary(std::ostream& os = std::cout);
+
+// 工具main中的跟踪会话：path非空时开启跟踪；finish()（或析构时）写出JSON并打印汇总，只执行一次。
+// 交互显示（waitKey）之前应显式调用finish()，以免等待窗口关闭的时间影响输出时机
+class TraceSession
+{
+public:
+    explicit TraceSession(const cv::String& path);
+    ~TraceSession() { finish(); }
+
+    bool finish();
+
+private:
+    cv::String path;
+    bool done;
+};
+
+// 不使用CommandLineParser的工具：从argv中取出--trace=<file>并把它从参数列表中删去，返回路径（没有时为空）
+cv::String takeTraceArg(int& argc, char** argv);
+
+#endif
@@ -0,0 +1,210 @@
+#include "wls_sweep.hpp"
+#include "raw_depth.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/core/utils/filesystem.hpp"
+#include <sys/stat.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+
+using namespace cv;
+using namespace cv::ximgproc;
+using namespace std;
+
+bool parseSweepList(const String& text, vector<double>& values)
+{
+    values.clear();
+    stringstream ss(text);
+    string item;
+    while(getline(ss, item, ','))
+    {
+        char* end = 0;
+        double v = strtod(item.c_str(), &end);
+        if(item.empty() || *end != '\0')
+        {
+            cerr << "Invalid sweep value '" << item << "' in: " << text << endl;
+            return false;
+        }
+        values.push_back(v);
+    }
+    return !values.empty();
+}
+
+vector<WLSSweepPoint> makeSweepGrid(const vector<double>& lambdas, const vector<double>& sigmas, const vector<double>& radii)
+{
+    vector<WLSSweepPoint> points;
+    for(size_t i = 0; i < lambdas.size(); i++)
+        for(size_t j = 0; j < sigmas.size(); j++)
+            for(size_t k = 0; k < radii.size(); k++)
+            {
+                WLSSweepPoint p;
+                p.lambda = lambdas[i];
+                p.sigma = sigmas[j];
+                p.radius = cvRound(radii[k]);
+                points.push_back(p);
+            }
+    return points;
+}
+
+// 路径、大小和修改时间；文件不存在时只有路径
+static String fileStamp(const String& path)
+{
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0)
+        return path;
+    return format("%s:%lld:%lld", path.c_str(), (long long)st.st_size, (long long)st.st_mtime);
+}
+
+String matchCacheKey(const StereoParams& params, const String& left_path, const String& right_path, const String& extra)
+{
+    const String text = format("%s|%s|%d|%d:%d|%d|%d|%d:%d|", params.algo.c_str(), params.filter.c_str(),
+                               (int)params.no_downscale, params.min_disp, params.max_disp, params.wsize, params.pyr_levels,
+                               params.left_threads, params.right_threads) +
+                        fileStamp(left_path) + "|" + fileStamp(right_path) + "|" + extra;
+    // FNV-1a 64位
+    unsigned long long h = 14695981039346656037ULL;
+    for(size_t i = 0; i < text.size(); i++)
+    {
+        h ^= (unsigned char)text[i];
+        h *= 1099511628211ULL;
+    }
+    return format("%016llx", h);
+}
+
+static bool loadCachedDisp(const String& path, Size expected, Mat& disp)
+{
+    if(!utils::fs::exists(path))
+        return false;
+    MappedDepth mapped;
+    if(!mapped.open(path))
+        return false;
+    if(mapped.mat().type() != CV_16SC1 || mapped.mat().size() != expected)
+        return false;
+    mapped.mat().copyTo(disp);
+    return true;
+}
+
+bool loadMatchCache(const StereoContext& ctx, const String& dir, const String& key, StereoFrame& f)
+{
+    // 视差图与匹配所用视图同尺寸；缩小匹配时与resize(0.5)的取整方式一致
+    Size expected = f.left.size();
+    if(ctx.use_conf && !ctx.params.no_downscale)
+        expected = Size(cvRound(f.left.cols * 0.5), cvRound(f.left.rows * 0.5));
+
+    if(!loadCachedDisp(utils::fs::join(dir, key + "_left.rdm"), expected, f.left_disp))
+        return false;
+    if(ctx.use_conf && !loadCachedDisp(utils::fs::join(dir, key + "_right.rdm"), expected, f.right_disp))
+        return false;
+
+    f.ROI = matcherROI(ctx, expected);
+    f.matching_time = f.left_matching_time = f.right_matching_time = 0.0;
+    return true;
+}
+
+bool saveMatchCache(const StereoContext& ctx, const String& dir, const String& key, const StereoFrame& f)
+{
+    if(!utils::fs::isDirectory(dir) && !utils::fs::createDirectories(dir))
+    {
+        cerr << "Cannot create cache directory: " << dir << endl;
+        return false;
+    }
+    if(!writeRawDepth(utils::fs::join(dir, key + "_left.rdm"), f.left_disp))
+        return false;
+    return !ctx.use_conf || writeRawDepth(utils::fs::join(dir, key + "_right.rdm"), f.right_disp);
+}
+
+// 质量指标都在ROI内统计，ROI外是WLS没有处理的边界
+static void measure(const StereoContext& ctx, const StereoFrame& f, const Mat& gt, double bad_thresh, WLSSweepResult& r)
+{
+    const Rect roi = f.ROI & Rect(Point(), f.filtered_disp.size());
+    // 缩小匹配时raw_disp已经放大回原尺寸并乘2
+    const int raw_scale = (ctx.use_conf && !ctx.params.no_downscale) ? 2 : 1;
+    const int raw_min = ctx.left_matcher->getMinDisparity() * 16 * raw_scale;
+
+    double fid_sum = 0.0, smooth_sum = 0.0, abs_sum = 0.0;
+    size_t fid_n = 0, smooth_n = 0, gt_n = 0, bad_n = 0;
+    for(int y = roi.y; y < roi.y + roi.height; y++)
+    {
+        const short* d = f.filtered_disp.ptr<short>(y);
+        const short* dn = f.filtered_disp.ptr<short>(std::min(y + 1, roi.y + roi.height - 1));
+        const short* raw = f.raw_disp.ptr<short>(y);
+        const bool conf32f = f.conf_map.depth() == CV_32F;
+        const float* c32 = conf32f ? f.conf_map.ptr<float>(y) : 0;
+        const uchar* c8 = conf32f ? 0 : f.conf_map.ptr<uchar>(y);
+        const float* g = gt.empty() ? 0 : gt.ptr<float>(y);
+        for(int x = roi.x; x < roi.x + roi.width; x++)
+        {
+            const double v = d[x] / 16.0;
+            if(raw[x] >= raw_min && (conf32f ? c32[x] > 0.0f : c8[x] > 0))
+            {
+                fid_sum += std::abs(v - raw[x] / (16.0 * raw_scale));
+                fid_n++;
+            }
+            if(x + 1 < roi.x + roi.width)
+            {
+                smooth_sum += (std::abs(d[x + 1] - d[x]) + std::abs(dn[x] - d[x])) / 16.0;
+                smooth_n++;
+            }
+            if(g && g[x] > 0.0f && g[x] < 1e30f)
+            {
+                const double err = std::abs(v - g[x]);
+                abs_sum += err;
+                bad_n += err > bad_thresh;
+                gt_n++;
+            }
+        }
+    }
+    r.fidelity = fid_n ? fid_sum / fid_n : 0.0;
+    r.smoothness = smooth_n ? smooth_sum / smooth_n : 0.0;
+    r.bad = gt.empty() ? -1.0 : (gt_n ? (double)bad_n / gt_n : 0.0);
+    r.mae = gt.empty() ? -1.0 : (gt_n ? abs_sum / gt_n : 0.0);
+}
+
+void runWLSSweep(StereoContext& ctx, const StereoFrame& frame, const vector<WLSSweepPoint>& points,
+                 const Mat& gt, double bad_thresh, vector<WLSSweepResult>& results)
+{
+    CV_Assert(gt.empty() || (gt.type() == CV_32FC1 && gt.size() == frame.left.size()));
+    results.resize(points.size());
+
+    // 每个组合一个滤波器实例和一份输出；匹配结果和输入视图只读共享
+    parallel_for_(Range(0, (int)points.size()), [&](const Range& range)
+    {
+        for(int i = range.start; i < range.end; i++)
+        {
+            Ptr<DisparityWLSFilter> wls = createWLSFilter(ctx);
+            wls->setLambda(points[i].lambda);
+            wls->setSigmaColor(points[i].sigma);
+            wls->setDepthDiscontinuityRadius(points[i].radius);
+
+            StereoFrame f = frame;
+            f.filtered_disp = Mat();
+            f.conf_map = Mat();
+            f.raw_disp = Mat();
+            filterFrame(ctx, f, wls.get());
+
+            WLSSweepResult& r = results[i];
+            r.point = points[i];
+            r.filter_ms = f.filtering_time * 1000.0;
+            measure(ctx, f, gt, bad_thresh, r);
+        }
+    });
+}
+
+bool writeSweepTable(const String& path, const vector<WLSSweepResult>& results)
+{
+    ofstream out(path.c_str());
+    if(!out)
+    {
+        cerr << "Cannot write sweep table: " << path << endl;
+        return false;
+    }
+    out << "lambda,sigma,radius,filter_ms,fidelity,smoothness,bad,mae\n";
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const WLSSweepResult& r = results[i];
+        out << format("%g,%g,%d,%.3f,%.4f,%.4f,%.5f,%.4f\n", r.point.lambda, r.point.sigma, r.point.radius,
+                      r.filter_ms, r.fidelity, r.smoothness, r.bad, r.mae);
+    }
+    return (bool)out;
+}
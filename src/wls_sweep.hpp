@@ -0,0 +1,51 @@
+#ifndef DISPARITY_WLS_SWEEP_HPP
+#define DISPARITY_WLS_SWEEP_HPP
+
+#include "opencv2/core.hpp"
+#include "stereo_pipeline.hpp"
+#include <vector>
+
+// WLS参数扫描：匹配只做一次（或从缓存读回），之后对每组lambda/sigma/不连续半径只重跑filter，组合之间并行。
+
+struct WLSSweepPoint
+{
+    double lambda;
+    double sigma;
+    int radius; // setDepthDiscontinuityRadius
+};
+
+struct WLSSweepResult
+{
+    WLSSweepPoint point;
+    double filter_ms;  // 与其他组合并行运行时测得
+    double fidelity;   // 与原始视差的平均绝对差（像素），只统计有效且置信度>0的像素
+    double smoothness; // 滤波结果的平均梯度|dx|+|dy|（像素），越小越平滑
+    double bad;        // 有真值时：误差超过阈值的比例；没有真值时为-1
+    double mae;        // 有真值时：平均绝对误差（像素）；没有真值时为-1
+};
+
+// 逗号分隔的数值列表，例如"4000,8000,16000"
+bool parseSweepList(const cv::String& text, std::vector<double>& values);
+
+// 所有组合的笛卡尔积
+std::vector<WLSSweepPoint> makeSweepGrid(const std::vector<double>& lambdas, const std::vector<double>& sigmas,
+                                         const std::vector<double>& radii);
+
+// 匹配缓存的键：只包含影响匹配结果的参数（算法、视差范围、窗口、缩小、金字塔、行带线程）以及
+// 两个输入文件的路径、大小和修改时间。WLS参数不在其中，修改它们不会使缓存失效。
+// extra为匹配前其他影响输入的处理（例如校正标定的摘要）
+cv::String matchCacheKey(const StereoParams& params, const cv::String& left_path, const cv::String& right_path,
+                         const cv::String& extra = cv::String());
+
+// 从dir读回键为key的左右视差（.rdm），并按ctx设置f.ROI。缓存不存在或尺寸与f.left不符时返回false
+bool loadMatchCache(const StereoContext& ctx, const cv::String& dir, const cv::String& key, StereoFrame& f);
+bool saveMatchCache(const StereoContext& ctx, const cv::String& dir, const cv::String& key, const StereoFrame& f);
+
+// frame已完成匹配。gt为可选的CV_32F真值视差（像素），非有限值或<=0的像素不参与统计
+void runWLSSweep(StereoContext& ctx, const StereoFrame& frame, const std::vector<WLSSweepPoint>& points,
+                 const cv::Mat& gt, double bad_thresh, std::vector<WLSSweepResult>& results);
+
+// 结果表（CSV，每个组合一行）
+bool writeSweepTable(const cv::String& path, const std::vector<WLSSweepResult>& results);
+
+#endif